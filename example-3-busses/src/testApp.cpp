@@ -82,11 +82,15 @@ void testApp::setup()
 	
 	output.start();
 	
-//	Start each of the loops at the same time so that they're in sync
-	
-	source1.loop();
-	source2.loop();
-	source3.loop();
+//	Start each of the loops at the same time so that they're in sync.
+//	Calling loop() on each player would start them a tiny bit apart,
+//	so instead we add them to a transport, which schedules all of them
+//	to start on exactly the same sample
+	
+	transport.addPlayer(source1);
+	transport.addPlayer(source2);
+	transport.addPlayer(source3);
+	transport.loop();
 	
 	ofSetVerticalSync(true);
 }
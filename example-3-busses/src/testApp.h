@@ -26,6 +26,7 @@ public:
 	ofxAudioUnit filter;
 	
 	ofxAudioUnitFilePlayer source1, source2, source3;
+	ofxAudioUnitTransport transport;
 	ofxAudioUnitMixer mixer;
 	ofxAudioUnitOutput output;
 	
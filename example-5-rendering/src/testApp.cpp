@@ -100,6 +100,12 @@ OSStatus renderPulseSineChord(void * inRefCon,
 							  UInt32 inNumberFrames,
 							  AudioBufferList * ioData)
 {
+//	If you add OFXAU_DEBUG_REALTIME to your preprocessor macros and call
+//	ofxAudioUnitRealtimeCheck::enable(), this line will report anything
+//	that isn't safe to do in here (like allocating memory or printing).
+//	Otherwise, it does nothing.
+	OFXAU_REALTIME_SCOPE();
+	
 	static double phase = 0; // used to generate the sine waves
 	static double pulse = 0; // used to pulse the volume of the sine wave
 	
@@ -0,0 +1,786 @@
+#include "testApp.h"
+#include <Accelerate/Accelerate.h>
+#include <mach/mach_time.h>
+#include <sys/stat.h>
+
+//	This example doesn't play anything. Instead, it renders audio units
+//	"offline" : rather than connecting them to an output and letting the
+//	hardware pull samples through them, we call render() ourselves, as
+//	fast as the computer can go, with time stamps we make up. This is
+//	handy for measuring how much work a chain does, or for checking its
+//	output sample by sample.
+
+//	Here, we're timing ofxAudioUnitMixer against ofxAudioUnitNativeMixer
+//	as the number of input busses grows from 8 to 512. Each bus is fed by
+//	a render callback, so what's being measured is mostly the cost of
+//	mixing (and, for the AU mixer, its per-bus overhead).
+
+//	It also checks that players started together by ofxAudioUnitTransport
+//	really do start on the same sample. A handful of sample players and
+//	streaming file players all play a file holding a single click, mixed
+//	together. If they're aligned, the mix is one click exactly as loud as
+//	all of them put together, landing exactly where the transport's start
+//	time falls. This is checked at 44.1kHz and again with the players and
+//	mixer running at 48kHz.
+
+//	Then it times a decaying tail (a bank of filters left ringing with no
+//	input) with and without ofxAudioUnitDenormalGuard. Without it, the
+//	filters' state ends up as denormal floats, which are far slower to
+//	work with than ordinary ones.
+
+//	It also times ofxAudioUnitSpatialPanner placing 64 sources around 32
+//	speakers, in each of its panning modes.
+
+//	And it times ofxAudioUnitResampler at each of its quality levels, both
+//	at a constant rate and with the rate changing on every sample.
+
+//	Lastly, it times 32 stems of noise played through
+//	ofxAudioUnitTimeStretchNode at a different tempo and pitch, all mixed
+//	together.
+
+//	Pressing 'l' writes 500 short files and times loading them into sample
+//	players, first by calling setFile() on each in turn, then all at once
+//	with ofxAudioUnitLoader. It isn't run at startup, since writing the
+//	files takes a while.
+
+//	Finally, it feeds ofxAudioUnitSampler a dense MIDI stream (256 events
+//	in every buffer), scheduled one event at a time and then in batches
+//	with scheduleMidiEvents(), and counts how many events get through per
+//	second.
+
+//	The results are printed to the console and drawn in the window. Build
+//	in Release mode to get meaningful numbers.
+
+static const UInt32 kBenchmarkFrames  = 512;
+static const int    kWarmupBuffers    = 20;
+static const int    kTimedBuffers     = 500;
+static const int    kMinBusCount      = 8;
+static const int    kMaxBusCount      = 512;
+
+static const int    kAlignmentPlayers = 4;    // of each kind
+static const UInt32 kAlignmentFrames  = 512;
+static const int    kAlignmentBuffers = 16;
+static const UInt32 kStartFrame       = 3000; // where the start time falls
+
+static const int    kTailFilters      = 256;
+
+static const int    kPannerSources    = 64;
+static const int    kPannerSpeakers   = 32;
+
+static const UInt32 kResampleInput    = 65536;
+
+static const int    kStretchStems     = 32;
+
+static const int    kLoaderFiles      = 500;
+
+static const int    kMidiEventsPerBuffer = 256;
+
+//	Renders kTimedBuffers buffers from a unit and returns how long each one
+//	took on average, in microseconds
+static double timeRender(ofxAudioUnit &unit, int channels = 2)
+{
+	AudioBufferList * bufferList = allocBufferList(channels, kBenchmarkFrames);
+	
+	AudioTimeStamp timeStamp = {0};
+	timeStamp.mFlags = kAudioTimeStampSampleTimeValid | kAudioTimeStampHostTimeValid;
+	
+	uint64_t startTime = 0;
+	for(int i = 0; i < kWarmupBuffers + kTimedBuffers; i++)
+	{
+		if(i == kWarmupBuffers) startTime = mach_absolute_time();
+		
+		timeStamp.mSampleTime = i * kBenchmarkFrames;
+		timeStamp.mHostTime   = mach_absolute_time();
+		
+		AudioUnitRenderActionFlags flags = 0;
+		unit.render(&flags, &timeStamp, 0, kBenchmarkFrames, bufferList);
+	}
+	
+	double seconds = ofxAudioUnitHostTimeToSeconds(mach_absolute_time() - startTime);
+	releaseBufferList(bufferList);
+	
+	return seconds / kTimedBuffers * 1000000;
+}
+
+//	Writes a short stereo file that's silent apart from a full scale click
+//	on its first frame. It's written at 44.1kHz, which is the rate the
+//	players decode at, so the click isn't smeared by a sample rate
+//	conversion
+static bool writeClickFile(const string &filePath)
+{
+	AudioStreamBasicDescription format = {0};
+	format.mSampleRate       = 44100;
+	format.mFormatID         = kAudioFormatLinearPCM;
+	format.mFormatFlags      = kAudioFormatFlagsNativeFloatPacked;
+	format.mBytesPerPacket   = 2 * sizeof(Float32);
+	format.mFramesPerPacket  = 1;
+	format.mBytesPerFrame    = 2 * sizeof(Float32);
+	format.mChannelsPerFrame = 2;
+	format.mBitsPerChannel   = 8 * sizeof(Float32);
+	
+	CFURLRef fileURL = CFURLCreateFromFileSystemRepresentation(kCFAllocatorDefault,
+															   (const UInt8 *)filePath.c_str(),
+															   filePath.length(),
+															   false);
+	ExtAudioFileRef file;
+	OSStatus s = ExtAudioFileCreateWithURL(fileURL, kAudioFileCAFType, &format, NULL, kAudioFileFlags_EraseFile, &file);
+	CFRelease(fileURL);
+	if(s != noErr) return false;
+	
+	vector<Float32> samples(2 * 4096, 0);
+	samples[0] = samples[1] = 1;
+	
+	AudioBufferList bufferList;
+	bufferList.mNumberBuffers = 1;
+	bufferList.mBuffers[0].mNumberChannels = 2;
+	bufferList.mBuffers[0].mDataByteSize   = samples.size() * sizeof(Float32);
+	bufferList.mBuffers[0].mData           = &samples[0];
+	
+	s = ExtAudioFileWrite(file, samples.size() / 2, &bufferList);
+	ExtAudioFileDispose(file);
+	return s == noErr;
+}
+
+//	Changes the rate a native node runs at. It's a converter underneath,
+//	so its input (the rate it renders at) and output are both changed
+static void setNodeSampleRate(ofxAudioUnit &node, Float64 sampleRate)
+{
+	AudioUnit unit = *node.getUnit();
+	AudioUnitUninitialize(unit);
+	
+	AudioUnitScope scopes[] = {kAudioUnitScope_Input, kAudioUnitScope_Output};
+	for(int i = 0; i < 2; i++)
+	{
+		AudioStreamBasicDescription format;
+		UInt32 size = sizeof(format);
+		AudioUnitGetProperty(unit, kAudioUnitProperty_StreamFormat, scopes[i], 0, &format, &size);
+		format.mSampleRate = sampleRate;
+		AudioUnitSetProperty(unit, kAudioUnitProperty_StreamFormat, scopes[i], 0, &format, size);
+	}
+	
+	AudioUnitInitialize(unit);
+}
+
+//	Renders one buffer of a decaying tail : a bank of one pole filters,
+//	ringing down with nothing going into them
+static void renderTail(float * state, float * output, UInt32 frames)
+{
+	for(int i = 0; i < frames; i++)
+	{
+		float sum = 0;
+		for(int f = 0; f < kTailFilters; f++)
+		{
+			state[f] *= 0.999f;
+			sum += state[f];
+		}
+		output[i] = sum;
+	}
+}
+
+//	Times kTimedBuffers buffers of the tail and returns how long each one
+//	took on average, in microseconds. The filters start out quiet enough
+//	that they're denormal by the time the warmup buffers are done
+static double timeTail()
+{
+	vector<float> state(kTailFilters);
+	for(int f = 0; f < kTailFilters; f++)
+	{
+		state[f] = 1e-37f * (f + 1);
+	}
+	vector<float> output(kBenchmarkFrames);
+	
+	uint64_t startTime = 0;
+	for(int i = 0; i < kWarmupBuffers + kTimedBuffers; i++)
+	{
+		if(i == kWarmupBuffers) startTime = mach_absolute_time();
+		renderTail(&state[0], &output[0], kBenchmarkFrames);
+	}
+	
+	return ofxAudioUnitHostTimeToSeconds(mach_absolute_time() - startTime) / kTimedBuffers * 1000000;
+}
+
+//	Resamples kTimedBuffers buffers of noise and returns how long each
+//	output sample took on average, in nanoseconds. With rates, the rate
+//	is given per sample instead of being constant
+static double timeResample(const ofxAudioUnitResampler &resampler, const vector<float> &input, const float * rates)
+{
+	const float rate = 1.37;
+	const double margin = ofxAudioUnitResampler::kMaxKernelRadius;
+	const double lastPosition = input.size() - margin - kBenchmarkFrames * 2;
+	
+	vector<float> output(kBenchmarkFrames);
+	double position = margin;
+	
+	uint64_t startTime = 0;
+	for(int i = 0; i < kWarmupBuffers + kTimedBuffers; i++)
+	{
+		if(i == kWarmupBuffers) startTime = mach_absolute_time();
+		
+		if(rates)
+		{
+			position = resampler.resample(&input[0], position, &output[0], kBenchmarkFrames, rates);
+		}
+		else
+		{
+			position = resampler.resample(&input[0], position, &output[0], kBenchmarkFrames, rate);
+		}
+		
+		if(position > lastPosition) position = margin;
+	}
+	
+	double seconds = ofxAudioUnitHostTimeToSeconds(mach_absolute_time() - startTime);
+	return seconds / (kTimedBuffers * kBenchmarkFrames) * 1000000000;
+}
+
+//	Schedules kMidiEventsPerBuffer events for every one of kTimedBuffers
+//	buffers and renders them. Returns the seconds spent scheduling, and
+//	sets renderSeconds to the seconds spent rendering
+static double timeMidi(ofxAudioUnitSampler &sampler, const vector<ofxAudioUnitMidiEvent> &events, bool batched, double &renderSeconds)
+{
+	AudioBufferList * bufferList = allocBufferList(2, kBenchmarkFrames);
+	
+	AudioTimeStamp timeStamp = {0};
+	timeStamp.mFlags = kAudioTimeStampSampleTimeValid | kAudioTimeStampHostTimeValid;
+	
+	uint64_t scheduleTime = 0;
+	uint64_t renderTime = 0;
+	for(int i = 0; i < kWarmupBuffers + kTimedBuffers; i++)
+	{
+		if(i == kWarmupBuffers) scheduleTime = renderTime = 0;
+		
+		uint64_t startTime = mach_absolute_time();
+		if(batched)
+		{
+			sampler.scheduleMidiEvents(0, &events[0], events.size());
+		}
+		else
+		{
+			for(int e = 0; e < events.size(); e++)
+			{
+				sampler.scheduleMidiEvent(0, events[e].status, events[e].data1, events[e].data2);
+			}
+		}
+		uint64_t scheduledTime = mach_absolute_time();
+		
+		timeStamp.mSampleTime = i * kBenchmarkFrames;
+		timeStamp.mHostTime   = scheduledTime;
+		
+		AudioUnitRenderActionFlags flags = 0;
+		sampler.render(&flags, &timeStamp, 0, kBenchmarkFrames, bufferList);
+		
+		scheduleTime += scheduledTime - startTime;
+		renderTime   += mach_absolute_time() - scheduledTime;
+	}
+	
+	releaseBufferList(bufferList);
+	
+	renderSeconds = ofxAudioUnitHostTimeToSeconds(renderTime);
+	return ofxAudioUnitHostTimeToSeconds(scheduleTime);
+}
+
+//	Plays the click on every player at once and renders the mix. Returns
+//	a line describing how the result compares to what it should be
+static string checkAlignment(const string &clickFile, Float64 sampleRate)
+{
+	const int playerCount = kAlignmentPlayers * 2;
+	
+	ofxAudioUnitNativeMixer mixer(playerCount);
+	setNodeSampleRate(mixer, sampleRate);
+	
+	vector<ofPtr<ofxAudioUnitSamplePlayer> >        samplePlayers;
+	vector<ofPtr<ofxAudioUnitStreamingFilePlayer> > streamingPlayers;
+	ofxAudioUnitTransport transport;
+	
+	for(int i = 0; i < kAlignmentPlayers; i++)
+	{
+		samplePlayers.push_back(ofPtr<ofxAudioUnitSamplePlayer>(new ofxAudioUnitSamplePlayer()));
+		ofxAudioUnitSamplePlayer &player = *samplePlayers.back();
+		setNodeSampleRate(player, sampleRate);
+		player.setFile(clickFile);
+		player.connectTo(mixer, i);
+		transport.addPlayer(player);
+		
+		streamingPlayers.push_back(ofPtr<ofxAudioUnitStreamingFilePlayer>(new ofxAudioUnitStreamingFilePlayer()));
+		ofxAudioUnitStreamingFilePlayer &streamer = *streamingPlayers.back();
+		setNodeSampleRate(streamer, sampleRate);
+		streamer.setFile(clickFile);
+		streamer.connectTo(mixer, kAlignmentPlayers + i);
+		transport.addPlayer(streamer);
+	}
+	
+	// the time stamps are made up so that the start time falls on
+	// kStartFrame, however long it actually takes to get rendering
+	const uint64_t startTime = transport.play();
+	const uint64_t firstHostTime = startTime - ofxAudioUnitSecondsToHostTime(kStartFrame / sampleRate);
+	
+	// giving the streaming players' service thread time to fill them up
+	ofSleepMillis(250);
+	
+	AudioBufferList * bufferList = allocBufferList(2, kAlignmentFrames);
+	vector<float> mix;
+	
+	AudioTimeStamp timeStamp = {0};
+	timeStamp.mFlags = kAudioTimeStampSampleTimeValid | kAudioTimeStampHostTimeValid;
+	
+	for(int i = 0; i < kAlignmentBuffers; i++)
+	{
+		timeStamp.mSampleTime = i * kAlignmentFrames;
+		timeStamp.mHostTime   = firstHostTime + ofxAudioUnitSecondsToHostTime(timeStamp.mSampleTime / sampleRate);
+		
+		AudioUnitRenderActionFlags flags = 0;
+		mixer.render(&flags, &timeStamp, 0, kAlignmentFrames, bufferList);
+		
+		float * left = (float *)bufferList->mBuffers[0].mData;
+		mix.insert(mix.end(), left, left + kAlignmentFrames);
+	}
+	
+	releaseBufferList(bufferList);
+	
+	// anything outside of the loudest sample means the clicks didn't all
+	// land on the same frame
+	vDSP_Length peakFrame = 0;
+	float peak = 0;
+	vDSP_maxmgvi(&mix[0], 1, &peak, &peakFrame, mix.size());
+	
+	float total = 0;
+	vDSP_svemg(&mix[0], 1, &total, mix.size());
+	
+	const bool aligned = (peakFrame == kStartFrame &&
+						  fabsf(peak - playerCount) < 0.001 &&
+						  total - peak < 0.001);
+	
+	return (ofToString(sampleRate, 0) + " Hz: " +
+			(aligned ? "aligned" : "NOT aligned") +
+			" (peak " + ofToString(peak, 3) + " of " + ofToString(playerCount) +
+			" at frame " + ofToString(peakFrame) + ", expected " + ofToString(kStartFrame) +
+			", " + ofToString(total - peak, 3) + " elsewhere)");
+}
+
+//--------------------------------------------------------------
+void testApp::setup(){
+	ofSetVerticalSync(true);
+	runMixerBenchmark();
+	runAlignmentCheck();
+	runDenormalBenchmark();
+	runPannerBenchmark();
+	runResamplerBenchmark();
+	runTimeStretchBenchmark();
+	runMidiBenchmark();
+}
+
+//--------------------------------------------------------------
+void testApp::runMixerBenchmark(){
+
+//	The amount of time the hardware gives us to render each buffer.
+//	A mixer that takes longer than this can't keep up.
+	double budget = kBenchmarkFrames / 44100. * 1000000;
+	
+	results.clear();
+	results.push_back("busses    AU mixer (us)    native mixer (us)    (budget " + ofToString(budget, 0) + " us per buffer)");
+	
+	float sampleValue = 0.01;
+	AURenderCallbackStruct callback = {renderConstant, &sampleValue};
+	
+	for(int busses = kMinBusCount; busses <= kMaxBusCount; busses *= 2)
+	{
+		ofxAudioUnitMixer mixer;
+		mixer.setInputBusCount(busses);
+		
+		ofxAudioUnitNativeMixer nativeMixer(busses);
+		
+		for(int i = 0; i < busses; i++)
+		{
+			mixer.setRenderCallback(callback, i);
+			mixer.setInputVolume(1, i);
+			nativeMixer.setRenderCallback(callback, i);
+		}
+		
+		double mixerTime       = timeRender(mixer);
+		double nativeMixerTime = timeRender(nativeMixer);
+		
+		results.push_back(ofToString(busses, 6, ' ') + "    " +
+						  ofToString(mixerTime, 1, 13, ' ') + "    " +
+						  ofToString(nativeMixerTime, 1, 17, ' '));
+	}
+	
+	for(int i = 0; i < results.size(); i++)
+	{
+		cout << results[i] << endl;
+	}
+}
+
+//--------------------------------------------------------------
+void testApp::runAlignmentCheck(){
+
+	const char * tempDir = getenv("TMPDIR");
+	string clickFile = string(tempDir ? tempDir : "/tmp") + "/ofxAudioUnitClick.caf";
+	
+	vector<string> lines;
+	if(!writeClickFile(clickFile))
+	{
+		lines.push_back("Couldn't write " + clickFile);
+	}
+	else
+	{
+		lines.push_back("");
+		lines.push_back("transport alignment, " + ofToString(kAlignmentPlayers * 2) + " players:");
+		lines.push_back(checkAlignment(clickFile, 44100));
+		lines.push_back(checkAlignment(clickFile, 48000));
+	}
+	
+	for(int i = 0; i < lines.size(); i++)
+	{
+		cout << lines[i] << endl;
+		results.push_back(lines[i]);
+	}
+}
+
+//--------------------------------------------------------------
+void testApp::runDenormalBenchmark(){
+
+	double unguardedTime = timeTail();
+	
+	double guardedTime;
+	{
+		ofxAudioUnitDenormalGuard denormalGuard;
+		guardedTime = timeTail();
+	}
+	
+	vector<string> lines;
+	lines.push_back("");
+	lines.push_back("decaying tail, " + ofToString(kTailFilters) + " filters:");
+	lines.push_back("without denormal guard " + ofToString(unguardedTime, 1) + " us per buffer");
+	lines.push_back("with denormal guard    " + ofToString(guardedTime, 1) + " us per buffer");
+	
+	for(int i = 0; i < lines.size(); i++)
+	{
+		cout << lines[i] << endl;
+		results.push_back(lines[i]);
+	}
+}
+
+//--------------------------------------------------------------
+void testApp::runPannerBenchmark(){
+
+	double budget = kBenchmarkFrames / 44100. * 1000000;
+	
+	float sampleValue = 0.01;
+	AURenderCallbackStruct callback = {renderConstant, &sampleValue};
+	
+	ofxAudioUnitSpatialPanner panner(kPannerSources, kPannerSpeakers);
+	for(int i = 0; i < kPannerSources; i++)
+	{
+		panner.setRenderCallback(callback, i);
+		panner.setSourcePosition(i * 360. / kPannerSources, 0, i);
+	}
+	
+	ofxAudioUnitPanningMode modes[] = {
+		OFX_AU_PAN_VBAP,
+		OFX_AU_PAN_AMBISONIC_FIRST_ORDER,
+		OFX_AU_PAN_AMBISONIC_THIRD_ORDER
+	};
+	string modeNames[] = {"VBAP", "1st order ambisonics", "3rd order ambisonics"};
+	
+	vector<string> lines;
+	lines.push_back("");
+	lines.push_back("spatial panner, " + ofToString(kPannerSources) + " sources to " +
+					ofToString(kPannerSpeakers) + " speakers (budget " + ofToString(budget, 0) + " us per buffer):");
+	
+	for(int i = 0; i < 3; i++)
+	{
+		panner.setMode(modes[i]);
+		double pannerTime = timeRender(panner, kPannerSpeakers);
+		lines.push_back(modeNames[i] + " " + ofToString(pannerTime, 1) + " us per buffer");
+	}
+	
+	for(int i = 0; i < lines.size(); i++)
+	{
+		cout << lines[i] << endl;
+		results.push_back(lines[i]);
+	}
+}
+
+//--------------------------------------------------------------
+void testApp::runResamplerBenchmark(){
+
+	vector<float> input(kResampleInput);
+	for(int i = 0; i < input.size(); i++)
+	{
+		input[i] = ofRandom(-1, 1);
+	}
+	
+	// sweeping between 0.5 and 2 once per buffer
+	vector<float> rates(kBenchmarkFrames);
+	for(int i = 0; i < rates.size(); i++)
+	{
+		rates[i] = 1.25 + 0.75 * sin(2 * M_PI * i / kBenchmarkFrames);
+	}
+	
+	ofxAudioUnitResamplerQuality qualities[] = {
+		OFX_AU_RESAMPLE_LINEAR,
+		OFX_AU_RESAMPLE_CUBIC,
+		OFX_AU_RESAMPLE_SINC
+	};
+	string qualityNames[] = {"linear", "cubic ", "sinc  "};
+	
+	vector<string> lines;
+	lines.push_back("");
+	lines.push_back("resampler, ns per output sample    constant rate    rate per sample");
+	
+	for(int i = 0; i < 3; i++)
+	{
+		ofxAudioUnitResampler resampler(1, qualities[i]);
+		double constantTime = timeResample(resampler, input, NULL);
+		double modulatedTime = timeResample(resampler, input, &rates[0]);
+		
+		lines.push_back(qualityNames[i] + "                             " +
+						ofToString(constantTime, 1, 13, ' ') + "    " +
+						ofToString(modulatedTime, 1, 15, ' '));
+	}
+	
+	for(int i = 0; i < lines.size(); i++)
+	{
+		cout << lines[i] << endl;
+		results.push_back(lines[i]);
+	}
+}
+
+//--------------------------------------------------------------
+void testApp::runTimeStretchBenchmark(){
+
+	double budget = kBenchmarkFrames / 44100. * 1000000;
+	
+	ofxAudioUnitNativeMixer mixer(kStretchStems);
+	vector<ofPtr<ofxAudioUnitTimeStretchNode> > stems;
+	vector<uint32_t> noiseStates(kStretchStems);
+	
+	for(int i = 0; i < kStretchStems; i++)
+	{
+		noiseStates[i] = 0x9E3779B9 + i;
+		AURenderCallbackStruct callback = {renderNoise, &noiseStates[i]};
+		
+		stems.push_back(ofPtr<ofxAudioUnitTimeStretchNode>(new ofxAudioUnitTimeStretchNode()));
+		ofxAudioUnitTimeStretchNode &stem = *stems.back();
+		stem.setRenderCallback(callback);
+		stem.setTempo(1.25);
+		stem.setPitch(3);
+		stem.connectTo(mixer, i);
+	}
+	
+	double stretchTime = timeRender(mixer);
+	
+	vector<string> lines;
+	lines.push_back("");
+	lines.push_back("time stretch, " + ofToString(kStretchStems) + " stems at 1.25x tempo, +3 semitones:");
+	lines.push_back(ofToString(stretchTime, 1) + " us per buffer (" +
+					ofToString(stretchTime / kStretchStems, 1) + " us per stem, budget " +
+					ofToString(budget, 0) + " us per buffer)");
+	
+	for(int i = 0; i < lines.size(); i++)
+	{
+		cout << lines[i] << endl;
+		results.push_back(lines[i]);
+	}
+}
+
+//--------------------------------------------------------------
+void testApp::runLoaderBenchmark(){
+
+	const char * tempDir = getenv("TMPDIR");
+	string folder = string(tempDir ? tempDir : "/tmp") + "/ofxAudioUnitLoaderFiles";
+	mkdir(folder.c_str(), 0755);
+	
+	vector<string> filePaths;
+	for(int i = 0; i < kLoaderFiles; i++)
+	{
+		filePaths.push_back(folder + "/click" + ofToString(i) + ".caf");
+		if(!writeClickFile(filePaths.back()))
+		{
+			cout << "Couldn't write " << filePaths.back() << endl;
+			results.push_back("Couldn't write " + filePaths.back());
+			return;
+		}
+	}
+	
+	// the players are made up front, so that only loading is timed
+	vector<ofPtr<ofxAudioUnitSamplePlayer> > players;
+	for(int i = 0; i < kLoaderFiles; i++)
+	{
+		players.push_back(ofPtr<ofxAudioUnitSamplePlayer>(new ofxAudioUnitSamplePlayer()));
+	}
+	
+	uint64_t startTime = mach_absolute_time();
+	for(int i = 0; i < kLoaderFiles; i++)
+	{
+		players[i]->setFile(filePaths[i]);
+	}
+	double sequentialTime = ofxAudioUnitHostTimeToSeconds(mach_absolute_time() - startTime);
+	
+	// the files have to be decoded again rather than found in the cache
+	for(int i = 0; i < kLoaderFiles; i++)
+	{
+		players[i]->setSample(ofxAudioUnitSampleBufferRef());
+	}
+	ofxAudioUnitSampleCache::shared().purge();
+	
+	ofxAudioUnitLoader loader;
+	for(int i = 0; i < kLoaderFiles; i++)
+	{
+		loader.add(*players[i], filePaths[i]);
+	}
+	
+	startTime = mach_absolute_time();
+	loader.start();
+	loader.wait();
+	double loaderTime = ofxAudioUnitHostTimeToSeconds(mach_absolute_time() - startTime);
+	
+	ofxAudioUnitSampleCache::shared().purge();
+	
+	vector<string> lines;
+	lines.push_back("");
+	lines.push_back("loading " + ofToString(kLoaderFiles) + " files into sample players:");
+	lines.push_back("setFile() one at a time " + ofToString(sequentialTime * 1000, 1) + " ms");
+	lines.push_back("ofxAudioUnitLoader      " + ofToString(loaderTime * 1000, 1) + " ms (" +
+					ofToString(sequentialTime / loaderTime, 1) + "x faster, " +
+					ofToString(loader.getFailedFiles().size()) + " failed)");
+	
+	for(int i = 0; i < lines.size(); i++)
+	{
+		cout << lines[i] << endl;
+		results.push_back(lines[i]);
+	}
+}
+
+//--------------------------------------------------------------
+void testApp::runMidiBenchmark(){
+
+	// short notes, each turned off a little after it's turned on, spread
+	// evenly across the buffer
+	vector<ofxAudioUnitMidiEvent> events(kMidiEventsPerBuffer);
+	for(int i = 0; i < events.size(); i++)
+	{
+		const int note = i / 2;
+		events[i].status = (i % 2 ? ofxAudioUnitSampler::kMidiMessage_NoteOff : ofxAudioUnitSampler::kMidiMessage_NoteOn) << 4;
+		events[i].data1  = 36 + note % 48;
+		events[i].data2  = i % 2 ? 0 : 100;
+		events[i].offset = note * 2 * kBenchmarkFrames / kMidiEventsPerBuffer + (i % 2);
+	}
+	
+	ofxAudioUnitSampler sampler;
+	
+	vector<string> lines;
+	lines.push_back("");
+	lines.push_back("sampler, " + ofToString(kMidiEventsPerBuffer) + " MIDI events per buffer    scheduling (events/s)    with rendering (events/s)");
+	
+	for(int batched = 0; batched < 2; batched++)
+	{
+		double renderSeconds;
+		double scheduleSeconds = timeMidi(sampler, events, batched, renderSeconds);
+		sampler.clearScheduledEvents();
+		
+		const double eventCount = (double)kTimedBuffers * kMidiEventsPerBuffer;
+		
+		lines.push_back(string(batched ? "scheduleMidiEvents() " : "scheduleMidiEvent()  ") + "                  " +
+						ofToString(eventCount / scheduleSeconds, 0, 21, ' ') + "    " +
+						ofToString(eventCount / (scheduleSeconds + renderSeconds), 0, 25, ' '));
+	}
+	
+	for(int i = 0; i < lines.size(); i++)
+	{
+		cout << lines[i] << endl;
+		results.push_back(lines[i]);
+	}
+}
+
+//	Every bus gets the same constant signal. It isn't silent, since the
+//	native mixer skips busses that are.
+OSStatus renderConstant(void * inRefCon,
+						AudioUnitRenderActionFlags * ioActionFlags,
+						const AudioTimeStamp * inTimeStamp,
+						UInt32 inBusNumber,
+						UInt32 inNumberFrames,
+						AudioBufferList * ioData)
+{
+	float * value = (float *)inRefCon;
+	
+	for(int i = 0; i < ioData->mNumberBuffers; i++)
+	{
+		vDSP_vfill(value, (float *)ioData->mBuffers[i].mData, 1, inNumberFrames);
+	}
+	
+	return noErr;
+}
+
+//	White noise, from a xorshift generator whose state is the ref con, so
+//	that every stem gets different noise
+OSStatus renderNoise(void * inRefCon,
+					 AudioUnitRenderActionFlags * ioActionFlags,
+					 const AudioTimeStamp * inTimeStamp,
+					 UInt32 inBusNumber,
+					 UInt32 inNumberFrames,
+					 AudioBufferList * ioData)
+{
+	uint32_t * state = (uint32_t *)inRefCon;
+	
+	for(int i = 0; i < inNumberFrames; i++)
+	{
+		*state ^= *state << 13;
+		*state ^= *state >> 17;
+		*state ^= *state << 5;
+		const float sample = (*state / 4294967295.0) * 0.5 - 0.25;
+		
+		for(int c = 0; c < ioData->mNumberBuffers; c++)
+		{
+			((float *)ioData->mBuffers[c].mData)[i] = sample;
+		}
+	}
+	
+	return noErr;
+}
+
+//--------------------------------------------------------------
+void testApp::update(){
+
+}
+
+//--------------------------------------------------------------
+void testApp::draw(){
+	ofBackground(30);
+	ofSetColor(255);
+	
+	for(int i = 0; i < results.size(); i++)
+	{
+		ofDrawBitmapString(results[i], ofPoint(20, 20 + i * 20));
+	}
+	
+	ofDrawBitmapString("Press a key to run a test : 'm' mixers, 'a' alignment, 'd' denormals, 'p' panner, 'r' resampler, 's' time stretch, 'l' loader, 'n' MIDI", ofPoint(20, ofGetHeight() - 20));
+}
+
+//--------------------------------------------------------------
+void testApp::keyPressed(int key){
+	if(key == 'm') runMixerBenchmark();
+	if(key == 'a') runAlignmentCheck();
+	if(key == 'd') runDenormalBenchmark();
+	if(key == 'p') runPannerBenchmark();
+	if(key == 'r') runResamplerBenchmark();
+	if(key == 's') runTimeStretchBenchmark();
+	if(key == 'l') runLoaderBenchmark();
+	if(key == 'n') runMidiBenchmark();
+}
+
+//--------------------------------------------------------------
+void testApp::keyReleased(int key){}
+//--------------------------------------------------------------
+void testApp::mouseMoved(int x, int y ){}
+//--------------------------------------------------------------
+void testApp::mouseDragged(int x, int y, int button){}
+//--------------------------------------------------------------
+void testApp::mousePressed(int x, int y, int button){}
+//--------------------------------------------------------------
+void testApp::mouseReleased(int x, int y, int button){}
+//--------------------------------------------------------------
+void testApp::windowResized(int w, int h){}
+//--------------------------------------------------------------
+void testApp::gotMessage(ofMessage msg){}
+//--------------------------------------------------------------
+void testApp::dragEvent(ofDragInfo dragInfo){}
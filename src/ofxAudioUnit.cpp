@@ -96,12 +96,19 @@ void ofxAudioUnit::connectTo(ofxAudioUnit &otherUnit, int destinationBus, int so
 // ----------------------------------------------------------
 {
 	if(!_unit) return;
+	otherUnit.connectInput(*this, destinationBus, sourceBus);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnit::connectInput(ofxAudioUnit &source, int destinationBus, int sourceBus)
+// ----------------------------------------------------------
+{
 	AudioUnitConnection connection;
-	connection.sourceAudioUnit    = *_unit;
+	connection.sourceAudioUnit    = *(source._unit);
 	connection.sourceOutputNumber = sourceBus;
 	connection.destInputNumber    = destinationBus;
 	
-	OFXAU_PRINT(AudioUnitSetProperty(*(otherUnit._unit),
+	OFXAU_PRINT(AudioUnitSetProperty(*_unit,
 									 kAudioUnitProperty_MakeConnection,
 									 kAudioUnitScope_Input,
 									 destinationBus,
@@ -141,6 +148,7 @@ OSStatus ofxAudioUnit::render(AudioUnitRenderActionFlags *ioActionFlags,
 							  AudioBufferList *ioData)
 // ----------------------------------------------------------
 {
+	ofxAudioUnitDenormalGuard denormalGuard;
 	return AudioUnitRender(*_unit, ioActionFlags, inTimeStamp,
 						   inOutputBusNumber, inNumberFrames, ioData);
 }
@@ -5,9 +5,17 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <map>
 #include "ofPolyline.h"
 #include "ofTypes.h"
 #include "ofxAudioUnitUtils.h"
+#include "ofxAudioUnitFadeScheduler.h"
+#include "ofxAudioUnitSampleCache.h"
+#include "ofxAudioUnitResampler.h"
+#include "ofxAudioUnitTimeStretcher.h"
+#include "ofxAudioUnitWaveformOverview.h"
+#include "ofxAudioUnitDecodeCache.h"
+#include "ofxAudioUnitEvents.h"
 
 #pragma mark ofxAudioUnit
 
@@ -32,6 +40,11 @@ protected:
 	bool loadPreset(const CFURLRef &presetURL);
 	bool savePreset(const CFURLRef &presetURL);
 	
+	// called on the destination unit by connectTo(). Units that don't take
+	// their input from a real Audio Unit bus (see ofxAudioUnitNativeNode)
+	// override this to pull from the source themselves
+	virtual void connectInput(ofxAudioUnit &source, int destinationBus, int sourceBus);
+	
 public:
 	ofxAudioUnit(){};
 	ofxAudioUnit(AudioComponentDescription description);
@@ -66,12 +79,12 @@ public:
 	bool saveCustomPresetAtPath(const std::string &presetPath);
 	bool loadCustomPresetAtPath(const std::string &presetPath);
 	
-	void setRenderCallback(AURenderCallbackStruct callback, int destinationBus = 0);
+	virtual void setRenderCallback(AURenderCallbackStruct callback, int destinationBus = 0);
 	void setParameter(AudioUnitParameterID property, AudioUnitScope scope, AudioUnitParameterValue value, int bus = 0);
 	void reset(){AudioUnitReset(*_unit, kAudioUnitScope_Global, 0);}
 	
-	bool setInputBusCount(unsigned int numberOfInputBusses);
-	unsigned int getInputBusCount() const;
+	virtual bool setInputBusCount(unsigned int numberOfInputBusses);
+	virtual unsigned int getInputBusCount() const;
 	bool setOutputBusCount(unsigned int numberOfOutputBusses);
 	unsigned int getOutputBusCount() const;
 	
@@ -101,21 +114,64 @@ static void AudioUnitDeleter(AudioUnit * unit);
 // the current level in decibles (most likely in the 
 // range -120 - 0)
 
+// If you're displaying meters for every bus, call
+// enableAllMetering() once and then getInputLevels()
+// with an array of 2 floats per bus. Each bus gets
+// its average power followed by its sample peak,
+// both in decibels relative to full scale. The peak
+// is held for a moment (by the unit itself) and then
+// decayed at the rate given to setPeakHold().
+
+// getInputLevels() saves calls into your app, but not
+// work inside the mixer: it still asks the unit for
+// each bus's levels one at a time, and the unit still
+// meters and mixes each bus separately. With hundreds
+// of busses, ofxAudioUnitNativeMixer is much cheaper.
+
+// The set functions change volume and pan immediately,
+// which will click if the change is large. The ramp
+// functions move to the new value over a number of
+// samples instead, following one of the curves in
+// ofxAudioUnitFadeCurve. Ramps are turned into
+// scheduled parameter changes on the render thread,
+// one buffer at a time.
+
+// Copies of a mixer share its unit, along with its
+// volumes and any ramps in progress.
+
 class ofxAudioUnitMixer : public ofxAudioUnit
 {
+	ofxAudioUnitMeterBallistics _ballistics;
+	
+	struct Fades;
+	ofPtr<Fades> _fades;
+
 public:
 	ofxAudioUnitMixer();
+	ofxAudioUnitMixer(const ofxAudioUnitMixer &orig);
+	ofxAudioUnitMixer& operator=(const ofxAudioUnitMixer &orig);
+	
+	bool setInputBusCount(unsigned int numberOfInputBusses);
 	
 	void setInputVolume (float volume, int bus = 0);
 	void setOutputVolume(float volume);
 	void setPan(float pan, int bus = 0);
 	
+	void rampInputVolume (float volume, UInt32 durationInSamples, int bus = 0, ofxAudioUnitFadeCurve curve = OFX_AU_FADE_LINEAR);
+	void rampOutputVolume(float volume, UInt32 durationInSamples, ofxAudioUnitFadeCurve curve = OFX_AU_FADE_LINEAR);
+	void rampPan(float pan, UInt32 durationInSamples, int bus = 0, ofxAudioUnitFadeCurve curve = OFX_AU_FADE_LINEAR);
+	
 	float getInputLevel(int bus = 0);
 	float getOutputLevel() const;
 	void  enableInputMetering(int bus = 0);
 	void  enableOutputMetering();
 	void  disableInputMetering(int bus = 0);
 	void  disableOutputMetering();
+	
+	void  enableAllMetering();
+	void  disableAllMetering();
+	unsigned int getInputLevels(float * levels, unsigned int busCount);
+	void  setPeakHold(float holdSeconds, float decayDecibelsPerSecond);
 };
 
 #pragma mark - ofxAudioUnitFilePlayer
@@ -124,6 +180,16 @@ public:
 // This audio unit allows you to play any file that
 // Core Audio supports (mp3, aac, caf, aiff, etc)
 
+// getOverview() returns the file's waveform overview for drawing (see
+// ofxAudioUnitWaveformOverview). It starts loading in the background
+// when the file is set. Call getOverview().setLazy(true) first to only
+// load it once something asks it for peaks.
+
+// loop() can only repeat the whole region, since looping is left to the
+// unit. For loop points with a crossfade at the seam, play the file with
+// an ofxAudioUnitSamplePlayer (or, for long files, an
+// ofxAudioUnitStreamingFilePlayer) instead.
+
 enum
 {
 	OFX_AU_LOOP_FOREVER = -1
@@ -134,6 +200,12 @@ class ofxAudioUnitFilePlayer : public ofxAudioUnit
 	AudioFileID _fileID[1];
 	ScheduledAudioFileRegion _region;
 	
+	struct RegionQueue;
+	ofPtr<RegionQueue> _queue;
+	struct Transport;
+	ofPtr<Transport> _transport;
+	ofPtr<ofxAudioUnitWaveformOverview> _overview;
+
 public:
 	ofxAudioUnitFilePlayer();
 	~ofxAudioUnitFilePlayer();
@@ -141,6 +213,7 @@ public:
 	bool   setFile(const std::string &filePath);
 	UInt32 getLength();
 	void   setLength(UInt32 length);
+	ofxAudioUnitWaveformOverview& getOverview() {return *_overview;}
 	
 	// You can get the startTime arg from mach_absolute_time().
 	// Note that all of these args are optional; you can just
@@ -148,6 +221,31 @@ public:
 	void play(uint64_t startTime = 0);
 	void loop(unsigned int timesToLoop = OFX_AU_LOOP_FOREVER, uint64_t startTime = 0);
 	void stop();
+	
+	// The frame of the file that's playing, as of the last buffer the unit
+	// rendered. It's kept up to date by the render thread, so reading it
+	// is only a memory load (unlike asking the unit for its current play
+	// time) and it's fine to call for many players every frame. While the
+	// region queue plays, it's the number of frames played since
+	// playQueue() instead.
+	UInt32 getPosition();
+	
+	// proc is called (off the render thread, see ofxAudioUnitEventQueue)
+	// each time playback loops or finishes, and each time a queued region
+	// finishes. Pass NULL to stop the calls.
+	void setEventCallback(ofxAudioUnitEventProc proc, void * context = NULL);
+	
+	// The region queue plays a list of regions back to back, without gaps,
+	// across any number of files. A few regions are scheduled on the unit
+	// ahead of time, and more are scheduled in the background as those
+	// finish, so the queue can be any length and can be added to while
+	// it plays. framesToPlay = 0 plays to the end of the file.
+	// clearQueue() removes the regions that haven't been scheduled yet, and
+	// stop() stops the queue and drops the regions that were scheduled.
+	void queueRegion(const std::string &filePath, UInt32 startFrame = 0, UInt32 framesToPlay = 0);
+	void playQueue(uint64_t startTime = 0);
+	void clearQueue();
+	unsigned int getQueuedRegionCount();
 };
 
 #pragma mark - ofxAudioUnitOutput
@@ -237,10 +335,58 @@ public:
 
 #pragma mark - ofxAudioUnitSampler
 
+// The midi functions send their events to the unit right away, so they
+// land at the start of the next buffer the unit renders. For timing finer
+// than a buffer, schedule events at a host time (from
+// mach_absolute_time()) instead. Scheduled events are handed to the
+// render thread through a lock-free queue, and each is sent to the unit
+// in the buffer its time falls in, offset to the exact sample. Events
+// whose time has already passed are sent at the start of the next
+// buffer. Up to 1024 events can be waiting at once, and the schedule
+// functions return false if there's no room.
+
+// Chords and bursts of events can be scheduled all at once with
+// scheduleMidiEvents(). The whole batch is handed over in one go (or not
+// at all, if it doesn't fit), and each event is sent its offset in
+// samples after the batch's host time. A host time of 0 sends the batch
+// from the start of the next buffer.
+
+// setSample() and setSamples() block until the unit has loaded every
+// sample, and the unit goes quiet meanwhile. setSamplesAsync() loads the
+// samples into a new unit on ofxAudioUnitThreadPool instead, while the
+// current one keeps playing, then swaps the new unit in. The completion
+// is called on the pool's thread once the new unit is playing (or the
+// load has failed). The new unit keeps:
+//  - the stream format and maximum frames per slice
+//  - the last setBank() and setProgram(), as of when the load started
+//  - every global scope parameter (volume, tuning, gain and anything
+//    else set with setParameter() on the global scope), as of the swap
+//  - scheduled events that haven't been sent yet
+//  - its connection to whatever the sampler was last connected to
+// Everything else starts fresh: notes held on the old unit are cut off,
+// other MIDI state (controllers, pitch bend) is reset, and parameters in
+// other scopes go back to their defaults. A preset's instrument is
+// replaced by the new samples, just as with setSamples().
+
+struct ofxAudioUnitMidiEvent
+{
+	UInt32 status;
+	UInt32 data1;
+	UInt32 data2;
+	UInt32 offset;
+};
+
 class ofxAudioUnitSampler : public ofxAudioUnit 
 {
+	struct Scheduler;
+	struct Swap;
+	ofPtr<Scheduler> _scheduler;
+	ofPtr<Swap> _swap;
+	void initShared();
 	
 public:
+	typedef void (*LoadCompletionProc)(bool loaded, void * context);
+	
 	ofxAudioUnitSampler();
 	ofxAudioUnitSampler(AudioComponentDescription description);
     ofxAudioUnitSampler(OSType type,
@@ -251,6 +397,15 @@ public:
     
 	bool setSample(const std::string &samplePath);
 	bool setSamples(const std::vector<std::string> &samplePaths);
+	
+	// returns false if the sampler is already loading
+	bool setSamplesAsync(const std::vector<std::string> &samplePaths,
+						 LoadCompletionProc completion = NULL,
+						 void * context = NULL);
+	bool isLoading() const;
+	
+	using ofxAudioUnit::connectTo;
+	void connectTo(ofxAudioUnit &otherUnit, int destinationBus = 0, int sourceBus = 0);
     
     void midiEvent(const UInt32 status, const UInt32 data1, const UInt32 data2);
     void setBank(const UInt32 msb, const UInt32 lsb);
@@ -259,6 +414,14 @@ public:
     void midiNoteOn(const UInt32 note, const UInt32 vel);
     void midiNoteOff(const UInt32 note, const UInt32 vel);
     void setVolume(float volume);
+
+	bool scheduleMidiEvent(uint64_t hostTime, const UInt32 status, const UInt32 data1, const UInt32 data2);
+	bool scheduleNoteOn(uint64_t hostTime, const UInt32 note, const UInt32 vel);
+	bool scheduleNoteOff(uint64_t hostTime, const UInt32 note, const UInt32 vel);
+	bool scheduleMidiEvents(uint64_t hostTime, const ofxAudioUnitMidiEvent * events, UInt32 count);
+	
+	// drops every scheduled event that hasn't been sent yet
+	void clearScheduledEvents();
     
     UInt32 midiChannelInUse;
     
@@ -334,6 +497,998 @@ public:
 	void setSource(ofxAudioUnit * source);
 };
 
+#pragma mark - ofxAudioUnitNativeNode
+
+// ofxAudioUnitNativeNode is a base class for nodes whose processing is
+// done by the addon itself rather than by an Apple Audio Unit. It wraps an
+// AUConverter so that it can still be connected to (and pulled by) regular
+// Audio Units, and calls renderNode() from the converter's render callback.
+
+// Sources connected to a native node (via connectTo(), a tap or a render
+// callback) aren't connected to a real Audio Unit bus. Instead, the node
+// keeps track of them and pulls them itself with pullInput(). All audio
+// inside a native node is non-interleaved 32 bit float, which is the
+// canonical Audio Unit format on OS X.
+
+class ofxAudioUnitNativeNode : public ofxAudioUnit
+{
+public:
+	ofxAudioUnitNativeNode(UInt32 outputChannels = 2);
+	virtual ~ofxAudioUnitNativeNode();
+	
+	void setRenderCallback(AURenderCallbackStruct callback, int destinationBus = 0);
+	
+	enum
+	{
+		kMaxFramesPerSlice = 4096
+	};
+
+protected:
+	struct InputSource
+	{
+		AURenderCallbackStruct callback;
+		AudioUnitRef unit;
+		UInt32 sourceBus;
+	};
+	
+	std::vector<InputSource> _inputs;
+	ofMutex _renderMutex;
+	UInt32 _outputChannels;
+	
+	void connectInput(ofxAudioUnit &source, int destinationBus, int sourceBus);
+	void resizeInputs(unsigned int inputCount);
+	bool isInputConnected(unsigned int bus) const;
+	
+	// Stops the converter from calling renderNode(). Subclasses should call
+	// this first thing in their destructor, before releasing anything that
+	// renderNode() uses.
+	void detachNode();
+	
+	OSStatus pullInput(unsigned int bus,
+					   AudioUnitRenderActionFlags *ioActionFlags,
+					   const AudioTimeStamp *inTimeStamp,
+					   UInt32 inNumberFrames,
+					   AudioBufferList *ioData);
+	
+	// How many frames into the buffer starting at inTimeStamp a host time
+	// (see mach_absolute_time()) falls, at the sample rate renderNode()
+	// is running at. 0 if it has already passed, or if the time stamp has
+	// no host time.
+	UInt32 framesUntilHostTime(uint64_t hostTime, const AudioTimeStamp *inTimeStamp) const;
+	
+	// The sample rate renderNode() runs at (44.1kHz unless the node's
+	// input format has been changed). Only a memory load, so it's safe to
+	// call on the render thread.
+	Float64 getNodeSampleRate() const {return _sampleRate;}
+	
+	// Called on the render thread with _renderMutex held. ioData is
+	// _outputChannels non-interleaved float buffers.
+	virtual OSStatus renderNode(AudioUnitRenderActionFlags *ioActionFlags,
+								const AudioTimeStamp *inTimeStamp,
+								UInt32 inNumberFrames,
+								AudioBufferList *ioData) = 0;
+
+private:
+	// the sample rate of the converter's input, which renderNode() fills.
+	// Kept up to date by a property listener, so the render thread never
+	// has to ask the unit for it
+	volatile Float64 _sampleRate;
+	
+	ofxAudioUnitNativeNode(const ofxAudioUnitNativeNode &orig);
+	ofxAudioUnitNativeNode& operator=(const ofxAudioUnitNativeNode &orig);
+	
+	static void streamFormatChanged(void *inRefCon,
+									AudioUnit inUnit,
+									AudioUnitPropertyID inID,
+									AudioUnitScope inScope,
+									AudioUnitElement inElement);
+	
+	static OSStatus nodeRenderCallback(void *inRefCon,
+									   AudioUnitRenderActionFlags *ioActionFlags,
+									   const AudioTimeStamp *inTimeStamp,
+									   UInt32 inBusNumber,
+									   UInt32 inNumberFrames,
+									   AudioBufferList *ioData);
+};
+
+#pragma mark - ofxAudioUnitNativeMixer
+
+// ofxAudioUnitNativeMixer has the same interface as ofxAudioUnitMixer,
+// but does its mixing natively instead of wrapping the AUMultiChannelMixer.
+// It's meant for setups with a large number of input busses (hundreds),
+// where the AUMultiChannelMixer's per-bus overhead starts to dominate.
+
+// Every input bus is rendered into one contiguous block of memory, then
+// the busses are accumulated into the output with vectorized (vDSP)
+// multiply-adds. The accumulation is done in short blocks of frames so
+// that the output block stays in cache while all of the busses are
+// streamed through it.
+
+// Inputs are expected to be stereo. Pan is a balance control, like the
+// AUMultiChannelMixer's pan for stereo inputs. Levels are reported in
+// decibels, as with ofxAudioUnitMixer, and getInputLevels() gives the
+// same {average power, sample peak} pairs, with the peak held for the
+// time given to setPeakHold() before decaying. Ramps are applied per
+// sample, as a linear gain ramp across each buffer. Volumes and pans are
+// only ever changed by the render thread : setInputVolume(),
+// setOutputVolume() and setPan() are zero-length ramps, which glide to
+// the new value over the next buffer.
+
+// Busses can be gathered into named submix groups with addGroup() and
+// setGroup(). Groups can be nested, and each one has a VCA-style volume
+// which scales every bus inside it. A group with no inserts costs nothing
+// extra : its volume is folded into its busses' gains and they are mixed
+// in the same pass as everything else. Adding inserts to a group (with
+// addGroupInsert()) gives it its own submix buffer, which is run through
+// the insert chain before being mixed into its parent. Inserts should use
+// the mixer's stream format (stereo, non-interleaved float).
+
+class ofxAudioUnitNativeMixer : public ofxAudioUnitNativeNode
+{
+	struct BusState
+	{
+		float volume;
+		float pan;
+		float gain[2];
+		float startGain[2];
+		bool  ramping;
+		bool  metering;
+		bool  rendered;
+		float averagePower;
+		float peakLevel;
+		int   group;
+		int   destination;
+		float destinationGain;
+	};
+	
+	struct Group
+	{
+		std::string name;
+		int   parent;
+		volatile float volume; // only written by setGroupVolume()
+		std::vector<AudioUnitRef> inserts;
+		AudioBufferList * mixBuffer;
+		AudioBufferList * outputBuffer;
+		AudioUnitSampleType * outputSamples;
+		
+		// routing, worked out at the start of every buffer. Members of a
+		// group mix into memberDestination (-1 being the mixer's output)
+		// scaled by memberGain. Groups with inserts mix their output into
+		// outputDestination, scaled by outputGain
+		int   memberDestination;
+		float memberGain;
+		int   outputDestination;
+		float outputGain;
+		
+		Group();
+		~Group();
+	};
+	
+	std::vector<BusState> _busses;
+	std::vector<ofPtr<Group> > _groups;
+	std::vector<AudioBufferList *> _busBuffers;
+	AudioUnitSampleType * _busSamples;
+	
+	float _outputVolume;
+	bool  _outputMetering;
+	float _outputAveragePower;
+	float _outputPeakLevel;
+	
+	ofxAudioUnitMeterBallistics _ballistics;
+	ofxAudioUnitFadeScheduler   _fades;
+	
+	void updateBusGain(BusState &bus);
+	void setTargetValue(unsigned int target, float value);
+	void releaseBusBuffers();
+	void updateGroupRouting();
+	bool renderGroupInserts(const AudioTimeStamp *inTimeStamp, UInt32 inNumberFrames, AudioUnitSampleType * out[2]);
+	void disconnectGroupInserts(Group &group);
+	
+	OSStatus renderNode(AudioUnitRenderActionFlags *ioActionFlags,
+						const AudioTimeStamp *inTimeStamp,
+						UInt32 inNumberFrames,
+						AudioBufferList *ioData);
+	
+	static OSStatus groupInputCallback(void *inRefCon,
+									   AudioUnitRenderActionFlags *ioActionFlags,
+									   const AudioTimeStamp *inTimeStamp,
+									   UInt32 inBusNumber,
+									   UInt32 inNumberFrames,
+									   AudioBufferList *ioData);
+
+public:
+	ofxAudioUnitNativeMixer(unsigned int inputBusses = 8);
+	~ofxAudioUnitNativeMixer();
+	
+	bool setInputBusCount(unsigned int numberOfInputBusses);
+	unsigned int getInputBusCount() const;
+	
+	void setInputVolume (float volume, int bus = 0);
+	void setOutputVolume(float volume);
+	void setPan(float pan, int bus = 0);
+	
+	void rampInputVolume (float volume, UInt32 durationInSamples, int bus = 0, ofxAudioUnitFadeCurve curve = OFX_AU_FADE_LINEAR);
+	void rampOutputVolume(float volume, UInt32 durationInSamples, ofxAudioUnitFadeCurve curve = OFX_AU_FADE_LINEAR);
+	void rampPan(float pan, UInt32 durationInSamples, int bus = 0, ofxAudioUnitFadeCurve curve = OFX_AU_FADE_LINEAR);
+	
+	float getInputLevel(int bus = 0);
+	float getOutputLevel() const;
+	void  enableInputMetering(int bus = 0);
+	void  enableOutputMetering();
+	void  disableInputMetering(int bus = 0);
+	void  disableOutputMetering();
+	
+	void  enableAllMetering();
+	void  disableAllMetering();
+	unsigned int getInputLevels(float * levels, unsigned int busCount);
+	void  setPeakHold(float holdSeconds, float decayDecibelsPerSecond);
+	
+	int   addGroup(const std::string &name, int parentGroup = -1);
+	int   getGroupIndex(const std::string &name) const;
+	unsigned int getGroupCount() const;
+	void  setGroup(int group, int bus = 0);
+	void  setGroupVolume(float volume, int group);
+	float getGroupVolume(int group) const;
+	void  addGroupInsert(ofxAudioUnit &insert, int group);
+	void  clearGroupInserts(int group);
+};
+
+#pragma mark - ofxAudioUnitMatrixMixer
+
+// ofxAudioUnitMatrixMixer routes any number of input channels to any
+// number of output channels, with a gain at each crosspoint. Routing 32
+// inputs to 16 outputs takes one of these, rather than 16 mixers.
+
+// Input channels are numbered bus by bus, so with stereo inputs bus 0 is
+// input channels 0 and 1, bus 1 is 2 and 3 and so on. Crosspoints that
+// haven't been set (or are set to 0) cost nothing : the matrix is stored
+// sparsely (in compressed rows), so the work done per buffer scales with
+// the number of crosspoints in use rather than inputs x outputs. Busses
+// that aren't routed anywhere aren't pulled at all.
+
+// Changing a crosspoint builds a new copy of the matrix, which is handed
+// over to the render thread without locking. Old copies are released on
+// the next change, off the render thread.
+
+class ofxAudioUnitMatrixMixer : public ofxAudioUnitNativeNode
+{
+	struct Matrix
+	{
+		std::vector<unsigned int> rowStarts;   // one per output channel, plus one
+		std::vector<unsigned int> inputs;      // input channel of each crosspoint
+		std::vector<float>        gains;       // gain of each crosspoint
+		std::vector<unsigned int> usedBusses;
+	};
+	
+	typedef std::pair<unsigned int, unsigned int> CrosspointKey; // (output, input)
+	std::map<CrosspointKey, float> _crosspoints;
+	ofMutex _crosspointMutex;
+	
+	Matrix * _matrix;
+	Matrix * volatile _pendingMatrix;
+	ofxAudioUnitLockFreeFifo<Matrix *> _retiredMatrices;
+	
+	UInt32 _channelsPerInput;
+	AudioUnitSampleType * _inputSamples;
+	std::vector<AudioBufferList *> _inputBuffers;
+	std::vector<char> _inputRendered;
+	
+	void publishMatrix();
+	void releaseRetiredMatrices();
+	void releaseInputBuffers();
+	
+	OSStatus renderNode(AudioUnitRenderActionFlags *ioActionFlags,
+						const AudioTimeStamp *inTimeStamp,
+						UInt32 inNumberFrames,
+						AudioBufferList *ioData);
+
+public:
+	ofxAudioUnitMatrixMixer(unsigned int inputBusses = 32,
+							unsigned int outputChannels = 16,
+							unsigned int channelsPerInput = 2);
+	~ofxAudioUnitMatrixMixer();
+	
+	// crosspoints on inputs that are removed are cleared
+	bool setInputBusCount(unsigned int numberOfInputBusses);
+	unsigned int getInputBusCount() const;
+	unsigned int getInputChannelCount() const;
+	unsigned int getOutputChannelCount() const;
+	
+	void  setCrosspointGain(float gain, unsigned int inputChannel, unsigned int outputChannel);
+	float getCrosspointGain(unsigned int inputChannel, unsigned int outputChannel);
+	unsigned int getCrosspointCount();
+	void  clearCrosspoints();
+};
+
+#pragma mark - ofxAudioUnitSamplePlayer
+
+// ofxAudioUnitSamplePlayer plays a file that has been decoded into
+// memory. Files are loaded through ofxAudioUnitSampleCache, so any number
+// of sample players can play the same file while it's only decoded and
+// stored once. Playback reads straight from the shared buffer.
+
+// This is the player to use for lots of short sounds (drum hits, for
+// example). For long files, use ofxAudioUnitStreamingFilePlayer instead.
+
+// setFile() decodes at the node's sample rate, so a node whose format is
+// changed should be changed before its file is set. A sample decoded at
+// any other rate plays at the wrong speed, and setSample() warns about
+// it.
+
+// loop() repeats the part of the sample between the loop points (the
+// whole sample by default), then plays on to the end of the sample once
+// the loops run out. The loop points and crossfade can be changed while
+// the sample plays, and take effect from the next buffer. With a
+// crossfade, the last frames before the loop end are faded into the
+// frames just before the loop start, so that material that doesn't
+// cross zero at the seam loops without a click. If there aren't enough
+// frames before the loop start, the frames after it are used instead,
+// and each loop after the first starts that much later.
+
+class ofxAudioUnitSamplePlayer : public ofxAudioUnitNativeNode
+{
+	ofxAudioUnitSampleBufferRef _sample;
+	UInt32   _position;
+	int      _loopsRemaining;
+	uint64_t _startTime;
+	volatile bool _playing;
+	
+	volatile UInt32 _loopStart;
+	volatile UInt32 _loopEnd;
+	volatile UInt32 _loopCrossfade;
+	std::vector<float> _fadeRamp;
+	
+	OSStatus renderNode(AudioUnitRenderActionFlags *ioActionFlags,
+						const AudioTimeStamp *inTimeStamp,
+						UInt32 inNumberFrames,
+						AudioBufferList *ioData);
+
+public:
+	ofxAudioUnitSamplePlayer();
+	~ofxAudioUnitSamplePlayer();
+	
+	bool   setFile(const std::string &filePath);
+	void   setSample(ofxAudioUnitSampleBufferRef sample);
+	ofxAudioUnitSampleBufferRef getSample() const {return _sample;}
+	UInt32 getLength() const;
+	
+	// As with ofxAudioUnitFilePlayer, startTime is a host time from
+	// mach_absolute_time(), and 0 means right away
+	void   play(uint64_t startTime = 0);
+	void   loop(unsigned int timesToLoop = OFX_AU_LOOP_FOREVER, uint64_t startTime = 0);
+	void   stop();
+	bool   isPlaying() const {return _playing;}
+	
+	// loopEnd = 0 loops to the end of the sample
+	void   setLoopPoints(UInt32 loopStart, UInt32 loopEnd = 0);
+	UInt32 getLoopStart() const {return _loopStart;}
+	UInt32 getLoopEnd() const {return _loopEnd;}
+	void   setLoopCrossfade(UInt32 frames) {_loopCrossfade = frames;}
+	UInt32 getLoopCrossfade() const {return _loopCrossfade;}
+};
+
+#pragma mark - ofxAudioUnitGranulator
+
+// ofxAudioUnitGranulator plays clouds of short, overlapping grains taken
+// from a sample. Like ofxAudioUnitSamplePlayer, it loads files through
+// ofxAudioUnitSampleCache and reads straight from the shared buffer, so
+// any number of granulators can work from the same file. A sample
+// decoded at a different rate from the node's still plays at the right
+// pitch, since grains read through it at the ratio of the two rates.
+
+// While the cloud is running (see start()), grains are started at the
+// rate set by setDensity(), in grains per second. Each grain reads
+// setDuration() seconds of the sample from around setPosition() (0 is
+// the start of the sample, 1 the end), at a pitch in semitones and with a
+// stereo pan (-1 to 1). The spreads randomize each grain's position,
+// pitch and pan by up to that much either side. Each grain is shaped by
+// a Hann window. triggerGrain() starts a single grain, whether or not
+// the cloud is running.
+
+// Grains are taken from a pool allocated up front (1024 by default, see
+// setMaxGrains()), so starting one never allocates. If every grain in
+// the pool is playing, new grains are dropped and counted (see
+// getDroppedGrainCount()). Each grain is mixed in a buffer at a time
+// with vDSP, which keeps thousands of grains a second well within
+// budget.
+
+class ofxAudioUnitGranulator : public ofxAudioUnitNativeNode
+{
+	struct Grain
+	{
+		Float64 position;
+		float   increment;
+		float   windowIncrement;
+		float   gains[2];
+		UInt32  length;
+		UInt32  age;
+		UInt32  delay;
+	};
+	
+	ofxAudioUnitSampleBufferRef _sample;
+	std::vector<Grain> _grains;
+	UInt32 _activeGrains;
+	Float64 _framesUntilNextGrain;
+	uint32_t _random;
+	
+	std::vector<float> _windowTable;
+	std::vector<float> _sourceIndices;
+	std::vector<float> _windowIndices;
+	std::vector<float> _window;
+	std::vector<float> _grainSamples;
+	
+	volatile bool  _running;
+	volatile float _density;
+	volatile float _duration;
+	volatile float _position;
+	volatile float _positionSpread;
+	volatile float _pitch;
+	volatile float _pitchSpread;
+	volatile float _pan;
+	volatile float _panSpread;
+	volatile float _gain;
+	volatile int32_t _triggers;
+	volatile UInt32 _droppedGrains;
+	
+	float randomBipolar();
+	void  startGrain(UInt32 delay);
+	void  mixGrain(Grain &grain, UInt32 frames, UInt32 outputCount, AudioBufferList *ioData);
+	
+	OSStatus renderNode(AudioUnitRenderActionFlags *ioActionFlags,
+						const AudioTimeStamp *inTimeStamp,
+						UInt32 inNumberFrames,
+						AudioBufferList *ioData);
+
+public:
+	ofxAudioUnitGranulator();
+	~ofxAudioUnitGranulator();
+	
+	bool setFile(const std::string &filePath);
+	void setSample(ofxAudioUnitSampleBufferRef sample);
+	ofxAudioUnitSampleBufferRef getSample() const {return _sample;}
+	
+	void start();
+	void stop();
+	bool isRunning() const {return _running;}
+	void triggerGrain();
+	
+	void  setDensity(float grainsPerSecond);
+	float getDensity() const {return _density;}
+	void  setDuration(float seconds);
+	float getDuration() const {return _duration;}
+	void  setPosition(float position, float spread = 0);
+	float getPosition() const {return _position;}
+	void  setPitch(float semitones, float spread = 0);
+	float getPitch() const {return _pitch;}
+	void  setPan(float pan, float spread = 0);
+	float getPan() const {return _pan;}
+	void  setGain(float gain) {_gain = gain;}
+	float getGain() const {return _gain;}
+	
+	void   setMaxGrains(UInt32 maxGrains);
+	UInt32 getMaxGrains() const {return _grains.size();}
+	UInt32 getActiveGrainCount() const {return _activeGrains;}
+	UInt32 getDroppedGrainCount() const {return _droppedGrains;}
+};
+
+#pragma mark - ofxAudioUnitStreamingFilePlayer
+
+// ofxAudioUnitStreamingFilePlayer plays files from disk like
+// ofxAudioUnitFilePlayer, but does its own disk reading instead of
+// leaving it to the AUAudioFilePlayer. This makes it better suited to
+// very long files, and to playing many files at once.
+
+// Streaming players are serviced by ofxAudioUnitServiceThread, which
+// decodes each file ahead of its playback position into a ring buffer. The render thread
+// only ever reads from the ring. setPrefetchDepth() controls how many
+// seconds are kept decoded ahead (2 by default) : more is safer when
+// the disk is busy, less uses less memory. If the ring ever runs dry
+// during playback, the player outputs silence for the missing frames
+// and counts an underrun (see getUnderrunCount()).
+
+// Files are decoded at the node's sample rate (44.1kHz unless its format
+// has been changed), and opened again if the node's rate changes while a
+// file is set. Uncompressed WAV and AIFF files at that rate are
+// memory-mapped and converted straight from the mapping. Everything else
+// is decoded (and resampled if necessary) by an ExtAudioFile. Compressed
+// files with variable-sized packets (such as mp3) are indexed by the
+// service thread in the background after they're opened, so that once
+// that's done, seeking anywhere in them takes the same time. Until then
+// they can still be played and seeked, but seeks far into the file are
+// slower.
+// With ofxAudioUnitDecodeCache enabled, those files are decoded to disk
+// once and then memory-mapped like WAV files from then on.
+
+// setRate() changes the playback speed (and pitch) like a varispeed, so
+// it can be used to scrub through a file. The ring holds the file at its
+// own rate and the rate is applied as it's played, so rate changes take
+// effect straight away. The interpolation used is set with
+// setResampleQuality() (cubic by default). Negative rates play
+// backwards : the service thread then decodes the file a chunk at a time
+// from the end towards the start, which costs a seek per chunk for
+// compressed files. Faster rates empty the ring faster, so they need a
+// deeper prefetch to ride out the same disk stall.
+
+// seek(), play() and changes of direction are primed by the service
+// thread into a second ring while the first keeps playing, and the
+// render thread switches over once there's enough decoded, usually
+// within a few milliseconds. Until then, a seek keeps playing from where
+// it was and a start waits, so a start time passed to play() should be
+// a little ahead of now to be met exactly.
+
+// Like ofxAudioUnitSamplePlayer, loop() repeats the part of the file
+// between the loop points (the whole file by default), optionally with a
+// crossfade at the seam, then plays on to the end once the loops run
+// out. The loop is applied as the file is decoded, so a change to the
+// points or crossfade is heard once playback reaches the frames decoded
+// after it, up to the prefetch depth later (seek() to the current
+// position to hear it sooner). Playing backwards goes round the same
+// loop, without the crossfade.
+
+// As with ofxAudioUnitFilePlayer, getOverview() returns the file's
+// waveform overview, which starts loading when the file is set unless
+// it's been made lazy.
+
+class ofxAudioUnitStreamingFilePlayer : public ofxAudioUnitNativeNode
+{
+	// The playback position is worked out by the render thread from the
+	// frames it plays, and published for getPosition(). Where playback
+	// jumps (looping round), the decoder leaves a mark saying which file
+	// position the ring frame it's about to write holds
+	struct PositionMark
+	{
+		uint32_t ringFrame;
+		double   position;
+	};
+	
+	// One run of decoded audio from a seek (or start) onwards, in the
+	// order it plays. The service thread primes a new stream while the
+	// render thread plays the other one (see startStream())
+	struct Stream
+	{
+		ofxAudioUnitSampleRing ring;
+		ofxAudioUnitLockFreeFifo<PositionMark> positionMarks;
+		int32_t generation;
+		double  startPosition;
+		int     direction;
+		volatile bool endOfStream;
+	};
+	Stream _streams[2];
+	
+	// Bit 0 is the stream the render thread is playing, and bit 1 is set
+	// while the other one is primed and waiting for it. Only the service
+	// thread sets bit 1 and only the render thread switches streams, so
+	// whichever side clears bit 1 first (with a compare-and-swap) wins
+	volatile int32_t _streamState;
+	
+	// What seek() / loop() / setRate() last asked for, guarded by
+	// _requestMutex (which the render thread never takes). Each request
+	// bumps _requestGeneration, and the stream started for it is tagged
+	// with that generation
+	struct Request
+	{
+		double position;
+		int    direction;
+		int    timesToLoop;
+		bool   restart;
+		bool   pending;
+	};
+	Request _request;
+	ofMutex _requestMutex;
+	volatile int32_t _requestGeneration;
+	volatile int32_t _startGeneration; // play() waits for this stream
+	void   requestStream(double position);
+	
+	ofMutex _streamMutex;
+	
+	// file and decoder state, owned by whoever holds _streamMutex
+	ExtAudioFileRef _extAudioFile;
+	const unsigned char * _mappedFile;
+	size_t _mappedFileSize;
+	const unsigned char * _mappedAudio;
+	AudioStreamBasicDescription _fileFormat;
+	UInt32 _fileChannels;
+	SInt64 _fileLength;
+	Float64 _decodeRate;
+	std::string _sourcePath;
+	SInt64 _decodePosition;
+	int    _decodeStream;
+	int    _loopsRemaining;
+	std::vector<AudioUnitSampleType> _decodeSamples;
+	AudioBufferList * _decodeBuffers;
+	std::vector<AudioUnitSampleType> _fadeSamples;
+	std::vector<float> _fadeRamp;
+	
+	volatile SInt64 _loopStart;
+	volatile SInt64 _loopEnd;
+	volatile UInt32 _loopCrossfade;
+	
+	float _prefetchSeconds;
+	uint64_t _startTime;
+	volatile float   _rate;
+	volatile bool    _playing;
+	volatile int32_t _underruns;
+	
+	ofxAudioUnitWaveformOverview _overview;
+	
+	bool   openFile(const std::string &filePath);
+	void   reopenFile();
+	bool   mapFile(const std::string &filePath, AudioFileID fileID);
+	void   closeFile();
+	void   seekFile(SInt64 frame);
+	UInt32 decodeFrames(UInt32 frames);
+	UInt32 decodeFramesBackwards(UInt32 frames);
+	UInt32 decodeCrossfadeFrames(UInt32 frames, SInt64 fadeStart, SInt64 fadeFrom, SInt64 crossfade);
+	bool   startStream();
+	UInt32 fillRing(UInt32 maxFrames);
+	
+	// the seek index for files with variable-sized packets, built a
+	// little at a time by the service thread (see buildIndex())
+	AudioFileID _indexFile;
+	SInt64 _indexedPackets;
+	bool   _indexBuilt;
+	std::vector<unsigned char> _indexPacketData;
+	void   buildIndex();
+	
+	// render thread only
+	ofxAudioUnitResampler _resampler;
+	std::vector<AudioUnitSampleType> _renderSamples;
+	PositionMark _positionMark;
+	PositionMark _nextPositionMark;
+	bool _hasNextPositionMark;
+	void   adoptStream(const Stream &stream);
+	void   updatePosition(Stream &stream);
+	
+	volatile int32_t _position;
+	
+	OSStatus renderNode(AudioUnitRenderActionFlags *ioActionFlags,
+						const AudioTimeStamp *inTimeStamp,
+						UInt32 inNumberFrames,
+						AudioBufferList *ioData);
+	
+	// called regularly on the shared service thread
+	static void serviceStream(void * context);
+
+public:
+	ofxAudioUnitStreamingFilePlayer();
+	~ofxAudioUnitStreamingFilePlayer();
+	
+	bool   setFile(const std::string &filePath);
+	SInt64 getLength() const {return _fileLength;}
+	ofxAudioUnitWaveformOverview& getOverview() {return _overview;}
+	
+	void   setPrefetchDepth(float seconds);
+	float  getPrefetchDepth() const {return _prefetchSeconds;}
+	
+	void   play(uint64_t startTime = 0);
+	void   loop(unsigned int timesToLoop = OFX_AU_LOOP_FOREVER, uint64_t startTime = 0);
+	void   stop();
+	bool   isPlaying() const {return _playing;}
+	
+	void   seek(SInt64 frame);
+	
+	// loopEnd = 0 loops to the end of the file
+	void   setLoopPoints(SInt64 loopStart, SInt64 loopEnd = 0);
+	SInt64 getLoopStart() const {return _loopStart;}
+	SInt64 getLoopEnd() const {return _loopEnd;}
+	void   setLoopCrossfade(UInt32 frames) {_loopCrossfade = frames;}
+	UInt32 getLoopCrossfade() const {return _loopCrossfade;}
+	
+	// The frame of the file that's playing, as of the last buffer
+	// rendered. Reading it is only a memory load, so it's fine to call for
+	// many players every frame
+	SInt64 getPosition() const;
+	
+	// 1 is normal speed. Clamped to +/- 8
+	void   setRate(float rate);
+	float  getRate() const {return _rate;}
+	
+	void   setResampleQuality(ofxAudioUnitResamplerQuality quality);
+	ofxAudioUnitResamplerQuality getResampleQuality() const {return _resampler.getQuality();}
+	
+	unsigned int getUnderrunCount() const {return _underruns;}
+	void   resetUnderrunCount();
+};
+
+#pragma mark - ofxAudioUnitResamplerNode
+
+// ofxAudioUnitResamplerNode changes the speed (and with it, the pitch)
+// of whatever is connected to it, like the AUVarispeed unit, but with a
+// choice of interpolation quality (see ofxAudioUnitResampler).
+
+// Rate changes are ramped sample by sample across the next buffer, so
+// the rate can be modulated continuously without zipper noise. Rates
+// are clamped to between 1/8 and 8.
+
+class ofxAudioUnitResamplerNode : public ofxAudioUnitNativeNode
+{
+	ofxAudioUnitResampler _resampler;
+	volatile float _rate;
+	float _currentRate;
+	std::vector<float> _rates;
+	std::vector<float *> _inputChannels;
+	std::vector<float *> _outputChannels;
+	
+	AudioUnitSampleType * _inputSamples;
+	AudioBufferList * _inputBuffer;
+	Float64 _inputSampleTime;
+	
+	OSStatus renderNode(AudioUnitRenderActionFlags *ioActionFlags,
+						const AudioTimeStamp *inTimeStamp,
+						UInt32 inNumberFrames,
+						AudioBufferList *ioData);
+
+public:
+	ofxAudioUnitResamplerNode(UInt32 channels = 2, ofxAudioUnitResamplerQuality quality = OFX_AU_RESAMPLE_CUBIC);
+	~ofxAudioUnitResamplerNode();
+	
+	void  setRate(float rate);
+	float getRate() const {return _rate;}
+	
+	void  setQuality(ofxAudioUnitResamplerQuality quality);
+	ofxAudioUnitResamplerQuality getQuality() const {return _resampler.getQuality();}
+};
+
+#pragma mark - ofxAudioUnitTimeStretchNode
+
+// ofxAudioUnitTimeStretchNode changes the tempo and pitch of whatever is
+// connected to it independently, unlike the varispeed which couples them.
+// The pitch is shifted by resampling (see ofxAudioUnitResampler), and the
+// tempo that leaves is corrected by time-stretching (see
+// ofxAudioUnitTimeStretcher). It's cheap enough to run on a few dozen
+// stems at once.
+
+// Tempo is a rate (2 is twice as fast), clamped to between 1/4 and 4.
+// Pitch is in semitones, clamped to +/- 24. The output is delayed by
+// about 12ms.
+
+class ofxAudioUnitTimeStretchNode : public ofxAudioUnitNativeNode
+{
+	ofxAudioUnitTimeStretcher _stretcher;
+	ofxAudioUnitResampler _resampler;
+	volatile float _tempo;
+	volatile float _pitch;
+	std::vector<float> _stageSamples;
+	std::vector<float *> _stageChannels;
+	std::vector<float *> _inputChannels;
+	std::vector<float *> _outputChannels;
+	
+	AudioUnitSampleType * _inputSamples;
+	AudioBufferList * _inputBuffer;
+	Float64 _inputSampleTime;
+	
+	void pullInputFrames(const AudioTimeStamp *inTimeStamp, UInt32 frames);
+	
+	OSStatus renderNode(AudioUnitRenderActionFlags *ioActionFlags,
+						const AudioTimeStamp *inTimeStamp,
+						UInt32 inNumberFrames,
+						AudioBufferList *ioData);
+
+public:
+	ofxAudioUnitTimeStretchNode(UInt32 channels = 2);
+	~ofxAudioUnitTimeStretchNode();
+	
+	void  setTempo(float tempo);
+	float getTempo() const {return _tempo;}
+	
+	void  setPitch(float semitones);
+	float getPitch() const {return _pitch;}
+	
+	void  setPitchQuality(ofxAudioUnitResamplerQuality quality);
+	ofxAudioUnitResamplerQuality getPitchQuality() const {return _resampler.getQuality();}
+	
+	void  reset();
+};
+
+#pragma mark - ofxAudioUnitTransport
+
+// ofxAudioUnitTransport starts a group of players in sync. Calling play()
+// or loop() on several players one after the other starts each of them
+// at a slightly different time, so loops that should line up drift apart
+// by anything up to a buffer. The transport instead picks one start time
+// a little in the future and schedules every player in the group for
+// that same time, so they all start on the same sample.
+
+// The start latency has to cover the time it takes to schedule every
+// player plus one buffer of the output, or the players that were
+// scheduled last will start late. Streaming players also need the
+// service thread to have primed them by then, which takes a pass over
+// every streaming player in the group.
+
+class ofxAudioUnitTransport
+{
+	std::vector<ofxAudioUnitFilePlayer *>          _filePlayers;
+	std::vector<ofxAudioUnitSamplePlayer *>        _samplePlayers;
+	std::vector<ofxAudioUnitStreamingFilePlayer *> _streamingPlayers;
+	float    _startLatency;
+	uint64_t _startTime;
+
+public:
+	ofxAudioUnitTransport(float startLatencySeconds = 0.05);
+	
+	void addPlayer(ofxAudioUnitFilePlayer &player);
+	void addPlayer(ofxAudioUnitSamplePlayer &player);
+	void addPlayer(ofxAudioUnitStreamingFilePlayer &player);
+	void clearPlayers();
+	
+	void  setStartLatency(float seconds) {_startLatency = seconds;}
+	float getStartLatency() const {return _startLatency;}
+	
+	// These return the host time the group was scheduled to start at,
+	// which can also be passed to other players to start them in sync
+	uint64_t play();
+	uint64_t loop(unsigned int timesToLoop = OFX_AU_LOOP_FOREVER);
+	void     stop();
+	
+	uint64_t getStartTime() const {return _startTime;}
+};
+
+#pragma mark - ofxAudioUnitLoader
+
+// ofxAudioUnitLoader loads files into many players at once. Calling
+// setFile() on each player in turn opens, probes and decodes one file
+// after another; the loader does the same work on ofxAudioUnitThreadPool,
+// so as many files are loaded at a time as there are workers.
+
+// Sample players' files are fully decoded into ofxAudioUnitSampleCache,
+// and add(filePath) on its own decodes a file into the cache for a
+// sample player to pick up later. It decodes at 44.1kHz unless given the
+// rate of the players that will use it.
+
+// Add everything to load, then call start(). From then until
+// isFinished() returns true, the players must be left alone and nothing
+// more can be added. The completion callback, if there is one, is called
+// on a worker thread once every file has been loaded (or failed to), and
+// can call getFailedFiles().
+// Each player should only be added once.
+
+class ofxAudioUnitLoader
+{
+public:
+	typedef void (*CompletionProc)(ofxAudioUnitLoader &loader, void * context);
+	
+	ofxAudioUnitLoader();
+	~ofxAudioUnitLoader();
+	
+	void add(ofxAudioUnitFilePlayer &player, const std::string &filePath);
+	void add(ofxAudioUnitStreamingFilePlayer &player, const std::string &filePath);
+	void add(ofxAudioUnitSamplePlayer &player, const std::string &filePath);
+	void add(ofxAudioUnitSampler &sampler, const std::vector<std::string> &samplePaths);
+	void add(const std::string &filePath, Float64 sampleRate = 44100);
+	void clear();
+	
+	void  start(CompletionProc completion = NULL, void * context = NULL);
+	bool  isFinished() const;
+	float getProgress() const;
+	void  wait();
+	
+	// the files (or first sample of each sampler's set) that couldn't be loaded
+	std::vector<std::string> getFailedFiles() const;
+
+private:
+	enum Target
+	{
+		kTargetFilePlayer,
+		kTargetStreamingPlayer,
+		kTargetSamplePlayer,
+		kTargetSampler,
+		kTargetCache
+	};
+	
+	struct Item
+	{
+		ofxAudioUnitLoader * loader;
+		Target target;
+		void * player;
+		std::vector<std::string> filePaths;
+		Float64 sampleRate;
+		bool loaded;
+	};
+	
+	std::vector<Item> _items;
+	CompletionProc _completion;
+	void * _completionContext;
+	volatile int32_t _itemsRemaining;
+	volatile bool _finished;
+	bool _started;
+	
+	ofxAudioUnitLoader(const ofxAudioUnitLoader &orig);
+	ofxAudioUnitLoader& operator=(const ofxAudioUnitLoader &orig);
+	
+	void addItem(Target target, void * player, const std::vector<std::string> &filePaths, Float64 sampleRate = 44100);
+	void finish();
+	static void loadItem(void * context);
+};
+
+#pragma mark - ofxAudioUnitSpatialPanner
+
+// ofxAudioUnitSpatialPanner positions any number of mono sources on a
+// ring or sphere of speakers. Each input bus is one source, and each
+// output channel feeds one speaker.
+
+// Call setSpeakerPositions() with the azimuth of each speaker (in degrees,
+// 0 being straight ahead and increasing counter-clockwise) and optionally
+// their elevations. By default the speakers are spread evenly around a
+// ring, starting in front of the listener.
+
+// There are three panning modes :
+// - OFX_AU_PAN_VBAP (the default) uses vector base amplitude panning
+//   between the two speakers on either side of the source. The speaker
+//   pair and gains are looked up in a table built for every degree of
+//   azimuth, so it works for any horizontal layout. Elevation is ignored.
+// - OFX_AU_PAN_AMBISONIC_FIRST_ORDER and OFX_AU_PAN_AMBISONIC_THIRD_ORDER
+//   encode every source into an ambisonic (ACN / SN3D) mix of 4 or 16
+//   channels, which is then decoded to the speakers with a projection
+//   decoder. This works best with evenly spread speakers.
+
+// Moving a source doesn't jump : gains are interpolated across the next
+// buffer. Sources with 2 channels per source are mixed down to mono.
+
+enum ofxAudioUnitPanningMode
+{
+	OFX_AU_PAN_VBAP,
+	OFX_AU_PAN_AMBISONIC_FIRST_ORDER,
+	OFX_AU_PAN_AMBISONIC_THIRD_ORDER
+};
+
+class ofxAudioUnitSpatialPanner : public ofxAudioUnitNativeNode
+{
+	struct Source
+	{
+		float azimuth;
+		float elevation;
+		float gain;
+		std::vector<float> currentGains; // one per speaker (VBAP) or ambisonic channel
+		std::vector<float> targetGains;
+	};
+	
+	struct VBAPEntry
+	{
+		unsigned int speakers[2];
+		float gains[2];
+	};
+	
+	ofxAudioUnitPanningMode _mode;
+	std::vector<Source> _sources;
+	std::vector<float> _speakerAzimuths;
+	std::vector<float> _speakerElevations;
+	std::vector<VBAPEntry> _vbapTable;
+	std::vector<float> _decodeMatrix;
+	
+	UInt32 _channelsPerSource;
+	AudioUnitSampleType * _sourceSamples;
+	AudioUnitSampleType * _ambisonicSamples;
+	std::vector<AudioBufferList *> _sourceBuffers;
+	
+	unsigned int getPannerChannelCount() const;
+	void buildVBAPTable();
+	void buildDecodeMatrix();
+	void computeTargetGains(Source &source);
+	void resetSources();
+	
+	OSStatus renderNode(AudioUnitRenderActionFlags *ioActionFlags,
+						const AudioTimeStamp *inTimeStamp,
+						UInt32 inNumberFrames,
+						AudioBufferList *ioData);
+
+public:
+	ofxAudioUnitSpatialPanner(unsigned int sources = 16,
+							  unsigned int speakers = 8,
+							  unsigned int channelsPerSource = 1);
+	~ofxAudioUnitSpatialPanner();
+	
+	unsigned int getInputBusCount() const;
+	unsigned int getSpeakerCount() const;
+	
+	void setMode(ofxAudioUnitPanningMode mode);
+	ofxAudioUnitPanningMode getMode() const {return _mode;}
+	void setSpeakerPositions(const std::vector<float> &azimuths,
+							 const std::vector<float> &elevations = std::vector<float>());
+	
+	void setSourcePosition(float azimuth, float elevation = 0, int source = 0);
+	void setSourceGain(float gain, int source = 0);
+};
+
 #if !TARGET_OS_IPHONE
 
 #pragma mark - - OSX only below here - -
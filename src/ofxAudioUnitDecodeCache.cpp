@@ -0,0 +1,305 @@
+#include "ofxAudioUnitDecodeCache.h"
+#include "ofxAudioUnitThreadPool.h"
+#include "ofxAudioUnitUtils.h"
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+// how many frames are decoded per read from the source
+static const UInt32 kDecodeChunkFrames = 16384;
+
+// how often decode() checks on a copy that's being made in the background
+static const useconds_t kPendingIntervalMicroseconds = 10000;
+
+static const std::string kCacheExtension = ".caf";
+
+// ----------------------------------------------------------
+static CFURLRef createURL(const std::string &filePath)
+// ----------------------------------------------------------
+{
+	return CFURLCreateFromFileSystemRepresentation(kCFAllocatorDefault,
+	                                               (const UInt8 *)filePath.c_str(),
+	                                               filePath.length(),
+	                                               NULL);
+}
+
+// ----------------------------------------------------------
+static bool needsDecoding(const std::string &filePath)
+// ----------------------------------------------------------
+{
+	CFURLRef fileURL = createURL(filePath);
+	AudioFileID fileID;
+	OSStatus s = AudioFileOpenURL(fileURL, kAudioFileReadPermission, 0, &fileID);
+	CFRelease(fileURL);
+	
+	if(s != noErr) return false;
+	
+	AudioStreamBasicDescription format = {0};
+	UInt32 dataSize = sizeof(format);
+	s = AudioFileGetProperty(fileID, kAudioFilePropertyDataFormat, &dataSize, &format);
+	AudioFileClose(fileID);
+	
+	return s == noErr && format.mFormatID != kAudioFormatLinearPCM;
+}
+
+// ----------------------------------------------------------
+static bool transcode(const std::string &filePath, const std::string &cachePath)
+// ----------------------------------------------------------
+{
+	CFURLRef sourceURL = createURL(filePath);
+	ExtAudioFileRef source = NULL;
+	OSStatus s = ExtAudioFileOpenURL(sourceURL, &source);
+	CFRelease(sourceURL);
+	
+	AudioStreamBasicDescription sourceFormat = {0};
+	if(s == noErr)
+	{
+		UInt32 dataSize = sizeof(sourceFormat);
+		s = ExtAudioFileGetProperty(source, kExtAudioFileProperty_FileDataFormat, &dataSize, &sourceFormat);
+	}
+	
+	if(s != noErr || sourceFormat.mChannelsPerFrame == 0)
+	{
+		cout << "Error " << s << " while opening file at " << filePath << " to decode it" << endl;
+		if(source) ExtAudioFileDispose(source);
+		return false;
+	}
+	
+	// The copy's format is also the format both files are read and
+	// written in, so the copy is written without any conversion. It keeps
+	// the source's rate, since players decode to their own node's rate
+	// and a copy at any fixed rate would be resampled twice
+	const UInt32 channels = sourceFormat.mChannelsPerFrame;
+	AudioStreamBasicDescription format = {0};
+	format.mSampleRate       = sourceFormat.mSampleRate;
+	format.mFormatID         = kAudioFormatLinearPCM;
+	format.mFormatFlags      = kAudioFormatFlagsNativeFloatPacked;
+	format.mBitsPerChannel   = sizeof(float) * 8;
+	format.mChannelsPerFrame = channels;
+	format.mFramesPerPacket  = 1;
+	format.mBytesPerFrame    = channels * sizeof(float);
+	format.mBytesPerPacket   = channels * sizeof(float);
+	
+	// written under a temporary name and moved into place, so a copy is
+	// never opened half-written
+	const std::string tempPath = cachePath + ".tmp";
+	CFURLRef tempURL = createURL(tempPath);
+	ExtAudioFileRef copy = NULL;
+	
+	s = ExtAudioFileSetProperty(source, kExtAudioFileProperty_ClientDataFormat, sizeof(format), &format);
+	if(s == noErr) s = ExtAudioFileCreateWithURL(tempURL, kAudioFileCAFType, &format, NULL, kAudioFileFlags_EraseFile, &copy);
+	if(s == noErr) s = ExtAudioFileSetProperty(copy, kExtAudioFileProperty_ClientDataFormat, sizeof(format), &format);
+	CFRelease(tempURL);
+	
+	std::vector<float> samples(channels * kDecodeChunkFrames);
+	AudioBufferList bufferList;
+	bufferList.mNumberBuffers = 1;
+	
+	while(s == noErr)
+	{
+		UInt32 frames = kDecodeChunkFrames;
+		bufferList.mBuffers[0].mNumberChannels = channels;
+		bufferList.mBuffers[0].mData           = &samples[0];
+		bufferList.mBuffers[0].mDataByteSize   = samples.size() * sizeof(float);
+		
+		s = ExtAudioFileRead(source, &frames, &bufferList);
+		if(s != noErr || frames == 0) break;
+		
+		s = ExtAudioFileWrite(copy, frames, &bufferList);
+	}
+	
+	ExtAudioFileDispose(source);
+	if(copy) ExtAudioFileDispose(copy);
+	
+	if(s != noErr || rename(tempPath.c_str(), cachePath.c_str()) != 0)
+	{
+		cout << "Error " << s << " while decoding file at " << filePath << " to " << cachePath << endl;
+		unlink(tempPath.c_str());
+		return false;
+	}
+	
+	return true;
+}
+
+#pragma mark - Cache
+
+// ----------------------------------------------------------
+ofxAudioUnitDecodeCache& ofxAudioUnitDecodeCache::shared()
+// ----------------------------------------------------------
+{
+	static ofxAudioUnitDecodeCache cache;
+	return cache;
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitDecodeCache::ofxAudioUnitDecodeCache()
+: _enabled(false)
+// ----------------------------------------------------------
+{
+	const char * temp = getenv("TMPDIR");
+	_directory = std::string(temp ? temp : "/tmp/") + "ofxAudioUnitDecodeCache";
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitDecodeCache::setEnabled(bool enabled)
+// ----------------------------------------------------------
+{
+	OFXAU_REALTIME_LOCK(_mutex);
+	_enabled = enabled;
+	_mutex.unlock();
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitDecodeCache::isEnabled()
+// ----------------------------------------------------------
+{
+	OFXAU_REALTIME_LOCK(_mutex);
+	const bool enabled = _enabled;
+	_mutex.unlock();
+	return enabled;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitDecodeCache::setDirectory(const std::string &directory)
+// ----------------------------------------------------------
+{
+	OFXAU_REALTIME_LOCK(_mutex);
+	_directory = directory;
+	_mutex.unlock();
+}
+
+// ----------------------------------------------------------
+std::string ofxAudioUnitDecodeCache::getDirectory()
+// ----------------------------------------------------------
+{
+	OFXAU_REALTIME_LOCK(_mutex);
+	const std::string directory = _directory;
+	_mutex.unlock();
+	return directory;
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitDecodeCache::lookup(const std::string &filePath, std::string &cachePath)
+// ----------------------------------------------------------
+{
+	uint64_t hash = 0;
+	if(!ofxAudioUnitHashFile(filePath, hash)) return false;
+	
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash);
+	cachePath = getDirectory() + "/" + name + kCacheExtension;
+	
+	return access(cachePath.c_str(), R_OK) == 0 || needsDecoding(filePath);
+}
+
+// ----------------------------------------------------------
+std::string ofxAudioUnitDecodeCache::resolve(const std::string &filePath)
+// ----------------------------------------------------------
+{
+	if(!isEnabled()) return filePath;
+	
+	std::string cachePath;
+	if(!lookup(filePath, cachePath)) return filePath;
+	if(access(cachePath.c_str(), R_OK) == 0) return cachePath;
+	
+	// making the copy for next time
+	OFXAU_REALTIME_LOCK(_mutex);
+	if(_pending.insert(cachePath).second)
+	{
+		mkdir(_directory.c_str(), 0755);
+		
+		Job * job = new Job;
+		job->filePath  = filePath;
+		job->cachePath = cachePath;
+		ofxAudioUnitThreadPool::shared().addJob(decodeJob, job);
+	}
+	_mutex.unlock();
+	
+	return filePath;
+}
+
+// ----------------------------------------------------------
+std::string ofxAudioUnitDecodeCache::decode(const std::string &filePath)
+// ----------------------------------------------------------
+{
+	std::string cachePath;
+	if(!lookup(filePath, cachePath)) return filePath;
+	
+	// waiting for the copy if it's already being made in the background,
+	// or claiming it so that it isn't
+	bool claimed = false;
+	while(!claimed)
+	{
+		OFXAU_REALTIME_LOCK(_mutex);
+		if(access(cachePath.c_str(), R_OK) != 0 && _pending.insert(cachePath).second)
+		{
+			mkdir(_directory.c_str(), 0755);
+			claimed = true;
+		}
+		const bool waiting = !claimed && _pending.count(cachePath);
+		_mutex.unlock();
+		
+		if(!claimed && !waiting) break;
+		if(waiting) usleep(kPendingIntervalMicroseconds);
+	}
+	
+	if(claimed)
+	{
+		transcode(filePath, cachePath);
+		
+		OFXAU_REALTIME_LOCK(_mutex);
+		_pending.erase(cachePath);
+		_mutex.unlock();
+	}
+	
+	return access(cachePath.c_str(), R_OK) == 0 ? cachePath : filePath;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitDecodeCache::decodeJob(void * context)
+// ----------------------------------------------------------
+{
+	Job * job = (Job *)context;
+	transcode(job->filePath, job->cachePath);
+	
+	ofxAudioUnitDecodeCache &cache = shared();
+	OFXAU_REALTIME_LOCK(cache._mutex);
+	cache._pending.erase(job->cachePath);
+	cache._mutex.unlock();
+	
+	delete job;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitDecodeCache::purge()
+// ----------------------------------------------------------
+{
+	OFXAU_REALTIME_LOCK(_mutex);
+	
+	DIR * directory = opendir(_directory.c_str());
+	if(directory)
+	{
+		struct dirent * entry;
+		while((entry = readdir(directory)) != NULL)
+		{
+			const std::string name = entry->d_name;
+			const std::string path = _directory + "/" + name;
+			
+			if(name.size() > kCacheExtension.size() &&
+			   name.compare(name.size() - kCacheExtension.size(), kCacheExtension.size(), kCacheExtension) == 0 &&
+			   !_pending.count(path))
+			{
+				unlink(path.c_str());
+			}
+		}
+		closedir(directory);
+	}
+	
+	_mutex.unlock();
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <set>
+#include "ofTypes.h"
+
+// ofxAudioUnitDecodeCache keeps decoded copies of compressed files (mp3,
+// aac and so on) on disk, so that each file only ever has to be decoded
+// once. Copies are interleaved 32 bit float PCM at the source's sample
+// rate in CAF files. ofxAudioUnitStreamingFilePlayer memory-maps a copy
+// without decoding when its rate matches the player's, and
+// ofxAudioUnitSampleCache and ofxAudioUnitFilePlayer read copies without
+// decoding them (only resampling them, if the rates differ).
+
+// The cache is off until setEnabled(true) is called. Once it's on, the
+// players look up every file they open with resolve(). The first time a
+// file is seen its copy is made in the background on
+// ofxAudioUnitThreadPool, and the original is used until the copy is
+// ready. decode() makes the copy straight away instead, for warming the
+// cache at install time, say.
+
+// Copies are keyed by ofxAudioUnitHashFile(), so a source that changes
+// gets a new copy. They're kept in the cache directory, which defaults to
+// a folder in the app's temporary directory. Nothing is ever deleted
+// except by purge().
+
+class ofxAudioUnitDecodeCache
+{
+public:
+	static ofxAudioUnitDecodeCache& shared();
+	
+	void setEnabled(bool enabled);
+	bool isEnabled();
+	
+	void setDirectory(const std::string &directory);
+	std::string getDirectory();
+	
+	// the path of filePath's decoded copy if it has one, otherwise
+	// filePath itself
+	std::string resolve(const std::string &filePath);
+	
+	// makes filePath's decoded copy now if it needs one, and returns its
+	// path as resolve() would
+	std::string decode(const std::string &filePath);
+	
+	// deletes every decoded copy that isn't being made
+	void purge();
+
+private:
+	struct Job
+	{
+		std::string filePath;
+		std::string cachePath;
+	};
+	
+	bool _enabled;
+	std::string _directory;
+	std::set<std::string> _pending;
+	ofMutex _mutex;
+	
+	ofxAudioUnitDecodeCache();
+	ofxAudioUnitDecodeCache(const ofxAudioUnitDecodeCache &orig);
+	ofxAudioUnitDecodeCache& operator=(const ofxAudioUnitDecodeCache &orig);
+	
+	bool lookup(const std::string &filePath, std::string &cachePath);
+	static void decodeJob(void * context);
+};
@@ -0,0 +1,66 @@
+#include "ofxAudioUnitEvents.h"
+#include "ofxAudioUnitServiceThread.h"
+
+// ----------------------------------------------------------
+ofxAudioUnitEventQueue::ofxAudioUnitEventQueue(unsigned int capacity)
+: _events(capacity)
+, _proc(NULL)
+, _context(NULL)
+// ----------------------------------------------------------
+{
+
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitEventQueue::~ofxAudioUnitEventQueue()
+// ----------------------------------------------------------
+{
+	setCallback(NULL, NULL);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitEventQueue::setCallback(ofxAudioUnitEventProc proc, void * context)
+// ----------------------------------------------------------
+{
+	// removing the queue from the dispatcher waits for any delivery in
+	// progress, so the callback can be swapped safely
+	ofxAudioUnitServiceThread &dispatcher = ofxAudioUnitServiceThread::dispatcher();
+	if(_proc) dispatcher.removeClient(dispatch, this);
+	
+	_proc    = proc;
+	_context = context;
+	
+	if(_proc)
+	{
+		dispatcher.addClient(dispatch, this);
+	}
+	else
+	{
+		// nothing's delivering any more, so the queue can be emptied here
+		ofxAudioUnitEvent event;
+		while(_events.pop(event));
+	}
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitEventQueue::post(const ofxAudioUnitEvent &event)
+// ----------------------------------------------------------
+{
+	if(!_proc) return true;
+	return _events.push(event);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitEventQueue::dispatch(void * context)
+// ----------------------------------------------------------
+{
+	ofxAudioUnitEventQueue * queue = static_cast<ofxAudioUnitEventQueue *>(context);
+	
+	// the callback may replace or clear itself, so it's looked up again
+	// for every event
+	ofxAudioUnitEvent event;
+	while(queue->_proc && queue->_events.pop(event))
+	{
+		queue->_proc(event, queue->_context);
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "ofxAudioUnitLockFree.h"
+#include <AudioToolbox/AudioToolbox.h>
+
+// Players report what happens during playback (finishing, looping) as
+// events. Events are noticed on the render thread and posted to an
+// ofxAudioUnitEventQueue, which hands them to the app's callback on
+// ofxAudioUnitServiceThread::dispatcher(). App
+// callbacks never run on the render thread, so they can allocate, log
+// and change callbacks (their own included). They can also take the
+// app's locks, as long as no thread calls setCallback() while holding a
+// lock the callback takes: setCallback() waits for a delivery in
+// progress, so that would deadlock. Callbacks should return promptly,
+// since the dispatcher delivers every player's events in turn.
+
+enum ofxAudioUnitEventType
+{
+	OFX_AU_EVENT_FINISHED,        // played to the end (of its last loop)
+	OFX_AU_EVENT_LOOPED,          // wrapped back to the start of a loop
+	OFX_AU_EVENT_REGION_FINISHED  // a region of a file player's queue finished
+};
+
+struct ofxAudioUnitEvent
+{
+	ofxAudioUnitEventType type;
+	
+	// the number of loops played so far, or of queued regions finished
+	// since the queue started
+	UInt32 count;
+	
+	// the host time of the buffer the event happened in, or 0 if the
+	// event wasn't noticed while rendering
+	uint64_t hostTime;
+};
+
+typedef void (*ofxAudioUnitEventProc)(const ofxAudioUnitEvent &event, void * context);
+
+// ofxAudioUnitEventQueue is the queue between one event source and the
+// dispatcher. post() never blocks or allocates, so it's safe on the
+// render thread. It only fails if the queue is full, in which case the
+// source should hold on to the event and post it again later rather than
+// drop it. Only one thread may post to a queue.
+
+class ofxAudioUnitEventQueue
+{
+public:
+	ofxAudioUnitEventQueue(unsigned int capacity = 64);
+	~ofxAudioUnitEventQueue();
+	
+	// proc is called on the dispatcher thread for every event posted. A
+	// NULL proc stops delivery (events posted meanwhile are discarded).
+	// Once this returns, the previous proc won't be called again (unless
+	// it's called from that proc, which finishes its current event).
+	void setCallback(ofxAudioUnitEventProc proc, void * context);
+	
+	bool post(const ofxAudioUnitEvent &event);
+
+private:
+	ofxAudioUnitLockFreeFifo<ofxAudioUnitEvent> _events;
+	ofxAudioUnitEventProc _proc;
+	void * _context;
+	
+	ofxAudioUnitEventQueue(const ofxAudioUnitEventQueue &orig);
+	ofxAudioUnitEventQueue& operator=(const ofxAudioUnitEventQueue &orig);
+	
+	static void dispatch(void * context);
+};
@@ -0,0 +1,224 @@
+#include "ofxAudioUnitFadeScheduler.h"
+#include "ofxAudioUnitRealtimeCheck.h"
+#include <math.h>
+#include <algorithm>
+
+using namespace std;
+
+// lowest level an exponential fade starts from or ends at (-60 dB)
+static const float kExponentialFloor = 0.001;
+
+static float curveValue(float from, float to, float t, ofxAudioUnitFadeCurve curve);
+
+// ----------------------------------------------------------
+ofxAudioUnitFadeScheduler::ofxAudioUnitFadeScheduler(unsigned int targetCount, unsigned int maxPendingFades)
+: _segmentCount(0)
+, _commands(maxPendingFades)
+// ----------------------------------------------------------
+{
+	setTargetCount(targetCount);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitFadeScheduler::setTargetCount(unsigned int targetCount, float initialValue)
+// ----------------------------------------------------------
+{
+	FadeState idle;
+	idle.value       = initialValue;
+	idle.from        = initialValue;
+	idle.to          = initialValue;
+	idle.elapsed     = 0;
+	idle.duration    = 0;
+	idle.curve       = OFX_AU_FADE_LINEAR;
+	idle.activeIndex = -1;
+	
+	OFXAU_REALTIME_LOCK(_stateMutex);
+	{
+		for(int i = _activeTargets.size() - 1; i >= 0; i--)
+		{
+			if(_activeTargets[i] >= targetCount) stopFade(_targets[_activeTargets[i]]);
+		}
+		
+		_targets.resize(targetCount, idle);
+		_activeTargets.reserve(targetCount);
+		_segments.resize(targetCount);
+		_segmentCount = 0;
+	}
+	_stateMutex.unlock();
+}
+
+#pragma mark - Requesting fades
+
+// ----------------------------------------------------------
+bool ofxAudioUnitFadeScheduler::fadeTo(unsigned int target, float value, UInt32 durationInSamples, ofxAudioUnitFadeCurve curve)
+// ----------------------------------------------------------
+{
+	FadeCommand command;
+	command.target   = target;
+	command.value    = value;
+	command.duration = durationInSamples;
+	command.curve    = curve;
+	
+	OFXAU_REALTIME_LOCK(_producerMutex);
+	bool queued = _commands.push(command);
+	_producerMutex.unlock();
+	
+	return queued;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitFadeScheduler::setValue(unsigned int target, float value)
+// ----------------------------------------------------------
+{
+	OFXAU_REALTIME_LOCK(_stateMutex);
+	{
+		// fades that were requested before this call shouldn't win over it
+		applyCommands();
+		
+		if(target < _targets.size())
+		{
+			FadeState &fade = _targets[target];
+			stopFade(fade);
+			fade.value = fade.to = value;
+		}
+	}
+	_stateMutex.unlock();
+}
+
+// ----------------------------------------------------------
+float ofxAudioUnitFadeScheduler::getValue(unsigned int target) const
+// ----------------------------------------------------------
+{
+	return target < _targets.size() ? _targets[target].value : 0;
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitFadeScheduler::isFading(unsigned int target) const
+// ----------------------------------------------------------
+{
+	return target < _targets.size() && _targets[target].activeIndex >= 0;
+}
+
+#pragma mark - Rendering
+
+// ----------------------------------------------------------
+bool ofxAudioUnitFadeScheduler::beginBuffer(UInt32 frames)
+// ----------------------------------------------------------
+{
+	_segmentCount = 0;
+	if(!_stateMutex.tryLock()) return false;
+	
+	applyCommands();
+	
+	unsigned int i = 0;
+	while(i < _activeTargets.size())
+	{
+		FadeState &fade = _targets[_activeTargets[i]];
+		Segment &segment = _segments[_segmentCount++];
+		segment.target     = _activeTargets[i];
+		segment.startValue = fade.value;
+		
+		fade.elapsed = min(fade.elapsed + frames, fade.duration);
+		
+		if(fade.elapsed >= fade.duration)
+		{
+			fade.value = fade.to;
+			stopFade(fade); // moves the last active fade into slot i
+		}
+		else
+		{
+			fade.value = curveValue(fade.from, fade.to, (float)fade.elapsed / fade.duration, fade.curve);
+			i++;
+		}
+		
+		segment.endValue = fade.value;
+	}
+	
+	return true;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitFadeScheduler::endBuffer()
+// ----------------------------------------------------------
+{
+	_stateMutex.unlock();
+}
+
+#pragma mark - Fade state
+
+// ----------------------------------------------------------
+void ofxAudioUnitFadeScheduler::applyCommands()
+// ----------------------------------------------------------
+{
+	FadeCommand command;
+	while(_commands.pop(command))
+	{
+		if(command.target < _targets.size()) startFade(command);
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitFadeScheduler::startFade(const FadeCommand &command)
+// ----------------------------------------------------------
+{
+	FadeState &fade = _targets[command.target];
+	fade.from     = fade.value;
+	fade.to       = command.value;
+	fade.elapsed  = 0;
+	fade.duration = command.duration;
+	fade.curve    = command.curve;
+	
+	// a zero-length fade still reports one (flat) segment, so that the
+	// owner applies the new value on the next buffer
+	if(fade.duration == 0) fade.value = fade.to;
+	
+	if(fade.activeIndex < 0)
+	{
+		fade.activeIndex = _activeTargets.size();
+		_activeTargets.push_back(command.target);
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitFadeScheduler::stopFade(FadeState &fade)
+// ----------------------------------------------------------
+{
+	if(fade.activeIndex < 0) return;
+	
+	const unsigned int lastTarget = _activeTargets.back();
+	_activeTargets[fade.activeIndex] = lastTarget;
+	_targets[lastTarget].activeIndex = fade.activeIndex;
+	_activeTargets.pop_back();
+	
+	fade.activeIndex = -1;
+}
+
+// ----------------------------------------------------------
+float curveValue(float from, float to, float t, ofxAudioUnitFadeCurve curve)
+// ----------------------------------------------------------
+{
+	switch(curve)
+	{
+		case OFX_AU_FADE_EXPONENTIAL:
+			if(from >= 0 && to >= 0)
+			{
+				float a = max(from, kExponentialFloor);
+				float b = max(to, kExponentialFloor);
+				return a * powf(b / a, t);
+			}
+			break;
+		
+		case OFX_AU_FADE_EQUAL_POWER:
+			if(to > from) return from + (to - from) * sinf(t * M_PI_2);
+			else          return to   + (from - to) * cosf(t * M_PI_2);
+		
+		case OFX_AU_FADE_S_CURVE:
+			t = t * t * (3 - 2 * t);
+			break;
+		
+		default:
+			break;
+	}
+	
+	return from + (to - from) * t;
+}
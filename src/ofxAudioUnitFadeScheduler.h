@@ -0,0 +1,103 @@
+#pragma once
+
+#include <AudioToolbox/AudioToolbox.h>
+#include <vector>
+#include "ofTypes.h"
+#include "ofxAudioUnitLockFree.h"
+
+// Fade curves, for ofxAudioUnitFadeScheduler and the ramped setters
+// on the mixers. The exponential curve moves linearly in decibels (with
+// a floor of -60 dB), which sounds the most even for gain changes.
+// Equal power follows a quarter sine / cosine, and the s-curve eases
+// in and out at both ends.
+
+enum ofxAudioUnitFadeCurve
+{
+	OFX_AU_FADE_LINEAR,
+	OFX_AU_FADE_EXPONENTIAL,
+	OFX_AU_FADE_EQUAL_POWER,
+	OFX_AU_FADE_S_CURVE
+};
+
+// ofxAudioUnitFadeScheduler runs fades on a set of numbered float
+// values ("targets"), such as the volumes and pans of a mixer's busses.
+
+// Fades are requested from any non-render thread with fadeTo(). The
+// requests are passed to the render thread through a lock-free queue,
+// and the render thread advances every running fade once per buffer
+// with beginBuffer(). Each fade that moved during that buffer is
+// reported as a segment (a start and end value) which the owner applies
+// as a linear ramp over the buffer. Curves are followed piecewise, one
+// buffer at a time.
+
+// Only running fades are touched per buffer, so thousands of targets
+// can be fading at once. The number of targets has to be set up front
+// with setTargetCount(), which is the only call that allocates.
+
+class ofxAudioUnitFadeScheduler
+{
+public:
+	struct Segment
+	{
+		unsigned int target;
+		float startValue;
+		float endValue;
+	};
+	
+	ofxAudioUnitFadeScheduler(unsigned int targetCount = 0, unsigned int maxPendingFades = 4096);
+	
+	void setTargetCount(unsigned int targetCount, float initialValue = 0);
+	unsigned int getTargetCount() const {return _targets.size();}
+	
+	// Non-render threads only. fadeTo() returns false if too many fades
+	// have been requested since the last buffer was rendered. setValue()
+	// jumps straight to a value, cancelling any fade in progress.
+	bool  fadeTo(unsigned int target, float value, UInt32 durationInSamples, ofxAudioUnitFadeCurve curve = OFX_AU_FADE_LINEAR);
+	void  setValue(unsigned int target, float value);
+	float getValue(unsigned int target) const;
+	bool  isFading(unsigned int target) const;
+	
+	// Render thread only. If beginBuffer() returns true, the segments for
+	// this buffer are valid until endBuffer() is called. If it returns
+	// false, the scheduler is being reconfigured and nothing moves.
+	bool beginBuffer(UInt32 frames);
+	unsigned int getSegmentCount() const {return _segmentCount;}
+	const Segment& getSegment(unsigned int index) const {return _segments[index];}
+	void endBuffer();
+
+private:
+	struct FadeCommand
+	{
+		unsigned int target;
+		float value;
+		UInt32 duration;
+		ofxAudioUnitFadeCurve curve;
+	};
+	
+	struct FadeState
+	{
+		float value;
+		float from;
+		float to;
+		UInt32 elapsed;
+		UInt32 duration;
+		ofxAudioUnitFadeCurve curve;
+		int activeIndex;
+	};
+	
+	std::vector<FadeState>    _targets;
+	std::vector<unsigned int> _activeTargets;
+	std::vector<Segment>      _segments;
+	unsigned int              _segmentCount;
+	
+	ofxAudioUnitLockFreeFifo<FadeCommand> _commands;
+	ofMutex _producerMutex;
+	ofMutex _stateMutex;
+	
+	void applyCommands();
+	void startFade(const FadeCommand &command);
+	void stopFade(FadeState &fade);
+	
+	ofxAudioUnitFadeScheduler(const ofxAudioUnitFadeScheduler &orig);
+	ofxAudioUnitFadeScheduler& operator=(const ofxAudioUnitFadeScheduler &orig);
+};
@@ -1,5 +1,8 @@
 #include "ofxAudioUnit.h"
+#include "ofxAudioUnitServiceThread.h"
 #import <mach/mach_time.h>
+#include <libkern/OSAtomic.h>
+#include <deque>
 
 AudioComponentDescription filePlayerDesc =
 {
@@ -8,12 +11,151 @@ AudioComponentDescription filePlayerDesc =
 	kAudioUnitManufacturer_Apple
 };
 
+// how many queued regions are scheduled on the unit at once
+static const int kScheduledRegionSlots = 4;
+
+// how far ahead of the current play time a region is scheduled if the
+// queue ran dry before it was added
+static const Float64 kLateRegionLeadSeconds = 0.05;
+
+// The transport follows what the unit is playing so that the playback
+// position can be read without a property call. The player describes
+// each play() / stop() as a Schedule, handed to the render thread under
+// a sequence lock (the sequence is odd while it's being written). A
+// post-render notification works out where each buffer ended in the
+// file from the buffer's timestamp, and publishes that as a single
+// 32 bit value. It also notices loops, the end of playback and the ends
+// of queued regions, and posts them as events.
+
+struct ofxAudioUnitFilePlayer::Transport
+{
+	struct Schedule
+	{
+		bool     playing;
+		uint64_t startHostTime;
+		Float64  hostTicksPerFrame;
+		Float64  fileFramesPerFrame;
+		UInt32   startFrame;
+		UInt32   frames;    // 0 when the region queue is playing
+		UInt32   loopCount;
+		UInt32   queueRun;  // which start of the region queue is playing
+	};
+	
+	// where a queued region ends, in frames since playQueue() started
+	// the run it belongs to
+	struct RegionEnd
+	{
+		UInt32  run;
+		Float64 sampleTime;
+	};
+	
+	AudioUnitRef unit;
+	ofMutex mutex;
+	
+	// written by the player
+	Schedule pending;
+	volatile int32_t sequence;
+	
+	// render thread only
+	Schedule current;
+	int32_t appliedSequence;
+	Float64 startSampleTime;
+	bool started;
+	UInt32 loopsPlayed;
+	UInt32 loopsPosted;
+	bool finished;
+	bool finishPosted;
+	RegionEnd regionEnd;
+	bool hasRegionEnd;
+	UInt32 regionsFinished;
+	UInt32 regionsPosted;
+	
+	// written by the region queue, under its mutex
+	ofxAudioUnitLockFreeFifo<RegionEnd> regionEnds;
+	
+	// written by the render thread
+	volatile int32_t position;
+	ofxAudioUnitEventQueue events;
+	
+	Transport(AudioUnitRef transportUnit);
+	~Transport();
+	
+	void start(uint64_t startHostTime, UInt32 startFrame, UInt32 frames, UInt32 loopCount, Float64 fileRate, UInt32 queueRun);
+	void stop();
+	void setSchedule(const Schedule &schedule);
+	void advance(const AudioTimeStamp *inTimeStamp, UInt32 inNumberFrames);
+	void finishRegions(Float64 framesPlayed);
+	void postEvents(uint64_t hostTime);
+	
+	static OSStatus renderNotify(void *inRefCon,
+	                             AudioUnitRenderActionFlags *ioActionFlags,
+	                             const AudioTimeStamp *inTimeStamp,
+	                             UInt32 inBusNumber,
+	                             UInt32 inNumberFrames,
+	                             AudioBufferList *ioData);
+};
+
+// The region queue's state lives in its own object, shared by copies of
+// the player (which also share the unit). Only kScheduledRegionSlots
+// regions are handed to the unit at a time; the rest wait in pending.
+// The unit reports each finished region from its own thread through a
+// lock-free queue, and the service thread schedules the next ones.
+// Each region's end time is handed to the transport as it's scheduled,
+// so that the region is reported finished when the render thread plays
+// past it (the unit's completion can come well before that). Ends that
+// don't fit in the transport's queue are kept and retried on every
+// service pass, so none are lost.
+
+struct ofxAudioUnitFilePlayer::RegionQueue
+{
+	struct PendingRegion
+	{
+		std::string filePath;
+		UInt32 startFrame;
+		UInt32 framesToPlay;
+	};
+	
+	struct Slot
+	{
+		ScheduledAudioFileRegion region;
+		RegionQueue * queue;
+		bool scheduled;
+	};
+	
+	AudioUnitRef unit;
+	ofPtr<Transport> transport;
+	std::deque<PendingRegion> pending;
+	Slot slots[kScheduledRegionSlots];
+	Float64 nextSampleTime;
+	bool running;
+	UInt32 run;
+	ofxAudioUnitLockFreeFifo<Slot *> completed;
+	std::deque<Transport::RegionEnd> unpushedEnds;
+	ofMutex mutex;
+	
+	RegionQueue(AudioUnitRef queueUnit, ofPtr<Transport> queueTransport);
+	~RegionQueue();
+	
+	void start();
+	void stop();
+	void releaseSlots();
+	void scheduleRegions();
+	bool scheduleRegion(Slot &slot, const PendingRegion &pendingRegion, Float64 outputRate);
+	void updateFileIDs();
+	void pushRegionEnds();
+	
+	static void service(void * context);
+	static void regionCompleted(void * userData, ScheduledAudioFileRegion * region, OSStatus result);
+};
+
 // ----------------------------------------------------------
 ofxAudioUnitFilePlayer::ofxAudioUnitFilePlayer()
 // ----------------------------------------------------------
 {
 	_desc = filePlayerDesc;
 	initUnit();
+	_transport = ofPtr<Transport>(new Transport(_unit));
+	_overview  = ofPtr<ofxAudioUnitWaveformOverview>(new ofxAudioUnitWaveformOverview);
 }
 
 // ----------------------------------------------------------
@@ -30,10 +172,13 @@ ofxAudioUnitFilePlayer::~ofxAudioUnitFilePlayer()
 bool ofxAudioUnitFilePlayer::setFile(const std::string &filePath)
 // ----------------------------------------------------------
 {
+	// playing a decoded copy of a compressed file saves the unit decoding it
+	const std::string sourcePath = ofxAudioUnitDecodeCache::shared().resolve(filePath);
+	
 	CFURLRef fileURL;
 	fileURL = CFURLCreateFromFileSystemRepresentation(kCFAllocatorDefault,
-	                                                  (const UInt8 *)filePath.c_str(),
-	                                                  filePath.length(),
+	                                                  (const UInt8 *)sourcePath.c_str(),
+	                                                  sourcePath.length(),
 	                                                  NULL);
 	
 	if(_fileID[0]) AudioFileClose(_fileID[0]);
@@ -45,9 +190,12 @@ bool ofxAudioUnitFilePlayer::setFile(const std::string &filePath)
 	if(s != noErr)
 	{
 		cout << "Error " << s << " while opening file at " << filePath << endl;
+		_overview->clear();
 		return false;
 	}
 	
+	_overview->setFile(filePath);
+	
 	UInt64 numPackets = 0;
 	UInt32 dataSize   = sizeof(numPackets);
 	
@@ -140,6 +288,12 @@ void ofxAudioUnitFilePlayer::play(uint64_t startTime)
 	                                  &startTimeStamp,
 	                                  sizeof(startTimeStamp)),
 	             "setting file player start time");
+	
+	AudioStreamBasicDescription fileFormat = {0};
+	UInt32 dataSize = sizeof(fileFormat);
+	AudioFileGetProperty(_fileID[0], kAudioFilePropertyDataFormat, &dataSize, &fileFormat);
+	
+	_transport->start(startTime, _region.mStartFrame, _region.mFramesToPlay, _region.mLoopCount, fileFormat.mSampleRate, 0);
 }
 
 // ----------------------------------------------------------
@@ -154,5 +308,604 @@ void ofxAudioUnitFilePlayer::loop(unsigned int timesToLoop, uint64_t startTime)
 void ofxAudioUnitFilePlayer::stop()
 // ----------------------------------------------------------
 {
+	if(_queue) _queue->stop();
+	reset();
+	if(_queue) _queue->releaseSlots();
+	_transport->stop();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitFilePlayer::setEventCallback(ofxAudioUnitEventProc proc, void * context)
+// ----------------------------------------------------------
+{
+	_transport->events.setCallback(proc, context);
+}
+
+// ----------------------------------------------------------
+UInt32 ofxAudioUnitFilePlayer::getPosition()
+// ----------------------------------------------------------
+{
+	OSMemoryBarrier();
+	return _transport->position;
+}
+
+#pragma mark - Region queue
+
+// ----------------------------------------------------------
+void ofxAudioUnitFilePlayer::queueRegion(const std::string &filePath, UInt32 startFrame, UInt32 framesToPlay)
+// ----------------------------------------------------------
+{
+	if(!_queue)
+	{
+		_queue = ofPtr<RegionQueue>(new RegionQueue(_unit, _transport));
+	}
+	
+	RegionQueue::PendingRegion region;
+	region.filePath     = filePath;
+	region.startFrame   = startFrame;
+	region.framesToPlay = framesToPlay;
+	
+	OFXAU_REALTIME_LOCK(_queue->mutex);
+	_queue->pending.push_back(region);
+	_queue->mutex.unlock();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitFilePlayer::playQueue(uint64_t startTime)
+// ----------------------------------------------------------
+{
+	if(!_queue)
+	{
+		cout << "ofxAudioUnitFilePlayer has no queued regions to play" << endl;
+		return;
+	}
+	
+	// dropping anything already scheduled, so the queue starts cleanly
+	_queue->stop();
 	reset();
+	_queue->releaseSlots();
+	_queue->start();
+	
+	if(startTime == 0)
+	{
+		startTime = mach_absolute_time();
+	}
+	AudioTimeStamp startTimeStamp = {0};
+	FillOutAudioTimeStampWithHostTime(startTimeStamp, startTime);
+	
+	OFXAU_RETURN(AudioUnitSetProperty(*_unit,
+	                                  kAudioUnitProperty_ScheduleStartTimeStamp,
+	                                  kAudioUnitScope_Global,
+	                                  0,
+	                                  &startTimeStamp,
+	                                  sizeof(startTimeStamp)),
+	             "setting file player queue start time");
+	
+	_transport->start(startTime, 0, 0, 0, 0, _queue->run);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitFilePlayer::clearQueue()
+// ----------------------------------------------------------
+{
+	if(!_queue) return;
+	
+	OFXAU_REALTIME_LOCK(_queue->mutex);
+	_queue->pending.clear();
+	_queue->mutex.unlock();
+}
+
+// ----------------------------------------------------------
+unsigned int ofxAudioUnitFilePlayer::getQueuedRegionCount()
+// ----------------------------------------------------------
+{
+	if(!_queue) return 0;
+	
+	OFXAU_REALTIME_LOCK(_queue->mutex);
+	unsigned int count = _queue->pending.size();
+	for(int i = 0; i < kScheduledRegionSlots; i++)
+	{
+		if(_queue->slots[i].scheduled) count++;
+	}
+	_queue->mutex.unlock();
+	
+	return count;
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitFilePlayer::RegionQueue::RegionQueue(AudioUnitRef queueUnit, ofPtr<Transport> queueTransport)
+: unit(queueUnit)
+, transport(queueTransport)
+, nextSampleTime(0)
+, running(false)
+, run(0)
+, completed(kScheduledRegionSlots * 2)
+// ----------------------------------------------------------
+{
+	for(int i = 0; i < kScheduledRegionSlots; i++)
+	{
+		memset(&slots[i].region, 0, sizeof(slots[i].region));
+		slots[i].queue     = this;
+		slots[i].scheduled = false;
+	}
+	
+	ofxAudioUnitServiceThread::shared().addClient(service, this);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitFilePlayer::RegionQueue::~RegionQueue()
+// ----------------------------------------------------------
+{
+	ofxAudioUnitServiceThread::shared().removeClient(service, this);
+	
+	// the unit mustn't call back into the slots once they're gone
+	AudioUnitReset(*unit, kAudioUnitScope_Global, 0);
+	releaseSlots();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitFilePlayer::RegionQueue::start()
+// ----------------------------------------------------------
+{
+	OFXAU_REALTIME_LOCK(mutex);
+	nextSampleTime = 0;
+	running        = true;
+	run++;
+	scheduleRegions();
+	mutex.unlock();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitFilePlayer::RegionQueue::stop()
+// ----------------------------------------------------------
+{
+	OFXAU_REALTIME_LOCK(mutex);
+	running = false;
+	mutex.unlock();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitFilePlayer::RegionQueue::releaseSlots()
+// ----------------------------------------------------------
+{
+	OFXAU_REALTIME_LOCK(mutex);
+	{
+		// the unit has been reset, so any completions still in the queue
+		// are for regions that are gone anyway
+		Slot * slot;
+		while(completed.pop(slot));
+		
+		for(int i = 0; i < kScheduledRegionSlots; i++)
+		{
+			if(!slots[i].scheduled) continue;
+			slots[i].scheduled = false;
+			AudioFileClose(slots[i].region.mAudioFile);
+		}
+	}
+	mutex.unlock();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitFilePlayer::RegionQueue::scheduleRegions()
+// ----------------------------------------------------------
+{
+	if(!running || pending.empty()) return;
+	
+	bool slotFree = false;
+	for(int i = 0; i < kScheduledRegionSlots; i++) slotFree |= !slots[i].scheduled;
+	if(!slotFree) return;
+	
+	AudioStreamBasicDescription outputFormat = {0};
+	UInt32 dataSize = sizeof(outputFormat);
+	OFXAU_RETURN(AudioUnitGetProperty(*unit,
+	                                  kAudioUnitProperty_StreamFormat,
+	                                  kAudioUnitScope_Output,
+	                                  0,
+	                                  &outputFormat,
+	                                  &dataSize),
+	             "getting file player output format");
+	
+	// if the queue ran dry before more regions were added, the next
+	// region's time has already gone by
+	AudioTimeStamp playTime = {0};
+	dataSize = sizeof(playTime);
+	if(AudioUnitGetProperty(*unit, kAudioUnitProperty_CurrentPlayTime, kAudioUnitScope_Global, 0, &playTime, &dataSize) == noErr &&
+	   (playTime.mFlags & kAudioTimeStampSampleTimeValid) && playTime.mSampleTime >= 0)
+	{
+		nextSampleTime = max(nextSampleTime, playTime.mSampleTime + kLateRegionLeadSeconds * outputFormat.mSampleRate);
+	}
+	
+	for(int i = 0; i < kScheduledRegionSlots && !pending.empty(); i++)
+	{
+		if(slots[i].scheduled) continue;
+		
+		PendingRegion region = pending.front();
+		pending.pop_front();
+		scheduleRegion(slots[i], region, outputFormat.mSampleRate);
+	}
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitFilePlayer::RegionQueue::scheduleRegion(Slot &slot, const PendingRegion &pendingRegion, Float64 outputRate)
+// ----------------------------------------------------------
+{
+	const std::string &filePath = pendingRegion.filePath;
+	
+	CFURLRef fileURL;
+	fileURL = CFURLCreateFromFileSystemRepresentation(kCFAllocatorDefault,
+	                                                  (const UInt8 *)filePath.c_str(),
+	                                                  filePath.length(),
+	                                                  NULL);
+	
+	AudioFileID fileID;
+	OSStatus s = AudioFileOpenURL(fileURL, kAudioFileReadPermission, 0, &fileID);
+	CFRelease(fileURL);
+	
+	if(s != noErr)
+	{
+		cout << "Error " << s << " while opening queued file at " << filePath << endl;
+		return false;
+	}
+	
+	UInt64 numPackets = 0;
+	UInt32 dataSize   = sizeof(numPackets);
+	AudioFileGetProperty(fileID, kAudioFilePropertyAudioDataPacketCount, &dataSize, &numPackets);
+	
+	AudioStreamBasicDescription asbd = {0};
+	dataSize = sizeof(asbd);
+	AudioFileGetProperty(fileID, kAudioFilePropertyDataFormat, &dataSize, &asbd);
+	
+	const UInt64 fileFrames = numPackets * asbd.mFramesPerPacket;
+	if(pendingRegion.startFrame >= fileFrames || asbd.mSampleRate <= 0)
+	{
+		cout << "Queued region starts past the end of " << filePath << endl;
+		AudioFileClose(fileID);
+		return false;
+	}
+	
+	UInt32 framesToPlay = fileFrames - pendingRegion.startFrame;
+	if(pendingRegion.framesToPlay > 0) framesToPlay = min(framesToPlay, pendingRegion.framesToPlay);
+	
+	// each region starts on the sample after the previous one ends
+	ScheduledAudioFileRegion &region = slot.region;
+	memset(&region, 0, sizeof(region));
+	region.mTimeStamp.mFlags       = kAudioTimeStampSampleTimeValid;
+	region.mTimeStamp.mSampleTime  = nextSampleTime;
+	region.mCompletionProc         = regionCompleted;
+	region.mCompletionProcUserData = &slot;
+	region.mAudioFile              = fileID;
+	region.mLoopCount              = 0;
+	region.mStartFrame             = pendingRegion.startFrame;
+	region.mFramesToPlay           = framesToPlay;
+	slot.scheduled = true;
+	
+	// the unit has to know about a file before a region can use it
+	updateFileIDs();
+	
+	s = AudioUnitSetProperty(*unit,
+	                         kAudioUnitProperty_ScheduledFileRegion,
+	                         kAudioUnitScope_Global,
+	                         0,
+	                         &region,
+	                         sizeof(region));
+	
+	if(s != noErr)
+	{
+		OFXAU_PRINT(s, "scheduling queued file region");
+		slot.scheduled = false;
+		updateFileIDs();
+		AudioFileClose(fileID);
+		return false;
+	}
+	
+	nextSampleTime += framesToPlay * outputRate / asbd.mSampleRate;
+	
+	Transport::RegionEnd end = {run, nextSampleTime};
+	unpushedEnds.push_back(end);
+	pushRegionEnds();
+	return true;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitFilePlayer::RegionQueue::pushRegionEnds()
+// ----------------------------------------------------------
+{
+	while(!unpushedEnds.empty())
+	{
+		// ends from an earlier run would only be dropped by the render thread
+		if(unpushedEnds.front().run != run)
+		{
+			unpushedEnds.pop_front();
+			continue;
+		}
+		
+		if(!transport->regionEnds.push(unpushedEnds.front())) return;
+		unpushedEnds.pop_front();
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitFilePlayer::RegionQueue::updateFileIDs()
+// ----------------------------------------------------------
+{
+	AudioFileID fileIDs[kScheduledRegionSlots];
+	UInt32 fileCount = 0;
+	
+	for(int i = 0; i < kScheduledRegionSlots; i++)
+	{
+		if(slots[i].scheduled) fileIDs[fileCount++] = slots[i].region.mAudioFile;
+	}
+	
+	AudioUnitSetProperty(*unit,
+	                     kAudioUnitProperty_ScheduledFileIDs,
+	                     kAudioUnitScope_Global,
+	                     0,
+	                     fileCount ? fileIDs : NULL,
+	                     fileCount * sizeof(AudioFileID));
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitFilePlayer::RegionQueue::service(void * context)
+// ----------------------------------------------------------
+{
+	RegionQueue * queue = static_cast<RegionQueue *>(context);
+	if(!queue->mutex.tryLock()) return;
+	
+	// freeing the slots of finished regions. Their files are closed only
+	// once the unit has been given a file list without them
+	AudioFileID finishedFiles[kScheduledRegionSlots];
+	UInt32 finishedCount = 0;
+	
+	Slot * slot;
+	while(queue->completed.pop(slot))
+	{
+		if(!slot->scheduled) continue;
+		slot->scheduled = false;
+		finishedFiles[finishedCount++] = slot->region.mAudioFile;
+	}
+	
+	if(finishedCount > 0) queue->updateFileIDs();
+	for(int i = 0; i < finishedCount; i++) AudioFileClose(finishedFiles[i]);
+	
+	queue->scheduleRegions();
+	queue->pushRegionEnds();
+	queue->mutex.unlock();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitFilePlayer::RegionQueue::regionCompleted(void * userData, ScheduledAudioFileRegion * region, OSStatus result)
+// ----------------------------------------------------------
+{
+	// called on the unit's own thread
+	Slot * slot = static_cast<Slot *>(userData);
+	slot->queue->completed.push(slot);
+}
+
+#pragma mark - Transport
+
+// ----------------------------------------------------------
+ofxAudioUnitFilePlayer::Transport::Transport(AudioUnitRef transportUnit)
+: unit(transportUnit)
+, sequence(0)
+, appliedSequence(0)
+, startSampleTime(0)
+, started(false)
+, loopsPlayed(0)
+, loopsPosted(0)
+, finished(false)
+, finishPosted(false)
+, hasRegionEnd(false)
+, regionsFinished(0)
+, regionsPosted(0)
+, regionEnds(kScheduledRegionSlots * 4)
+, position(0)
+// ----------------------------------------------------------
+{
+	memset(&pending, 0, sizeof(pending));
+	memset(&current, 0, sizeof(current));
+	memset(&regionEnd, 0, sizeof(regionEnd));
+	
+	OFXAU_PRINT(AudioUnitAddRenderNotify(*unit, renderNotify, this),
+	            "adding file player position notification");
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitFilePlayer::Transport::~Transport()
+// ----------------------------------------------------------
+{
+	AudioUnitRemoveRenderNotify(*unit, renderNotify, this);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitFilePlayer::Transport::start(uint64_t startHostTime, UInt32 startFrame, UInt32 frames, UInt32 loopCount, Float64 fileRate, UInt32 queueRun)
+// ----------------------------------------------------------
+{
+	AudioStreamBasicDescription outputFormat = {0};
+	UInt32 dataSize = sizeof(outputFormat);
+	AudioUnitGetProperty(*unit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, &outputFormat, &dataSize);
+	if(outputFormat.mSampleRate <= 0) outputFormat.mSampleRate = 44100;
+	
+	mach_timebase_info_data_t timebase;
+	mach_timebase_info(&timebase);
+	const Float64 hostTicksPerSecond = 1.0e9 * timebase.denom / timebase.numer;
+	
+	Schedule schedule;
+	schedule.playing            = true;
+	schedule.startHostTime      = startHostTime;
+	schedule.hostTicksPerFrame  = hostTicksPerSecond / outputFormat.mSampleRate;
+	schedule.fileFramesPerFrame = fileRate > 0 ? fileRate / outputFormat.mSampleRate : 1;
+	schedule.startFrame         = startFrame;
+	schedule.frames             = frames;
+	schedule.loopCount          = loopCount;
+	schedule.queueRun           = queueRun;
+	setSchedule(schedule);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitFilePlayer::Transport::stop()
+// ----------------------------------------------------------
+{
+	Schedule schedule;
+	memset(&schedule, 0, sizeof(schedule));
+	setSchedule(schedule);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitFilePlayer::Transport::setSchedule(const Schedule &schedule)
+// ----------------------------------------------------------
+{
+	OFXAU_REALTIME_LOCK(mutex);
+	OSAtomicIncrement32Barrier(&sequence);
+	pending = schedule;
+	OSAtomicIncrement32Barrier(&sequence);
+	mutex.unlock();
+}
+
+// ----------------------------------------------------------
+OSStatus ofxAudioUnitFilePlayer::Transport::renderNotify(void *inRefCon,
+                                                         AudioUnitRenderActionFlags *ioActionFlags,
+                                                         const AudioTimeStamp *inTimeStamp,
+                                                         UInt32 inBusNumber,
+                                                         UInt32 inNumberFrames,
+                                                         AudioBufferList *ioData)
+// ----------------------------------------------------------
+{
+	if(!(*ioActionFlags & kAudioUnitRenderAction_PostRender)) return noErr;
+	
+	Transport * transport = static_cast<Transport *>(inRefCon);
+	Schedule &schedule = transport->current;
+	
+	// picking up a new schedule, unless the player is halfway through
+	// writing one (in which case it's picked up next buffer)
+	const int32_t sequence = transport->sequence;
+	OSMemoryBarrier();
+	if(sequence != transport->appliedSequence && !(sequence & 1))
+	{
+		Schedule pending = transport->pending;
+		OSMemoryBarrier();
+		if(transport->sequence == sequence)
+		{
+			schedule = pending;
+			transport->appliedSequence = sequence;
+			transport->started      = false;
+			transport->loopsPlayed  = 0;
+			transport->loopsPosted  = 0;
+			transport->finished     = false;
+			transport->finishPosted = false;
+			transport->regionsFinished = 0;
+			transport->regionsPosted   = 0;
+			if(!schedule.playing) transport->position = 0;
+		}
+	}
+	
+	if(schedule.playing) transport->advance(inTimeStamp, inNumberFrames);
+	transport->postEvents(inTimeStamp->mHostTime);
+	
+	return noErr;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitFilePlayer::Transport::advance(const AudioTimeStamp *inTimeStamp, UInt32 inNumberFrames)
+// ----------------------------------------------------------
+{
+	const bool timed = (inTimeStamp->mFlags & kAudioTimeStampSampleTimeValid) &&
+	                   (inTimeStamp->mFlags & kAudioTimeStampHostTimeValid);
+	if(!timed) return;
+	
+	// finding the sample time the unit started playing at, once the
+	// start time falls within a buffer
+	if(!started)
+	{
+		const Float64 ticksUntilStart = (Float64)current.startHostTime - (Float64)inTimeStamp->mHostTime;
+		const Float64 framesUntilStart = ticksUntilStart / current.hostTicksPerFrame;
+		if(framesUntilStart >= inNumberFrames) return;
+		
+		startSampleTime = inTimeStamp->mSampleTime + max(framesUntilStart, 0.);
+		started = true;
+	}
+	
+	const Float64 framesPlayed = max(inTimeStamp->mSampleTime + inNumberFrames - startSampleTime, 0.);
+	const Float64 fileFrames   = framesPlayed * current.fileFramesPerFrame;
+	
+	Float64 frame;
+	if(current.frames == 0)
+	{
+		frame = fileFrames;
+		finishRegions(framesPlayed);
+	}
+	else
+	{
+		const bool forever = current.loopCount == (UInt32)OFX_AU_LOOP_FOREVER;
+		const Float64 wraps = floor(fileFrames / current.frames);
+		
+		if(forever || wraps <= current.loopCount)
+		{
+			frame = current.startFrame + fmod(fileFrames, (Float64)current.frames);
+			loopsPlayed = wraps;
+		}
+		else
+		{
+			// played out. Nothing changes from here until the next schedule
+			frame = current.startFrame + current.frames;
+			loopsPlayed = current.loopCount;
+			finished = true;
+			current.playing = false;
+		}
+	}
+	
+	position = (int32_t)min(frame, (Float64)INT32_MAX);
+	OSMemoryBarrier();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitFilePlayer::Transport::finishRegions(Float64 framesPlayed)
+// ----------------------------------------------------------
+{
+	while(true)
+	{
+		if(!hasRegionEnd)
+		{
+			if(!regionEnds.pop(regionEnd)) return;
+			hasRegionEnd = true;
+		}
+		
+		// ends left over from an earlier run are dropped. Ends from a run
+		// that's about to start wait for its schedule to arrive
+		const int32_t runsAhead = regionEnd.run - current.queueRun;
+		if(runsAhead < 0)
+		{
+			hasRegionEnd = false;
+			continue;
+		}
+		if(runsAhead > 0 || framesPlayed < regionEnd.sampleTime) return;
+		
+		regionsFinished++;
+		hasRegionEnd = false;
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitFilePlayer::Transport::postEvents(uint64_t hostTime)
+// ----------------------------------------------------------
+{
+	// anything that doesn't fit in the queue is posted on a later buffer
+	while(loopsPosted < loopsPlayed)
+	{
+		ofxAudioUnitEvent event = {OFX_AU_EVENT_LOOPED, loopsPosted + 1, hostTime};
+		if(!events.post(event)) return;
+		loopsPosted++;
+	}
+	
+	while(regionsPosted < regionsFinished)
+	{
+		ofxAudioUnitEvent event = {OFX_AU_EVENT_REGION_FINISHED, regionsPosted + 1, hostTime};
+		if(!events.post(event)) return;
+		regionsPosted++;
+	}
+	
+	if(finished && !finishPosted)
+	{
+		ofxAudioUnitEvent event = {OFX_AU_EVENT_FINISHED, loopsPlayed, hostTime};
+		finishPosted = events.post(event);
+	}
 }
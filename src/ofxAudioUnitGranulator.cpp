@@ -0,0 +1,325 @@
+#include "ofxAudioUnit.h"
+#include <Accelerate/Accelerate.h>
+#include <libkern/OSAtomic.h>
+#include <math.h>
+
+static const UInt32  kDefaultMaxGrains = 1024;
+
+// the Hann window is looked up (with linear interpolation) from a table
+// of this many points, plus a trailing zero
+static const UInt32 kWindowTableSize = 1024;
+
+static const float kMaxDensity   = 20000;
+static const float kMinDuration  = 0.001;
+static const float kMaxDuration  = 2;
+static const float kMaxSemitones = 48;
+
+// ----------------------------------------------------------
+ofxAudioUnitGranulator::ofxAudioUnitGranulator()
+: ofxAudioUnitNativeNode(2)
+, _activeGrains(0)
+, _framesUntilNextGrain(0)
+, _random(0x9E3779B9)
+, _running(false)
+, _density(20)
+, _duration(0.1)
+, _position(0)
+, _positionSpread(0)
+, _pitch(0)
+, _pitchSpread(0)
+, _pan(0)
+, _panSpread(0)
+, _gain(0.5)
+, _triggers(0)
+, _droppedGrains(0)
+// ----------------------------------------------------------
+{
+	_grains.resize(kDefaultMaxGrains);
+	
+	_windowTable.resize(kWindowTableSize + 1);
+	for(int i = 0; i < kWindowTableSize; i++)
+	{
+		_windowTable[i] = 0.5 - 0.5 * cos(2 * M_PI * i / kWindowTableSize);
+	}
+	_windowTable[kWindowTableSize] = 0;
+	
+	_sourceIndices.resize(kMaxFramesPerSlice);
+	_windowIndices.resize(kMaxFramesPerSlice);
+	_window.resize(kMaxFramesPerSlice);
+	_grainSamples.resize(kMaxFramesPerSlice);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitGranulator::~ofxAudioUnitGranulator()
+// ----------------------------------------------------------
+{
+	detachNode();
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitGranulator::setFile(const std::string &filePath)
+// ----------------------------------------------------------
+{
+	ofxAudioUnitSampleBufferRef sample = ofxAudioUnitSampleCache::shared().load(filePath, getNodeSampleRate());
+	if(!sample) return false;
+	
+	setSample(sample);
+	return true;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitGranulator::setSample(ofxAudioUnitSampleBufferRef sample)
+// ----------------------------------------------------------
+{
+	// the grains playing are reading from the previous sample, so they're
+	// dropped along with it
+	OFXAU_REALTIME_LOCK(_renderMutex);
+	{
+		_activeGrains = 0;
+		_sample.swap(sample);
+	}
+	_renderMutex.unlock();
+}
+
+#pragma mark - Playback
+
+// ----------------------------------------------------------
+void ofxAudioUnitGranulator::start()
+// ----------------------------------------------------------
+{
+	OFXAU_REALTIME_LOCK(_renderMutex);
+	{
+		_framesUntilNextGrain = 0;
+		_running = true;
+	}
+	_renderMutex.unlock();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitGranulator::stop()
+// ----------------------------------------------------------
+{
+	// grains already playing are left to finish, so nothing is cut off
+	_running = false;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitGranulator::triggerGrain()
+// ----------------------------------------------------------
+{
+	OSAtomicIncrement32Barrier(&_triggers);
+}
+
+#pragma mark - Parameters
+
+// ----------------------------------------------------------
+void ofxAudioUnitGranulator::setDensity(float grainsPerSecond)
+// ----------------------------------------------------------
+{
+	_density = max(0.f, min(grainsPerSecond, kMaxDensity));
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitGranulator::setDuration(float seconds)
+// ----------------------------------------------------------
+{
+	_duration = max(kMinDuration, min(seconds, kMaxDuration));
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitGranulator::setPosition(float position, float spread)
+// ----------------------------------------------------------
+{
+	_position       = max(0.f, min(position, 1.f));
+	_positionSpread = max(0.f, min(spread, 1.f));
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitGranulator::setPitch(float semitones, float spread)
+// ----------------------------------------------------------
+{
+	_pitch       = max(-kMaxSemitones, min(semitones, kMaxSemitones));
+	_pitchSpread = max(0.f, min(spread, kMaxSemitones));
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitGranulator::setPan(float pan, float spread)
+// ----------------------------------------------------------
+{
+	_pan       = max(-1.f, min(pan, 1.f));
+	_panSpread = max(0.f, min(spread, 2.f));
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitGranulator::setMaxGrains(UInt32 maxGrains)
+// ----------------------------------------------------------
+{
+	OFXAU_REALTIME_LOCK(_renderMutex);
+	{
+		_grains.resize(max(maxGrains, (UInt32)1));
+		_activeGrains = min(_activeGrains, (UInt32)_grains.size());
+	}
+	_renderMutex.unlock();
+}
+
+#pragma mark - Rendering
+
+// ----------------------------------------------------------
+float ofxAudioUnitGranulator::randomBipolar()
+// ----------------------------------------------------------
+{
+	// xorshift, since rand() isn't safe to call on the render thread
+	_random ^= _random << 13;
+	_random ^= _random >> 17;
+	_random ^= _random << 5;
+	return (_random / 4294967295.0) * 2 - 1;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitGranulator::startGrain(UInt32 delay)
+// ----------------------------------------------------------
+{
+	if(_activeGrains >= _grains.size())
+	{
+		_droppedGrains++;
+		return;
+	}
+	
+	const UInt32  sampleFrames = _sample->getFrames();
+	const Float64 sampleRate   = getNodeSampleRate();
+	
+	// a sample decoded at another rate than the node's is read faster or
+	// slower to make up for it
+	const float semitones = max(-kMaxSemitones, min(_pitch + _pitchSpread * randomBipolar(), kMaxSemitones));
+	const float increment = powf(2, semitones / 12.f) * _sample->getSampleRate() / sampleRate;
+	
+	// a grain can't read past the end of the sample (including the extra
+	// frame interpolation reads), so long grains at high pitches are
+	// shortened to fit
+	UInt32 length = _duration * sampleRate;
+	length = min(length, (UInt32)((sampleFrames - 1) / increment));
+	if(length < 2) return;
+	
+	const Float64 span  = length * increment + 1;
+	Float64 start = (_position + _positionSpread * randomBipolar()) * sampleFrames - span / 2;
+	start = max(0., min(start, sampleFrames - span));
+	
+	// equal-power panning
+	const float pan   = max(-1.f, min(_pan + _panSpread * randomBipolar(), 1.f));
+	const float angle = (pan + 1) * M_PI / 4;
+	
+	Grain &grain = _grains[_activeGrains++];
+	grain.position        = start;
+	grain.increment       = increment;
+	grain.windowIncrement = (float)kWindowTableSize / length;
+	grain.gains[0]        = _gain * cosf(angle);
+	grain.gains[1]        = _gain * sinf(angle);
+	grain.length          = length;
+	grain.age             = 0;
+	grain.delay           = delay;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitGranulator::mixGrain(Grain &grain, UInt32 frames, UInt32 outputCount, AudioBufferList *ioData)
+// ----------------------------------------------------------
+{
+	const ofxAudioUnitSampleBuffer &sample = *_sample;
+	
+	// reading relative to the grain's current whole frame keeps the
+	// indices small enough to be exact as floats
+	const UInt32 base = grain.position;
+	float sourceStart = grain.position - base;
+	float windowStart = grain.age * grain.windowIncrement;
+	
+	vDSP_vramp(&sourceStart, &grain.increment, &_sourceIndices[0], 1, frames);
+	vDSP_vramp(&windowStart, &grain.windowIncrement, &_windowIndices[0], 1, frames);
+	vDSP_vlint(&_windowTable[0], &_windowIndices[0], 1, &_window[0], 1, frames, _windowTable.size());
+	
+	// mono samples play out of both sides, panned
+	int sourceChannel = -1;
+	for(int i = 0; i < outputCount; i++)
+	{
+		const int channel = min((UInt32)i, sample.getChannels() - 1);
+		if(channel != sourceChannel)
+		{
+			vDSP_vlint(sample.getChannel(channel) + base, &_sourceIndices[0], 1, &_grainSamples[0], 1, frames, sample.getFrames() - base);
+			vDSP_vmul(&_grainSamples[0], 1, &_window[0], 1, &_grainSamples[0], 1, frames);
+			sourceChannel = channel;
+		}
+		
+		AudioUnitSampleType * out = (AudioUnitSampleType *)ioData->mBuffers[i].mData + grain.delay;
+		vDSP_vsma(&_grainSamples[0], 1, &grain.gains[i % 2], out, 1, out, 1, frames);
+	}
+	
+	grain.position += frames * (Float64)grain.increment;
+	grain.age      += frames;
+	grain.delay     = 0;
+}
+
+// ----------------------------------------------------------
+OSStatus ofxAudioUnitGranulator::renderNode(AudioUnitRenderActionFlags *ioActionFlags,
+											const AudioTimeStamp *inTimeStamp,
+											UInt32 inNumberFrames,
+											AudioBufferList *ioData)
+// ----------------------------------------------------------
+{
+	const UInt32 outputCount = min((UInt32)ioData->mNumberBuffers, _outputChannels);
+	
+	for(int i = 0; i < outputCount; i++)
+	{
+		vDSP_vclr((AudioUnitSampleType *)ioData->mBuffers[i].mData, 1, inNumberFrames);
+	}
+	
+	if(!_sample || _sample->getFrames() < 2)
+	{
+		*ioActionFlags |= kAudioUnitRenderAction_OutputIsSilence;
+		return noErr;
+	}
+	
+	// starting this buffer's grains, each on the frame it falls on
+	const int32_t triggers = _triggers;
+	if(triggers > 0)
+	{
+		OSAtomicAdd32Barrier(-triggers, &_triggers);
+		for(int i = 0; i < triggers; i++) startGrain(0);
+	}
+	
+	const float density = _density;
+	if(_running && density > 0)
+	{
+		const Float64 interval = getNodeSampleRate() / density;
+		while(_framesUntilNextGrain < inNumberFrames)
+		{
+			startGrain(_framesUntilNextGrain);
+			_framesUntilNextGrain += interval;
+		}
+		_framesUntilNextGrain -= inNumberFrames;
+	}
+	
+	if(_activeGrains == 0)
+	{
+		*ioActionFlags |= kAudioUnitRenderAction_OutputIsSilence;
+		return noErr;
+	}
+	
+	// finished grains are swapped with the last active one, so the active
+	// grains always sit at the front of the pool
+	UInt32 i = 0;
+	while(i < _activeGrains)
+	{
+		Grain &grain = _grains[i];
+		const UInt32 frames = min(inNumberFrames - grain.delay, grain.length - grain.age);
+		mixGrain(grain, frames, outputCount, ioData);
+		
+		if(grain.age >= grain.length)
+		{
+			grain = _grains[--_activeGrains];
+		}
+		else
+		{
+			i++;
+		}
+	}
+	
+	return noErr;
+}
@@ -248,6 +248,8 @@ OSStatus ofxAudioUnitInput::renderCallback(void *inRefCon,
 										   AudioBufferList *ioData)
 // ----------------------------------------------------------
 {
+	OFXAU_REALTIME_SCOPE();
+	ofxAudioUnitDenormalGuard denormalGuard;
 	RenderContext * ctx = reinterpret_cast<RenderContext *>(inRefCon);
 	
 	OSStatus s = AudioUnitRender(*(ctx->inputUnit),
@@ -273,6 +275,8 @@ OSStatus ofxAudioUnitInput::pullCallback(void *inRefCon,
 										 AudioBufferList *ioData)
 // ----------------------------------------------------------
 {
+	OFXAU_REALTIME_SCOPE();
+	ofxAudioUnitDenormalGuard denormalGuard;
 	RenderContext * ctx = reinterpret_cast<RenderContext *>(inRefCon);
 	
 	// If we can't advance the read head, render silence.
@@ -0,0 +1,220 @@
+#include "ofxAudioUnit.h"
+#include "ofxAudioUnitThreadPool.h"
+#include <libkern/OSAtomic.h>
+#include <unistd.h>
+
+// how often wait() checks whether the loader has finished
+static const useconds_t kWaitIntervalMicroseconds = 1000;
+
+// ----------------------------------------------------------
+ofxAudioUnitLoader::ofxAudioUnitLoader()
+: _completion(NULL)
+, _completionContext(NULL)
+, _itemsRemaining(0)
+, _finished(false)
+, _started(false)
+// ----------------------------------------------------------
+{
+
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitLoader::~ofxAudioUnitLoader()
+// ----------------------------------------------------------
+{
+	// the pool's jobs point into _items, so they have to have run first
+	wait();
+}
+
+#pragma mark - Items
+
+// ----------------------------------------------------------
+void ofxAudioUnitLoader::add(ofxAudioUnitFilePlayer &player, const std::string &filePath)
+// ----------------------------------------------------------
+{
+	addItem(kTargetFilePlayer, &player, std::vector<std::string>(1, filePath));
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitLoader::add(ofxAudioUnitStreamingFilePlayer &player, const std::string &filePath)
+// ----------------------------------------------------------
+{
+	addItem(kTargetStreamingPlayer, &player, std::vector<std::string>(1, filePath));
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitLoader::add(ofxAudioUnitSamplePlayer &player, const std::string &filePath)
+// ----------------------------------------------------------
+{
+	addItem(kTargetSamplePlayer, &player, std::vector<std::string>(1, filePath));
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitLoader::add(ofxAudioUnitSampler &sampler, const std::vector<std::string> &samplePaths)
+// ----------------------------------------------------------
+{
+	addItem(kTargetSampler, &sampler, samplePaths);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitLoader::add(const std::string &filePath, Float64 sampleRate)
+// ----------------------------------------------------------
+{
+	addItem(kTargetCache, NULL, std::vector<std::string>(1, filePath), sampleRate);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitLoader::addItem(Target target, void * player, const std::vector<std::string> &filePaths, Float64 sampleRate)
+// ----------------------------------------------------------
+{
+	if(_started && !isFinished())
+	{
+		cout << "ofxAudioUnitLoader can't add files while it's loading" << endl;
+		return;
+	}
+	
+	Item item;
+	item.loader     = this;
+	item.target     = target;
+	item.player     = player;
+	item.filePaths  = filePaths;
+	item.sampleRate = sampleRate;
+	item.loaded     = false;
+	_items.push_back(item);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitLoader::clear()
+// ----------------------------------------------------------
+{
+	wait();
+	_items.clear();
+	_started = false;
+}
+
+#pragma mark - Loading
+
+// ----------------------------------------------------------
+void ofxAudioUnitLoader::start(CompletionProc completion, void * context)
+// ----------------------------------------------------------
+{
+	if(_started && !isFinished())
+	{
+		cout << "ofxAudioUnitLoader is already loading" << endl;
+		return;
+	}
+	
+	_completion        = completion;
+	_completionContext = context;
+	_started           = true;
+	
+	for(int i = 0; i < _items.size(); i++) _items[i].loaded = false;
+	_itemsRemaining = _items.size();
+	_finished = false;
+	OSMemoryBarrier();
+	
+	if(_items.empty())
+	{
+		finish();
+		return;
+	}
+	
+	ofxAudioUnitThreadPool &pool = ofxAudioUnitThreadPool::shared();
+	for(int i = 0; i < _items.size(); i++)
+	{
+		pool.addJob(loadItem, &_items[i]);
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitLoader::loadItem(void * context)
+// ----------------------------------------------------------
+{
+	Item * item = (Item *)context;
+	
+	switch(item->target)
+	{
+		case kTargetFilePlayer:
+			item->loaded = ((ofxAudioUnitFilePlayer *)item->player)->setFile(item->filePaths[0]);
+			break;
+		
+		case kTargetStreamingPlayer:
+			item->loaded = ((ofxAudioUnitStreamingFilePlayer *)item->player)->setFile(item->filePaths[0]);
+			break;
+		
+		case kTargetSamplePlayer:
+			item->loaded = ((ofxAudioUnitSamplePlayer *)item->player)->setFile(item->filePaths[0]);
+			break;
+		
+		case kTargetSampler:
+			item->loaded = ((ofxAudioUnitSampler *)item->player)->setSamples(item->filePaths);
+			break;
+		
+		case kTargetCache:
+			item->loaded = ofxAudioUnitSampleCache::shared().load(item->filePaths[0], item->sampleRate).get() != NULL;
+			break;
+	}
+	
+	// the last item to finish reports for the whole loader
+	if(OSAtomicDecrement32Barrier(&item->loader->_itemsRemaining) == 0)
+	{
+		item->loader->finish();
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitLoader::finish()
+// ----------------------------------------------------------
+{
+	if(_completion) _completion(*this, _completionContext);
+	
+	// only once the callback has returned, since the loader may be
+	// destroyed as soon as it's finished
+	OSMemoryBarrier();
+	_finished = true;
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitLoader::isFinished() const
+// ----------------------------------------------------------
+{
+	OSMemoryBarrier();
+	return _started && _finished;
+}
+
+// ----------------------------------------------------------
+float ofxAudioUnitLoader::getProgress() const
+// ----------------------------------------------------------
+{
+	if(!_started) return 0;
+	if(_items.empty()) return 1;
+	
+	OSMemoryBarrier();
+	return (float)(_items.size() - _itemsRemaining) / _items.size();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitLoader::wait()
+// ----------------------------------------------------------
+{
+	while(_started && !isFinished()) usleep(kWaitIntervalMicroseconds);
+}
+
+// ----------------------------------------------------------
+std::vector<std::string> ofxAudioUnitLoader::getFailedFiles() const
+// ----------------------------------------------------------
+{
+	std::vector<std::string> failed;
+	OSMemoryBarrier();
+	if(!_started || _itemsRemaining > 0) return failed;
+	
+	for(int i = 0; i < _items.size(); i++)
+	{
+		if(!_items[i].loaded && !_items[i].filePaths.empty())
+		{
+			failed.push_back(_items[i].filePaths[0]);
+		}
+	}
+	
+	return failed;
+}
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <libkern/OSAtomic.h>
+#include <vector>
+#include <algorithm>
+#include <string.h>
+
+// ofxAudioUnitLockFreeFifo is a fixed-capacity, single-producer /
+// single-consumer queue for handing data to or from a render thread.
+// Neither side ever blocks or allocates: push() fails if the queue is
+// full, and pop() fails if it's empty.
+
+// Exactly one thread may push and exactly one thread may pop at any
+// given time. If several threads need to push, serialize them with a
+// mutex on the producer side (that side usually isn't the render thread).
+
+// setCapacity() allocates, so call it before either side starts using
+// the queue.
+
+template <typename T>
+class ofxAudioUnitLockFreeFifo
+{
+	std::vector<T>   _items;
+	volatile int32_t _readIndex;
+	volatile int32_t _writeIndex;
+	
+	ofxAudioUnitLockFreeFifo(const ofxAudioUnitLockFreeFifo &orig);
+	ofxAudioUnitLockFreeFifo& operator=(const ofxAudioUnitLockFreeFifo &orig);
+
+public:
+	ofxAudioUnitLockFreeFifo(unsigned int capacity = 0)
+	: _readIndex(0), _writeIndex(0)
+	{
+		setCapacity(capacity);
+	}
+	
+	void setCapacity(unsigned int capacity)
+	{
+		// one slot is always left empty to tell "full" from "empty"
+		_items.assign(capacity + 1, T());
+		_readIndex = _writeIndex = 0;
+		OSMemoryBarrier();
+	}
+	
+	unsigned int getCapacity() const {return _items.size() - 1;}
+	
+	bool push(const T &item)
+	{
+		const int32_t writeIndex = _writeIndex;
+		const int32_t nextIndex  = (writeIndex + 1) % _items.size();
+		if(nextIndex == _readIndex) return false;
+		
+		_items[writeIndex] = item;
+		
+		// the item must be visible before the consumer can see the new index
+		OSMemoryBarrier();
+		_writeIndex = nextIndex;
+		return true;
+	}
+	
+	// pushes all of items or, if there isn't room for them all, none.
+	// They're published together, so the consumer sees the whole batch
+	// at once
+	bool push(const T * items, unsigned int count)
+	{
+		const int32_t size = _items.size();
+		const int32_t writeIndex = _writeIndex;
+		const int32_t free = (_readIndex - writeIndex - 1 + size) % size;
+		if(count > free) return false;
+		
+		for(unsigned int i = 0; i < count; i++)
+		{
+			_items[(writeIndex + i) % size] = items[i];
+		}
+		
+		OSMemoryBarrier();
+		_writeIndex = (writeIndex + count) % size;
+		return true;
+	}
+	
+	bool pop(T &item)
+	{
+		const int32_t readIndex = _readIndex;
+		if(readIndex == _writeIndex) return false;
+		
+		OSMemoryBarrier();
+		item = _items[readIndex];
+		
+		// the slot must be read before the producer can reuse it
+		OSMemoryBarrier();
+		_readIndex = (readIndex + 1) % _items.size();
+		return true;
+	}
+	
+	unsigned int getCount() const
+	{
+		const int32_t size = _items.size();
+		return (_writeIndex - _readIndex + size) % size;
+	}
+	
+	bool isEmpty() const {return _readIndex == _writeIndex;}
+};
+
+// ofxAudioUnitSampleRing is a single-producer / single-consumer ring of
+// non-interleaved float samples, for streaming audio between a worker
+// thread and a render thread. Like the fifo above, neither side blocks
+// or allocates, and allocate() / reset() may only be called while
+// neither side is using the ring.
+
+class ofxAudioUnitSampleRing
+{
+	std::vector<float> _samples;
+	unsigned int _channels;
+	unsigned int _capacity;
+	
+	// free-running frame counters. Their difference is the number of
+	// readable frames, which stays correct across integer wrap-around
+	// (the capacity is rounded up to a power of two so that positions in
+	// the ring stay continuous when the counters wrap)
+	volatile uint32_t _readFrame;
+	volatile uint32_t _writeFrame;
+	
+	ofxAudioUnitSampleRing(const ofxAudioUnitSampleRing &orig);
+	ofxAudioUnitSampleRing& operator=(const ofxAudioUnitSampleRing &orig);
+
+public:
+	ofxAudioUnitSampleRing() : _channels(0), _capacity(0), _readFrame(0), _writeFrame(0) {}
+	
+	void allocate(unsigned int channels, unsigned int capacityInFrames)
+	{
+		_channels = channels;
+		_capacity = 1;
+		while(_capacity < capacityInFrames) _capacity <<= 1;
+		_samples.assign(channels * _capacity, 0);
+		reset();
+	}
+	
+	void reset()
+	{
+		_readFrame = _writeFrame = 0;
+		OSMemoryBarrier();
+	}
+	
+	unsigned int getChannels() const {return _channels;}
+	unsigned int getCapacity() const {return _capacity;}
+	
+	unsigned int getReadableFrames() const {return _writeFrame - _readFrame;}
+	
+	// how many frames have gone through either side since the last reset
+	// (wrapping round at 2^32)
+	uint32_t getFramesWritten() const {return _writeFrame;}
+	uint32_t getFramesRead()    const {return _readFrame;}
+	unsigned int getWritableFrames() const {return _capacity - getReadableFrames();}
+	
+	// producer side
+	unsigned int write(const float * const * channels, unsigned int frames)
+	{
+		frames = std::min(frames, getWritableFrames());
+		const uint32_t writeFrame = _writeFrame;
+		const unsigned int start = writeFrame & (_capacity - 1);
+		const unsigned int first = std::min(frames, _capacity - start);
+		
+		for(unsigned int c = 0; c < _channels; c++)
+		{
+			float * ring = &_samples[c * _capacity];
+			memcpy(ring + start, channels[c], first * sizeof(float));
+			memcpy(ring, channels[c] + first, (frames - first) * sizeof(float));
+		}
+		
+		OSMemoryBarrier();
+		_writeFrame = writeFrame + frames;
+		return frames;
+	}
+	
+	// consumer side. read() with NULL channels just skips frames
+	unsigned int read(float * const * channels, unsigned int frames)
+	{
+		frames = std::min(frames, getReadableFrames());
+		const uint32_t readFrame = _readFrame;
+		const unsigned int start = readFrame & (_capacity - 1);
+		const unsigned int first = std::min(frames, _capacity - start);
+		OSMemoryBarrier();
+		
+		for(unsigned int c = 0; channels && c < _channels; c++)
+		{
+			const float * ring = &_samples[c * _capacity];
+			memcpy(channels[c], ring + start, first * sizeof(float));
+			memcpy(channels[c] + first, ring, (frames - first) * sizeof(float));
+		}
+		
+		OSMemoryBarrier();
+		_readFrame = readFrame + frames;
+		return frames;
+	}
+};
@@ -0,0 +1,320 @@
+#include "ofxAudioUnit.h"
+#include <Accelerate/Accelerate.h>
+#include <libkern/OSAtomic.h>
+
+// number of old matrices the render thread can hand back before they're
+// released. If it fills up, new matrices wait until the next change.
+static const unsigned int kMaxRetiredMatrices = 16;
+
+// ----------------------------------------------------------
+ofxAudioUnitMatrixMixer::ofxAudioUnitMatrixMixer(unsigned int inputBusses,
+												 unsigned int outputChannels,
+												 unsigned int channelsPerInput)
+: ofxAudioUnitNativeNode(outputChannels)
+, _pendingMatrix(NULL)
+, _retiredMatrices(kMaxRetiredMatrices)
+, _channelsPerInput(channelsPerInput)
+, _inputSamples(NULL)
+// ----------------------------------------------------------
+{
+	_matrix = new Matrix;
+	_matrix->rowStarts.assign(outputChannels + 1, 0);
+	
+	setInputBusCount(inputBusses);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitMatrixMixer::~ofxAudioUnitMatrixMixer()
+// ----------------------------------------------------------
+{
+	detachNode();
+	
+	OFXAU_REALTIME_LOCK(_renderMutex);
+	{
+		releaseRetiredMatrices();
+		delete _pendingMatrix;
+		delete _matrix;
+		_pendingMatrix = NULL;
+		_matrix = NULL;
+		
+		releaseInputBuffers();
+	}
+	_renderMutex.unlock();
+}
+
+#pragma mark - Channels
+
+// ----------------------------------------------------------
+bool ofxAudioUnitMatrixMixer::setInputBusCount(unsigned int numberOfInputBusses)
+// ----------------------------------------------------------
+{
+	// every input channel gets a kMaxFramesPerSlice-long buffer, all of
+	// which live in one contiguous block
+	AudioUnitSampleType * inputSamples = (AudioUnitSampleType *)calloc(numberOfInputBusses * _channelsPerInput * kMaxFramesPerSlice,
+																	   sizeof(AudioUnitSampleType));
+	if(numberOfInputBusses > 0 && !inputSamples)
+	{
+		cout << "Couldn't allocate buffers for " << numberOfInputBusses
+		<< " matrix mixer inputs" << endl;
+		return false;
+	}
+	
+	std::vector<AudioBufferList *> inputBuffers(numberOfInputBusses);
+	for(int i = 0; i < numberOfInputBusses; i++)
+	{
+		size_t listSize = offsetof(AudioBufferList, mBuffers[0]) + _channelsPerInput * sizeof(AudioBuffer);
+		inputBuffers[i] = (AudioBufferList *)malloc(listSize);
+		inputBuffers[i]->mNumberBuffers = _channelsPerInput;
+	}
+	
+	std::vector<char> inputRendered(numberOfInputBusses, false);
+	
+	OFXAU_REALTIME_LOCK(_crosspointMutex);
+	{
+		// crosspoints on inputs that are going away go with them
+		const unsigned int inputChannels = numberOfInputBusses * _channelsPerInput;
+		std::map<CrosspointKey, float>::iterator it = _crosspoints.begin();
+		while(it != _crosspoints.end())
+		{
+			if(it->first.second >= inputChannels) _crosspoints.erase(it++);
+			else ++it;
+		}
+		
+		// the render thread only looks at inputs its matrix routes, and
+		// its matrix doesn't route any past the end of the old buffers
+		resizeInputs(numberOfInputBusses);
+		
+		OFXAU_REALTIME_LOCK(_renderMutex);
+		{
+			releaseInputBuffers();
+			_inputSamples = inputSamples;
+			_inputBuffers.swap(inputBuffers);
+			_inputRendered.swap(inputRendered);
+			
+			// The matrix has to match the new inputs before the render
+			// thread runs again, rather than whenever it gets round to
+			// picking it up, so it's swapped in here
+			publishMatrix();
+			delete _matrix;
+			_matrix = _pendingMatrix;
+			_pendingMatrix = NULL;
+		}
+		_renderMutex.unlock();
+	}
+	_crosspointMutex.unlock();
+	
+	return true;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitMatrixMixer::releaseInputBuffers()
+// ----------------------------------------------------------
+{
+	for(int i = 0; i < _inputBuffers.size(); i++) free(_inputBuffers[i]);
+	_inputBuffers.clear();
+	
+	free(_inputSamples);
+	_inputSamples = NULL;
+}
+
+// ----------------------------------------------------------
+unsigned int ofxAudioUnitMatrixMixer::getInputBusCount() const
+// ----------------------------------------------------------
+{
+	return _inputs.size();
+}
+
+// ----------------------------------------------------------
+unsigned int ofxAudioUnitMatrixMixer::getInputChannelCount() const
+// ----------------------------------------------------------
+{
+	return _inputs.size() * _channelsPerInput;
+}
+
+// ----------------------------------------------------------
+unsigned int ofxAudioUnitMatrixMixer::getOutputChannelCount() const
+// ----------------------------------------------------------
+{
+	return _outputChannels;
+}
+
+#pragma mark - Crosspoints
+
+// ----------------------------------------------------------
+void ofxAudioUnitMatrixMixer::setCrosspointGain(float gain, unsigned int inputChannel, unsigned int outputChannel)
+// ----------------------------------------------------------
+{
+	if(inputChannel >= getInputChannelCount() || outputChannel >= _outputChannels)
+	{
+		cout << "Matrix mixer doesn't have a crosspoint at input " << inputChannel
+		<< ", output " << outputChannel << endl;
+		return;
+	}
+	
+	OFXAU_REALTIME_LOCK(_crosspointMutex);
+	{
+		CrosspointKey key(outputChannel, inputChannel);
+		if(gain == 0) _crosspoints.erase(key);
+		else          _crosspoints[key] = gain;
+		
+		publishMatrix();
+	}
+	_crosspointMutex.unlock();
+}
+
+// ----------------------------------------------------------
+float ofxAudioUnitMatrixMixer::getCrosspointGain(unsigned int inputChannel, unsigned int outputChannel)
+// ----------------------------------------------------------
+{
+	float gain = 0;
+	
+	OFXAU_REALTIME_LOCK(_crosspointMutex);
+	{
+		std::map<CrosspointKey, float>::const_iterator it;
+		it = _crosspoints.find(CrosspointKey(outputChannel, inputChannel));
+		if(it != _crosspoints.end()) gain = it->second;
+	}
+	_crosspointMutex.unlock();
+	
+	return gain;
+}
+
+// ----------------------------------------------------------
+unsigned int ofxAudioUnitMatrixMixer::getCrosspointCount()
+// ----------------------------------------------------------
+{
+	OFXAU_REALTIME_LOCK(_crosspointMutex);
+	unsigned int count = _crosspoints.size();
+	_crosspointMutex.unlock();
+	return count;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitMatrixMixer::clearCrosspoints()
+// ----------------------------------------------------------
+{
+	OFXAU_REALTIME_LOCK(_crosspointMutex);
+	_crosspoints.clear();
+	publishMatrix();
+	_crosspointMutex.unlock();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitMatrixMixer::publishMatrix()
+// ----------------------------------------------------------
+{
+	releaseRetiredMatrices();
+	
+	// the crosspoints are keyed by (output, input), so walking the map
+	// gives them in row order
+	Matrix * matrix = new Matrix;
+	matrix->rowStarts.assign(_outputChannels + 1, 0);
+	matrix->inputs.reserve(_crosspoints.size());
+	matrix->gains.reserve(_crosspoints.size());
+	
+	std::vector<char> busUsed(_inputs.size(), false);
+	
+	std::map<CrosspointKey, float>::const_iterator it;
+	for(it = _crosspoints.begin(); it != _crosspoints.end(); ++it)
+	{
+		const unsigned int output = it->first.first;
+		const unsigned int input  = it->first.second;
+		
+		matrix->rowStarts[output + 1]++;
+		matrix->inputs.push_back(input);
+		matrix->gains.push_back(it->second);
+		busUsed[input / _channelsPerInput] = true;
+	}
+	
+	for(int i = 0; i < _outputChannels; i++)
+		matrix->rowStarts[i + 1] += matrix->rowStarts[i];
+	
+	for(int i = 0; i < busUsed.size(); i++)
+		if(busUsed[i]) matrix->usedBusses.push_back(i);
+	
+	// replacing whatever the render thread hasn't picked up yet
+	Matrix * unclaimed;
+	do
+	{
+		unclaimed = _pendingMatrix;
+	}
+	while(!OSAtomicCompareAndSwapPtrBarrier(unclaimed, matrix, (void * volatile *)&_pendingMatrix));
+	
+	delete unclaimed;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitMatrixMixer::releaseRetiredMatrices()
+// ----------------------------------------------------------
+{
+	Matrix * retired;
+	while(_retiredMatrices.pop(retired)) delete retired;
+}
+
+#pragma mark - Rendering
+
+// ----------------------------------------------------------
+OSStatus ofxAudioUnitMatrixMixer::renderNode(AudioUnitRenderActionFlags *ioActionFlags,
+											 const AudioTimeStamp *inTimeStamp,
+											 UInt32 inNumberFrames,
+											 AudioBufferList *ioData)
+// ----------------------------------------------------------
+{
+	// picking up a new matrix if there is one. The old one is handed back
+	// to be deleted off the render thread, so a new matrix is only taken
+	// if there's room to hand the old one back
+	Matrix * pending = _pendingMatrix;
+	if(pending && _retiredMatrices.getCount() < _retiredMatrices.getCapacity() &&
+	   OSAtomicCompareAndSwapPtrBarrier(pending, NULL, (void * volatile *)&_pendingMatrix))
+	{
+		_retiredMatrices.push(_matrix);
+		_matrix = pending;
+	}
+	
+	const Matrix &matrix = *_matrix;
+	const UInt32 channelBytes = inNumberFrames * sizeof(AudioUnitSampleType);
+	
+	// pulling only the busses that are routed somewhere
+	for(int i = 0; i < matrix.usedBusses.size(); i++)
+	{
+		const unsigned int bus = matrix.usedBusses[i];
+		_inputRendered[bus] = false;
+		if(!isInputConnected(bus)) continue;
+		
+		AudioBufferList * inputBuffer = _inputBuffers[bus];
+		for(int c = 0; c < _channelsPerInput; c++)
+		{
+			inputBuffer->mBuffers[c].mNumberChannels = 1;
+			inputBuffer->mBuffers[c].mData           = _inputSamples + (bus * _channelsPerInput + c) * kMaxFramesPerSlice;
+			inputBuffer->mBuffers[c].mDataByteSize   = channelBytes;
+		}
+		
+		AudioUnitRenderActionFlags busFlags = 0;
+		OSStatus s = pullInput(bus, &busFlags, inTimeStamp, inNumberFrames, inputBuffer);
+		_inputRendered[bus] = s == noErr && !(busFlags & kAudioUnitRenderAction_OutputIsSilence);
+	}
+	
+	// each output channel is one row of the matrix
+	bool anyCrosspointRendered = false;
+	const UInt32 outputCount = min((UInt32)ioData->mNumberBuffers, _outputChannels);
+	
+	for(int output = 0; output < outputCount; output++)
+	{
+		AudioUnitSampleType * out = (AudioUnitSampleType *)ioData->mBuffers[output].mData;
+		vDSP_vclr(out, 1, inNumberFrames);
+		
+		for(unsigned int i = matrix.rowStarts[output]; i < matrix.rowStarts[output + 1]; i++)
+		{
+			const unsigned int input = matrix.inputs[i];
+			if(!_inputRendered[input / _channelsPerInput]) continue;
+			
+			const AudioUnitSampleType * in = _inputSamples + input * kMaxFramesPerSlice;
+			vDSP_vsma(in, 1, &matrix.gains[i], out, 1, out, 1, inNumberFrames);
+			anyCrosspointRendered = true;
+		}
+	}
+	
+	if(!anyCrosspointRendered) *ioActionFlags |= kAudioUnitRenderAction_OutputIsSilence;
+	
+	return noErr;
+}
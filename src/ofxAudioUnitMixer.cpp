@@ -6,6 +6,39 @@ AudioComponentDescription mixerDesc = {
 	kAudioUnitManufacturer_Apple
 };
 
+// fade scheduler targets : the output volume, then a volume and a pan per input bus
+enum
+{
+	kOutputVolumeTarget = 0
+};
+
+static unsigned int volumeTarget(int bus){return 1 + bus * 2;}
+static unsigned int panTarget(int bus)   {return 2 + bus * 2;}
+
+// number of parameter events handed to the mixer per call while fading
+static const UInt32 kFadeEventBatchSize = 64;
+
+// The fade scheduler belongs to the unit rather than to the mixer object,
+// since copies of a mixer share its unit. The render notification that
+// runs the fades is added once, when the unit is created, and removed
+// when the last copy is gone.
+
+struct ofxAudioUnitMixer::Fades
+{
+	AudioUnitRef unit;
+	ofxAudioUnitFadeScheduler scheduler;
+	
+	Fades(AudioUnitRef fadesUnit, unsigned int targetCount);
+	~Fades();
+	
+	static OSStatus renderNotify(void *inRefCon,
+								 AudioUnitRenderActionFlags *ioActionFlags,
+								 const AudioTimeStamp *inTimeStamp,
+								 UInt32 inBusNumber,
+								 UInt32 inNumberFrames,
+								 AudioBufferList *ioData);
+};
+
 // ----------------------------------------------------------
 ofxAudioUnitMixer::ofxAudioUnitMixer()
 // ----------------------------------------------------------
@@ -13,15 +46,68 @@ ofxAudioUnitMixer::ofxAudioUnitMixer()
 	_desc = mixerDesc;
 	initUnit();
 	
+	int busses = getInputBusCount();
+	_fades = ofPtr<Fades>(new Fades(_unit, volumeTarget(busses)));
+	
 	// default volume is 0, which can make things seem like they aren't working
 	
-	int busses = getInputBusCount();
 	for(int i = 0; i < busses; i++)
 		setInputVolume(1, i);
 	
 	setOutputVolume(1);
 }
 
+// ----------------------------------------------------------
+ofxAudioUnitMixer::ofxAudioUnitMixer(const ofxAudioUnitMixer &orig)
+: _ballistics(orig._ballistics)
+, _fades(orig._fades)
+// ----------------------------------------------------------
+{
+	_desc = orig._desc;
+	_unit = orig._unit;
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitMixer& ofxAudioUnitMixer::operator=(const ofxAudioUnitMixer &orig)
+// ----------------------------------------------------------
+{
+	if(this == &orig) return *this;
+	
+	_desc       = orig._desc;
+	_unit       = orig._unit;
+	_fades      = orig._fades;
+	_ballistics = orig._ballistics;
+	
+	return *this;
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitMixer::setInputBusCount(unsigned int numberOfInputBusses)
+// ----------------------------------------------------------
+{
+	bool success = ofxAudioUnit::setInputBusCount(numberOfInputBusses);
+	
+	const unsigned int previousBusCount = (_fades->scheduler.getTargetCount() - 1) / 2;
+	const unsigned int busCount = getInputBusCount();
+	_fades->scheduler.setTargetCount(volumeTarget(busCount));
+	
+	// new busses' ramps start from wherever the unit has put them
+	for(int i = previousBusCount; i < busCount; i++)
+	{
+		AudioUnitParameterValue volume = 1;
+		AudioUnitGetParameter(*_unit, kMultiChannelMixerParam_Volume, kAudioUnitScope_Input, i, &volume);
+		_fades->scheduler.setValue(volumeTarget(i), volume);
+
+#ifdef __MAC_10_7
+		AudioUnitParameterValue pan = 0;
+		AudioUnitGetParameter(*_unit, kMultiChannelMixerParam_Pan, kAudioUnitScope_Input, i, &pan);
+		_fades->scheduler.setValue(panTarget(i), pan);
+#endif
+	}
+	
+	return success;
+}
+
 #pragma mark - Volume / Pan
 
 // ----------------------------------------------------------
@@ -35,6 +121,7 @@ void ofxAudioUnitMixer::setInputVolume(float volume, int bus)
 									  volume,
 									  0),
 				"setting mixer input gain");
+	_fades->scheduler.setValue(volumeTarget(bus), volume);
 }
 
 // ----------------------------------------------------------
@@ -48,6 +135,7 @@ void ofxAudioUnitMixer::setOutputVolume(float volume)
 									  volume,
 									  0),
 				"setting mixer output gain");
+	_fades->scheduler.setValue(kOutputVolumeTarget, volume);
 }
 
 // ----------------------------------------------------------
@@ -70,9 +158,139 @@ void ofxAudioUnitMixer::setPan(float pan, int bus)
 									  pan,
 									  0),
 				"setting mixer pan");
+	_fades->scheduler.setValue(panTarget(bus), pan);
 #endif
 }
 
+#pragma mark - Ramps
+
+// ----------------------------------------------------------
+void ofxAudioUnitMixer::rampInputVolume(float volume, UInt32 durationInSamples, int bus, ofxAudioUnitFadeCurve curve)
+// ----------------------------------------------------------
+{
+	if(!_fades->scheduler.fadeTo(volumeTarget(bus), volume, durationInSamples, curve))
+	{
+		cout << "Too many pending mixer ramps, setting input volume immediately" << endl;
+		setInputVolume(volume, bus);
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitMixer::rampOutputVolume(float volume, UInt32 durationInSamples, ofxAudioUnitFadeCurve curve)
+// ----------------------------------------------------------
+{
+	if(!_fades->scheduler.fadeTo(kOutputVolumeTarget, volume, durationInSamples, curve))
+	{
+		cout << "Too many pending mixer ramps, setting output volume immediately" << endl;
+		setOutputVolume(volume);
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitMixer::rampPan(float pan, UInt32 durationInSamples, int bus, ofxAudioUnitFadeCurve curve)
+// ----------------------------------------------------------
+{
+#ifndef __MAC_10_7
+	setPan(pan, bus);
+#else
+	if(!_fades->scheduler.fadeTo(panTarget(bus), pan, durationInSamples, curve))
+	{
+		cout << "Too many pending mixer ramps, setting pan immediately" << endl;
+		setPan(pan, bus);
+	}
+#endif
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitMixer::Fades::Fades(AudioUnitRef fadesUnit, unsigned int targetCount)
+: unit(fadesUnit)
+, scheduler(targetCount)
+// ----------------------------------------------------------
+{
+	if(!unit) return;
+	
+	OFXAU_PRINT(AudioUnitAddRenderNotify(*unit, renderNotify, this),
+				"adding mixer fade notification");
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitMixer::Fades::~Fades()
+// ----------------------------------------------------------
+{
+	if(unit) AudioUnitRemoveRenderNotify(*unit, renderNotify, this);
+}
+
+// ----------------------------------------------------------
+OSStatus ofxAudioUnitMixer::Fades::renderNotify(void *inRefCon,
+												AudioUnitRenderActionFlags *ioActionFlags,
+												const AudioTimeStamp *inTimeStamp,
+												UInt32 inBusNumber,
+												UInt32 inNumberFrames,
+												AudioBufferList *ioData)
+// ----------------------------------------------------------
+{
+	if(!(*ioActionFlags & kAudioUnitRenderAction_PreRender)) return noErr;
+	
+	OFXAU_REALTIME_SCOPE();
+	
+	Fades * owner = static_cast<Fades *>(inRefCon);
+	ofxAudioUnitFadeScheduler &fades = owner->scheduler;
+	
+	if(!fades.beginBuffer(inNumberFrames)) return noErr;
+	
+	// every fade that moved this buffer becomes a ramp across the buffer
+	AudioUnitParameterEvent events[kFadeEventBatchSize];
+	UInt32 eventCount = 0;
+	
+	for(int i = 0; i < fades.getSegmentCount(); i++)
+	{
+		const ofxAudioUnitFadeScheduler::Segment &segment = fades.getSegment(i);
+		AudioUnitParameterEvent &event = events[eventCount];
+		
+		if(segment.target == kOutputVolumeTarget)
+		{
+			event.scope     = kAudioUnitScope_Output;
+			event.element   = 0;
+			event.parameter = kMultiChannelMixerParam_Volume;
+		}
+		else
+		{
+			event.scope     = kAudioUnitScope_Input;
+			event.element   = (segment.target - 1) / 2;
+#ifdef __MAC_10_7
+			event.parameter = segment.target == volumeTarget(event.element) ? kMultiChannelMixerParam_Volume : kMultiChannelMixerParam_Pan;
+#else
+			event.parameter = kMultiChannelMixerParam_Volume;
+#endif
+		}
+		
+		if(segment.startValue == segment.endValue)
+		{
+			event.eventType = kParameterEvent_Immediate;
+			event.eventValues.immediate.bufferOffset = 0;
+			event.eventValues.immediate.value        = segment.endValue;
+		}
+		else
+		{
+			event.eventType = kParameterEvent_Ramped;
+			event.eventValues.ramp.startBufferOffset = 0;
+			event.eventValues.ramp.durationInFrames  = inNumberFrames;
+			event.eventValues.ramp.startValue        = segment.startValue;
+			event.eventValues.ramp.endValue          = segment.endValue;
+		}
+		
+		if(++eventCount == kFadeEventBatchSize || i == fades.getSegmentCount() - 1)
+		{
+			AudioUnitScheduleParameters(*owner->unit, events, eventCount);
+			eventCount = 0;
+		}
+	}
+	
+	fades.endBuffer();
+	
+	return noErr;
+}
+
 #pragma mark - Metering
 
 // ----------------------------------------------------------
@@ -154,3 +372,64 @@ void ofxAudioUnitMixer::disableOutputMetering()
 						 &off,
 						 sizeof(off));
 }
+
+// ----------------------------------------------------------
+void ofxAudioUnitMixer::enableAllMetering()
+// ----------------------------------------------------------
+{
+	int busses = getInputBusCount();
+	for(int i = 0; i < busses; i++)
+		enableInputMetering(i);
+	
+	enableOutputMetering();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitMixer::disableAllMetering()
+// ----------------------------------------------------------
+{
+	int busses = getInputBusCount();
+	for(int i = 0; i < busses; i++)
+		disableInputMetering(i);
+	
+	disableOutputMetering();
+}
+
+// ----------------------------------------------------------
+unsigned int ofxAudioUnitMixer::getInputLevels(float * levels, unsigned int busCount)
+// ----------------------------------------------------------
+{
+	// busses the mixer doesn't have (or isn't metering) read as silent
+	// rather than printing an error for each one
+	for(int i = 0; i < busCount; i++)
+	{
+		if(AudioUnitGetParameter(*_unit,
+								 kMultiChannelMixerParam_PreAveragePower,
+								 kAudioUnitScope_Input,
+								 i,
+								 &levels[i * 2]) != noErr)
+		{
+			levels[i * 2] = -120;
+		}
+		
+		if(AudioUnitGetParameter(*_unit,
+								 kMultiChannelMixerParam_PrePeakHoldLevel,
+								 kAudioUnitScope_Input,
+								 i,
+								 &levels[i * 2 + 1]) != noErr)
+		{
+			levels[i * 2 + 1] = -120;
+		}
+	}
+	
+	// the unit already holds its peaks, so they're only decayed here
+	_ballistics.process(levels, busCount, true);
+	return busCount;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitMixer::setPeakHold(float holdSeconds, float decayDecibelsPerSecond)
+// ----------------------------------------------------------
+{
+	_ballistics.setPeakHold(holdSeconds, decayDecibelsPerSecond);
+}
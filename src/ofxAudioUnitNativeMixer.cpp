@@ -0,0 +1,830 @@
+#include "ofxAudioUnit.h"
+#include <Accelerate/Accelerate.h>
+
+// Number of frames accumulated per pass over the input busses. 256 stereo
+// frames of output (2kB) stays comfortably in L1 while every bus's
+// corresponding block is streamed through it.
+static const UInt32 kAccumulateBlockFrames = 256;
+
+static const float kMinimumLevel = -120;
+
+// fade scheduler targets : the output volume, then a volume and a pan per input bus
+enum
+{
+	kOutputVolumeTarget = 0
+};
+
+static unsigned int volumeTarget(int bus){return 1 + bus * 2;}
+static unsigned int panTarget(int bus)   {return 2 + bus * 2;}
+
+static void measureLevels(const AudioBufferList * bufferList,
+						  UInt32 frames,
+						  float &outAveragePower,
+						  float &outPeakLevel);
+
+// ----------------------------------------------------------
+ofxAudioUnitNativeMixer::ofxAudioUnitNativeMixer(unsigned int inputBusses)
+: ofxAudioUnitNativeNode(2)
+, _busSamples(NULL)
+, _outputVolume(1)
+, _outputMetering(false)
+, _outputAveragePower(kMinimumLevel)
+, _outputPeakLevel(kMinimumLevel)
+// ----------------------------------------------------------
+{
+	setInputBusCount(inputBusses);
+	_fades.setValue(kOutputVolumeTarget, 1);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitNativeMixer::~ofxAudioUnitNativeMixer()
+// ----------------------------------------------------------
+{
+	detachNode();
+	
+	OFXAU_REALTIME_LOCK(_renderMutex);
+	releaseBusBuffers();
+	for(int i = 0; i < _groups.size(); i++) disconnectGroupInserts(*_groups[i]);
+	_renderMutex.unlock();
+}
+
+#pragma mark - Busses
+
+// ----------------------------------------------------------
+bool ofxAudioUnitNativeMixer::setInputBusCount(unsigned int numberOfInputBusses)
+// ----------------------------------------------------------
+{
+	resizeInputs(numberOfInputBusses);
+	
+	const unsigned int previousBusCount = _busses.size();
+	_fades.setTargetCount(volumeTarget(numberOfInputBusses));
+	for(int i = previousBusCount; i < numberOfInputBusses; i++)
+		_fades.setValue(volumeTarget(i), 1);
+	
+	BusState defaultState;
+	defaultState.volume       = 1;
+	defaultState.pan          = 0;
+	defaultState.gain[0]      = 1;
+	defaultState.gain[1]      = 1;
+	defaultState.startGain[0] = 1;
+	defaultState.startGain[1] = 1;
+	defaultState.ramping      = false;
+	defaultState.metering     = false;
+	defaultState.rendered     = false;
+	defaultState.averagePower = kMinimumLevel;
+	defaultState.peakLevel    = kMinimumLevel;
+	defaultState.group        = -1;
+	defaultState.destination  = -1;
+	defaultState.destinationGain = 1;
+	
+	// every bus gets a stereo pair of kMaxFramesPerSlice-long buffers,
+	// all of which live in one contiguous block
+	const size_t busStride = 2 * kMaxFramesPerSlice;
+	AudioUnitSampleType * busSamples = (AudioUnitSampleType *)calloc(numberOfInputBusses * busStride,
+																	   sizeof(AudioUnitSampleType));
+	if(numberOfInputBusses > 0 && !busSamples)
+	{
+		cout << "Couldn't allocate buffers for " << numberOfInputBusses
+		<< " native mixer busses" << endl;
+		return false;
+	}
+	
+	std::vector<AudioBufferList *> busBuffers(numberOfInputBusses);
+	for(int i = 0; i < numberOfInputBusses; i++)
+	{
+		size_t listSize = offsetof(AudioBufferList, mBuffers[0]) + 2 * sizeof(AudioBuffer);
+		busBuffers[i] = (AudioBufferList *)malloc(listSize);
+		busBuffers[i]->mNumberBuffers = 2;
+		for(int c = 0; c < 2; c++)
+		{
+			busBuffers[i]->mBuffers[c].mNumberChannels = 1;
+			busBuffers[i]->mBuffers[c].mDataByteSize   = kMaxFramesPerSlice * sizeof(AudioUnitSampleType);
+			busBuffers[i]->mBuffers[c].mData           = busSamples + (i * busStride) + (c * kMaxFramesPerSlice);
+		}
+	}
+	
+	OFXAU_REALTIME_LOCK(_renderMutex);
+	{
+		releaseBusBuffers();
+		_busSamples = busSamples;
+		_busBuffers.swap(busBuffers);
+		_busses.resize(numberOfInputBusses, defaultState);
+	}
+	_renderMutex.unlock();
+	
+	return true;
+}
+
+// ----------------------------------------------------------
+unsigned int ofxAudioUnitNativeMixer::getInputBusCount() const
+// ----------------------------------------------------------
+{
+	return _busses.size();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitNativeMixer::releaseBusBuffers()
+// ----------------------------------------------------------
+{
+	for(int i = 0; i < _busBuffers.size(); i++) free(_busBuffers[i]);
+	_busBuffers.clear();
+	
+	free(_busSamples);
+	_busSamples = NULL;
+}
+
+#pragma mark - Volume / Pan
+
+// ----------------------------------------------------------
+void ofxAudioUnitNativeMixer::setInputVolume(float volume, int bus)
+// ----------------------------------------------------------
+{
+	rampInputVolume(volume, 0, bus);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitNativeMixer::setOutputVolume(float volume)
+// ----------------------------------------------------------
+{
+	rampOutputVolume(volume, 0);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitNativeMixer::setPan(float pan, int bus)
+// ----------------------------------------------------------
+{
+	rampPan(pan, 0, bus);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitNativeMixer::rampInputVolume(float volume, UInt32 durationInSamples, int bus, ofxAudioUnitFadeCurve curve)
+// ----------------------------------------------------------
+{
+	if(bus >= _busses.size()) return;
+	if(!_fades.fadeTo(volumeTarget(bus), volume, durationInSamples, curve))
+	{
+		cout << "Too many pending mixer ramps, setting input volume immediately" << endl;
+		setTargetValue(volumeTarget(bus), volume);
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitNativeMixer::rampOutputVolume(float volume, UInt32 durationInSamples, ofxAudioUnitFadeCurve curve)
+// ----------------------------------------------------------
+{
+	if(!_fades.fadeTo(kOutputVolumeTarget, volume, durationInSamples, curve))
+	{
+		cout << "Too many pending mixer ramps, setting output volume immediately" << endl;
+		setTargetValue(kOutputVolumeTarget, volume);
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitNativeMixer::rampPan(float pan, UInt32 durationInSamples, int bus, ofxAudioUnitFadeCurve curve)
+// ----------------------------------------------------------
+{
+	if(bus >= _busses.size()) return;
+	pan = max(-1.f, min(1.f, pan));
+	if(!_fades.fadeTo(panTarget(bus), pan, durationInSamples, curve))
+	{
+		cout << "Too many pending mixer ramps, setting pan immediately" << endl;
+		setTargetValue(panTarget(bus), pan);
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitNativeMixer::setTargetValue(unsigned int target, float value)
+// ----------------------------------------------------------
+{
+	// only for when the fade queue is full. Everywhere else, the render
+	// thread is the only one that writes the busses' volumes and pans
+	OFXAU_REALTIME_LOCK(_renderMutex);
+	{
+		_fades.setValue(target, value);
+		
+		if(target == kOutputVolumeTarget)
+		{
+			_outputVolume = value;
+		}
+		else
+		{
+			BusState &state = _busses[(target - 1) / 2];
+			if(target % 2) state.volume = value;
+			else           state.pan    = value;
+			updateBusGain(state);
+		}
+	}
+	_renderMutex.unlock();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitNativeMixer::updateBusGain(BusState &bus)
+// ----------------------------------------------------------
+{
+	// balance law : panning towards one side only attenuates the other
+	bus.gain[0] = bus.volume * min(1.f, 1.f - bus.pan);
+	bus.gain[1] = bus.volume * min(1.f, 1.f + bus.pan);
+}
+
+#pragma mark - Metering
+
+// ----------------------------------------------------------
+float ofxAudioUnitNativeMixer::getInputLevel(int bus)
+// ----------------------------------------------------------
+{
+	if(bus >= _busses.size()) return kMinimumLevel;
+	return _busses[bus].averagePower;
+}
+
+// ----------------------------------------------------------
+float ofxAudioUnitNativeMixer::getOutputLevel() const
+// ----------------------------------------------------------
+{
+	return _outputAveragePower;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitNativeMixer::enableInputMetering(int bus)
+// ----------------------------------------------------------
+{
+	if(bus < _busses.size()) _busses[bus].metering = true;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitNativeMixer::enableOutputMetering()
+// ----------------------------------------------------------
+{
+	_outputMetering = true;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitNativeMixer::disableInputMetering(int bus)
+// ----------------------------------------------------------
+{
+	if(bus >= _busses.size()) return;
+	_busses[bus].metering     = false;
+	_busses[bus].averagePower = kMinimumLevel;
+	_busses[bus].peakLevel    = kMinimumLevel;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitNativeMixer::disableOutputMetering()
+// ----------------------------------------------------------
+{
+	_outputMetering     = false;
+	_outputAveragePower = kMinimumLevel;
+	_outputPeakLevel    = kMinimumLevel;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitNativeMixer::enableAllMetering()
+// ----------------------------------------------------------
+{
+	for(int i = 0; i < _busses.size(); i++) _busses[i].metering = true;
+	_outputMetering = true;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitNativeMixer::disableAllMetering()
+// ----------------------------------------------------------
+{
+	for(int i = 0; i < _busses.size(); i++) disableInputMetering(i);
+	disableOutputMetering();
+}
+
+// ----------------------------------------------------------
+unsigned int ofxAudioUnitNativeMixer::getInputLevels(float * levels, unsigned int busCount)
+// ----------------------------------------------------------
+{
+	busCount = min(busCount, (unsigned int)_busses.size());
+	for(int i = 0; i < busCount; i++)
+	{
+		levels[i * 2]     = _busses[i].averagePower;
+		levels[i * 2 + 1] = _busses[i].peakLevel;
+	}
+	
+	_ballistics.process(levels, busCount);
+	return busCount;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitNativeMixer::setPeakHold(float holdSeconds, float decayDecibelsPerSecond)
+// ----------------------------------------------------------
+{
+	_ballistics.setPeakHold(holdSeconds, decayDecibelsPerSecond);
+}
+
+#pragma mark - Groups
+
+// ----------------------------------------------------------
+ofxAudioUnitNativeMixer::Group::Group()
+: parent(-1)
+, volume(1)
+, mixBuffer(NULL)
+, outputBuffer(NULL)
+, outputSamples(NULL)
+, memberDestination(-1)
+, memberGain(1)
+, outputDestination(-1)
+, outputGain(1)
+// ----------------------------------------------------------
+{
+
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitNativeMixer::Group::~Group()
+// ----------------------------------------------------------
+{
+	if(mixBuffer) releaseBufferList(mixBuffer);
+	free(outputBuffer);
+	free(outputSamples);
+}
+
+// ----------------------------------------------------------
+int ofxAudioUnitNativeMixer::addGroup(const std::string &name, int parentGroup)
+// ----------------------------------------------------------
+{
+	if(parentGroup >= (int)_groups.size())
+	{
+		cout << "Native mixer doesn't have a group " << parentGroup << endl;
+		return -1;
+	}
+	
+	ofPtr<Group> group(new Group);
+	group->name   = name;
+	group->parent = max(parentGroup, -1);
+	
+	// since a group's parent always comes before it, walking the groups
+	// in order visits parents before children
+	OFXAU_REALTIME_LOCK(_renderMutex);
+	_groups.push_back(group);
+	int index = _groups.size() - 1;
+	_renderMutex.unlock();
+	
+	return index;
+}
+
+// ----------------------------------------------------------
+int ofxAudioUnitNativeMixer::getGroupIndex(const std::string &name) const
+// ----------------------------------------------------------
+{
+	for(int i = 0; i < _groups.size(); i++)
+	{
+		if(_groups[i]->name == name) return i;
+	}
+	return -1;
+}
+
+// ----------------------------------------------------------
+unsigned int ofxAudioUnitNativeMixer::getGroupCount() const
+// ----------------------------------------------------------
+{
+	return _groups.size();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitNativeMixer::setGroup(int group, int bus)
+// ----------------------------------------------------------
+{
+	if(bus >= _busses.size() || group >= (int)_groups.size()) return;
+	_busses[bus].group = max(group, -1);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitNativeMixer::setGroupVolume(float volume, int group)
+// ----------------------------------------------------------
+{
+	if(group < 0 || group >= _groups.size()) return;
+	_groups[group]->volume = volume;
+}
+
+// ----------------------------------------------------------
+float ofxAudioUnitNativeMixer::getGroupVolume(int group) const
+// ----------------------------------------------------------
+{
+	if(group < 0 || group >= _groups.size()) return 0;
+	return _groups[group]->volume;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitNativeMixer::addGroupInsert(ofxAudioUnit &insert, int group)
+// ----------------------------------------------------------
+{
+	if(group < 0 || group >= _groups.size())
+	{
+		cout << "Native mixer doesn't have a group " << group << endl;
+		return;
+	}
+	
+	Group &g = *_groups[group];
+	AudioUnitRef unit = insert.getUnit();
+	
+	// the first insert gives the group its own submix buffer, plus
+	// somewhere to render the end of the insert chain into
+	if(!g.mixBuffer)
+	{
+		AudioBufferList * mixBuffer = allocBufferList(2, kMaxFramesPerSlice);
+		AudioUnitSampleType * outputSamples = (AudioUnitSampleType *)calloc(2 * kMaxFramesPerSlice,
+																			sizeof(AudioUnitSampleType));
+		AudioBufferList * outputBuffer = (AudioBufferList *)malloc(offsetof(AudioBufferList, mBuffers[0]) +
+																   2 * sizeof(AudioBuffer));
+		outputBuffer->mNumberBuffers = 2;
+		for(int c = 0; c < 2; c++)
+		{
+			outputBuffer->mBuffers[c].mNumberChannels = 1;
+			outputBuffer->mBuffers[c].mDataByteSize   = kMaxFramesPerSlice * sizeof(AudioUnitSampleType);
+			outputBuffer->mBuffers[c].mData           = outputSamples + c * kMaxFramesPerSlice;
+		}
+		
+		OFXAU_REALTIME_LOCK(_renderMutex);
+		g.mixBuffer     = mixBuffer;
+		g.outputBuffer  = outputBuffer;
+		g.outputSamples = outputSamples;
+		_renderMutex.unlock();
+	}
+	
+	// the chain is pulled from its last insert, the first insert pulls
+	// the group's submix and every other insert pulls the one before it
+	if(g.inserts.empty())
+	{
+		AURenderCallbackStruct callback;
+		callback.inputProc       = groupInputCallback;
+		callback.inputProcRefCon = &g;
+		OFXAU_PRINT(AudioUnitSetProperty(*unit,
+										 kAudioUnitProperty_SetRenderCallback,
+										 kAudioUnitScope_Input,
+										 0,
+										 &callback,
+										 sizeof(callback)),
+					"setting group insert's render callback");
+	}
+	else
+	{
+		AudioUnitConnection connection;
+		connection.sourceAudioUnit    = *g.inserts.back();
+		connection.sourceOutputNumber = 0;
+		connection.destInputNumber    = 0;
+		OFXAU_PRINT(AudioUnitSetProperty(*unit,
+										 kAudioUnitProperty_MakeConnection,
+										 kAudioUnitScope_Input,
+										 0,
+										 &connection,
+										 sizeof(connection)),
+					"connecting group inserts");
+	}
+	
+	OFXAU_REALTIME_LOCK(_renderMutex);
+	g.inserts.push_back(unit);
+	_renderMutex.unlock();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitNativeMixer::clearGroupInserts(int group)
+// ----------------------------------------------------------
+{
+	if(group < 0 || group >= _groups.size()) return;
+	
+	OFXAU_REALTIME_LOCK(_renderMutex);
+	disconnectGroupInserts(*_groups[group]);
+	_groups[group]->inserts.clear();
+	_renderMutex.unlock();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitNativeMixer::disconnectGroupInserts(Group &group)
+// ----------------------------------------------------------
+{
+	if(group.inserts.empty()) return;
+	
+	// inserts may outlive the mixer, so the first one mustn't be left
+	// calling back into this group
+	AURenderCallbackStruct callback;
+	callback.inputProc       = NULL;
+	callback.inputProcRefCon = NULL;
+	AudioUnitSetProperty(*group.inserts.front(),
+						 kAudioUnitProperty_SetRenderCallback,
+						 kAudioUnitScope_Input,
+						 0,
+						 &callback,
+						 sizeof(callback));
+	
+	for(int i = 1; i < group.inserts.size(); i++)
+	{
+		AudioUnitConnection connection;
+		connection.sourceAudioUnit    = NULL;
+		connection.sourceOutputNumber = 0;
+		connection.destInputNumber    = 0;
+		AudioUnitSetProperty(*group.inserts[i],
+							 kAudioUnitProperty_MakeConnection,
+							 kAudioUnitScope_Input,
+							 0,
+							 &connection,
+							 sizeof(connection));
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitNativeMixer::updateGroupRouting()
+// ----------------------------------------------------------
+{
+	// Groups without inserts pass their members straight through to
+	// wherever the group itself goes, so the VCA volumes along the way
+	// collapse into one gain. Groups with inserts collect their members
+	// in their own buffer, and apply their volume after the inserts.
+	for(int i = 0; i < _groups.size(); i++)
+	{
+		Group &group = *_groups[i];
+		
+		if(group.parent < 0)
+		{
+			group.outputDestination = -1;
+			group.outputGain        = group.volume;
+		}
+		else
+		{
+			const Group &parent = *_groups[group.parent];
+			group.outputDestination = parent.memberDestination;
+			group.outputGain        = group.volume * parent.memberGain;
+		}
+		
+		if(group.inserts.empty())
+		{
+			group.memberDestination = group.outputDestination;
+			group.memberGain        = group.outputGain;
+		}
+		else
+		{
+			group.memberDestination = i;
+			group.memberGain        = 1;
+		}
+	}
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitNativeMixer::renderGroupInserts(const AudioTimeStamp *inTimeStamp,
+												 UInt32 inNumberFrames,
+												 AudioUnitSampleType * out[2])
+// ----------------------------------------------------------
+{
+	bool anyGroupRendered = false;
+	
+	// children come after their parents, so going backwards means every
+	// group's submix is complete by the time its inserts are run
+	for(int i = _groups.size() - 1; i >= 0; i--)
+	{
+		Group &group = *_groups[i];
+		if(group.inserts.empty()) continue;
+		
+		AudioBufferList * output = group.outputBuffer;
+		for(int c = 0; c < 2; c++)
+		{
+			output->mBuffers[c].mData         = group.outputSamples + c * kMaxFramesPerSlice;
+			output->mBuffers[c].mDataByteSize = inNumberFrames * sizeof(AudioUnitSampleType);
+		}
+		
+		AudioUnitRenderActionFlags flags = 0;
+		OSStatus s = AudioUnitRender(*group.inserts.back(), &flags, inTimeStamp, 0, inNumberFrames, output);
+		if(s != noErr || (flags & kAudioUnitRenderAction_OutputIsSilence)) continue;
+		
+		for(int c = 0; c < 2; c++)
+		{
+			AudioUnitSampleType * destination = group.outputDestination < 0 ?
+				out[c] :
+				(AudioUnitSampleType *)_groups[group.outputDestination]->mixBuffer->mBuffers[c].mData;
+			
+			vDSP_vsma((const AudioUnitSampleType *)output->mBuffers[c].mData, 1,
+					  &group.outputGain,
+					  destination, 1,
+					  destination, 1,
+					  inNumberFrames);
+		}
+		anyGroupRendered = true;
+	}
+	
+	return anyGroupRendered;
+}
+
+// ----------------------------------------------------------
+OSStatus ofxAudioUnitNativeMixer::groupInputCallback(void *inRefCon,
+													 AudioUnitRenderActionFlags *ioActionFlags,
+													 const AudioTimeStamp *inTimeStamp,
+													 UInt32 inBusNumber,
+													 UInt32 inNumberFrames,
+													 AudioBufferList *ioData)
+// ----------------------------------------------------------
+{
+	const Group * group = static_cast<const Group *>(inRefCon);
+	const UInt32 bytes = inNumberFrames * sizeof(AudioUnitSampleType);
+	
+	for(int i = 0; i < ioData->mNumberBuffers; i++)
+	{
+		const AudioBuffer &source = group->mixBuffer->mBuffers[min(i, 1)];
+		if(ioData->mBuffers[i].mData)
+		{
+			memcpy(ioData->mBuffers[i].mData, source.mData, min(bytes, ioData->mBuffers[i].mDataByteSize));
+		}
+		else
+		{
+			ioData->mBuffers[i].mData         = source.mData;
+			ioData->mBuffers[i].mDataByteSize = bytes;
+		}
+	}
+	
+	return noErr;
+}
+
+// ----------------------------------------------------------
+void measureLevels(const AudioBufferList * bufferList,
+				   UInt32 frames,
+				   float &outAveragePower,
+				   float &outPeakLevel)
+// ----------------------------------------------------------
+{
+	float peak = 0;
+	float meanSquare = 0;
+	
+	for(int i = 0; i < bufferList->mNumberBuffers; i++)
+	{
+		const float * samples = (const float *)bufferList->mBuffers[i].mData;
+		float channelPeak, channelMeanSquare;
+		vDSP_maxmgv(samples, 1, &channelPeak, frames);
+		vDSP_measqv(samples, 1, &channelMeanSquare, frames);
+		peak = max(peak, channelPeak);
+		meanSquare += channelMeanSquare / bufferList->mNumberBuffers;
+	}
+	
+	outAveragePower = meanSquare > 0 ? max(kMinimumLevel, 10.f * log10f(meanSquare)) : kMinimumLevel;
+	outPeakLevel    = peak > 0       ? max(kMinimumLevel, 20.f * log10f(peak))       : kMinimumLevel;
+}
+
+#pragma mark - Rendering
+
+// ----------------------------------------------------------
+OSStatus ofxAudioUnitNativeMixer::renderNode(AudioUnitRenderActionFlags *ioActionFlags,
+											 const AudioTimeStamp *inTimeStamp,
+											 UInt32 inNumberFrames,
+											 AudioBufferList *ioData)
+// ----------------------------------------------------------
+{
+	AudioUnitSampleType * out[2];
+	for(int c = 0; c < 2; c++)
+	{
+		out[c] = (AudioUnitSampleType *)ioData->mBuffers[c].mData;
+		vDSP_vclr(out[c], 1, inNumberFrames);
+	}
+	
+	const size_t busCount = min(_busses.size(), _inputs.size());
+	const UInt32 busBytes = inNumberFrames * sizeof(AudioUnitSampleType);
+	bool anyBusRendered = false;
+	
+	// applying this buffer's fades. Anything that moved ramps from its
+	// previous gain to its new one across the buffer
+	float outputStartVolume = _outputVolume;
+	bool  outputRamping = false;
+	
+	if(_fades.beginBuffer(inNumberFrames))
+	{
+		for(int i = 0; i < _fades.getSegmentCount(); i++)
+		{
+			const ofxAudioUnitFadeScheduler::Segment &segment = _fades.getSegment(i);
+			
+			if(segment.target == kOutputVolumeTarget)
+			{
+				outputStartVolume = segment.startValue;
+				_outputVolume     = segment.endValue;
+				outputRamping     = true;
+				continue;
+			}
+			
+			const unsigned int bus = (segment.target - 1) / 2;
+			if(bus >= busCount) continue;
+			
+			BusState &state = _busses[bus];
+			if(!state.ramping)
+			{
+				state.ramping      = true;
+				state.startGain[0] = state.gain[0];
+				state.startGain[1] = state.gain[1];
+			}
+			
+			if(segment.target == volumeTarget(bus)) state.volume = segment.endValue;
+			else                                    state.pan    = segment.endValue;
+			updateBusGain(state);
+		}
+		_fades.endBuffer();
+	}
+	
+	updateGroupRouting();
+	
+	// pulling every connected (and audible or metered) bus into its slot
+	for(int bus = 0; bus < busCount; bus++)
+	{
+		BusState &state = _busses[bus];
+		state.rendered = false;
+		
+		if(state.group >= 0 && state.group < _groups.size())
+		{
+			state.destination     = _groups[state.group]->memberDestination;
+			state.destinationGain = _groups[state.group]->memberGain;
+		}
+		else
+		{
+			state.destination     = -1;
+			state.destinationGain = 1;
+		}
+		
+		bool audible = state.gain[0] != 0 || state.gain[1] != 0;
+		if(state.ramping) audible = audible || state.startGain[0] != 0 || state.startGain[1] != 0;
+		audible = audible && state.destinationGain != 0;
+		if(!isInputConnected(bus) || !(audible || state.metering)) continue;
+		
+		AudioBufferList * busBuffer = _busBuffers[bus];
+		const size_t busOffset = bus * 2 * kMaxFramesPerSlice;
+		for(int c = 0; c < 2; c++)
+		{
+			busBuffer->mBuffers[c].mData         = _busSamples + busOffset + (c * kMaxFramesPerSlice);
+			busBuffer->mBuffers[c].mDataByteSize = busBytes;
+		}
+		
+		AudioUnitRenderActionFlags busFlags = 0;
+		OSStatus s = pullInput(bus, &busFlags, inTimeStamp, inNumberFrames, busBuffer);
+		
+		if(s != noErr || (busFlags & kAudioUnitRenderAction_OutputIsSilence))
+		{
+			state.averagePower = state.peakLevel = kMinimumLevel;
+			continue;
+		}
+		
+		if(state.metering) measureLevels(busBuffer, inNumberFrames, state.averagePower, state.peakLevel);
+		
+		state.rendered = audible;
+		anyBusRendered = anyBusRendered || audible;
+	}
+	
+	for(int i = 0; i < _groups.size(); i++)
+	{
+		const Group &group = *_groups[i];
+		if(group.inserts.empty()) continue;
+		for(int c = 0; c < 2; c++)
+			vDSP_vclr((AudioUnitSampleType *)group.mixBuffer->mBuffers[c].mData, 1, inNumberFrames);
+	}
+	
+	// accumulating the busses into the output (or their group's submix),
+	// one block of frames at a time
+	for(UInt32 start = 0; start < inNumberFrames; start += kAccumulateBlockFrames)
+	{
+		vDSP_Length blockFrames = min(kAccumulateBlockFrames, inNumberFrames - start);
+		
+		for(int bus = 0; bus < busCount; bus++)
+		{
+			const BusState &state = _busses[bus];
+			if(!state.rendered) continue;
+			
+			const AudioBufferList * busBuffer = _busBuffers[bus];
+			for(int c = 0; c < 2; c++)
+			{
+				const AudioUnitSampleType * busSamples = (const AudioUnitSampleType *)busBuffer->mBuffers[c].mData;
+				AudioUnitSampleType * destination = state.destination < 0 ?
+					out[c] :
+					(AudioUnitSampleType *)_groups[state.destination]->mixBuffer->mBuffers[c].mData;
+				
+				if(state.ramping)
+				{
+					float step = state.destinationGain * (state.gain[c] - state.startGain[c]) / inNumberFrames;
+					float gain = state.destinationGain * state.startGain[c] + step * start;
+					vDSP_vrampmuladd(busSamples + start, 1, &gain, &step, destination + start, 1, blockFrames);
+				}
+				else
+				{
+					float gain = state.destinationGain * state.gain[c];
+					vDSP_vsma(busSamples + start, 1, &gain, destination + start, 1, destination + start, 1, blockFrames);
+				}
+			}
+		}
+	}
+	
+	for(int bus = 0; bus < busCount; bus++) _busses[bus].ramping = false;
+	
+	if(renderGroupInserts(inTimeStamp, inNumberFrames, out)) anyBusRendered = true;
+	
+	if(outputRamping)
+	{
+		float step = (_outputVolume - outputStartVolume) / inNumberFrames;
+		for(int c = 0; c < 2; c++)
+		{
+			float volume = outputStartVolume;
+			vDSP_vrampmul(out[c], 1, &volume, &step, out[c], 1, inNumberFrames);
+		}
+	}
+	else if(_outputVolume != 1)
+	{
+		for(int c = 0; c < 2; c++) vDSP_vsmul(out[c], 1, &_outputVolume, out[c], 1, inNumberFrames);
+	}
+	
+	if(_outputMetering) measureLevels(ioData, inNumberFrames, _outputAveragePower, _outputPeakLevel);
+	
+	if(!anyBusRendered) *ioActionFlags |= kAudioUnitRenderAction_OutputIsSilence;
+	
+	return noErr;
+}
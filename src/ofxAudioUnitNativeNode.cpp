@@ -0,0 +1,302 @@
+#include "ofxAudioUnit.h"
+#include <libkern/OSAtomic.h>
+
+AudioComponentDescription nativeNodeDesc = {
+	kAudioUnitType_FormatConverter,
+	kAudioUnitSubType_AUConverter,
+	kAudioUnitManufacturer_Apple
+};
+
+static OSStatus silentNodeCallback(void *inRefCon,
+								   AudioUnitRenderActionFlags *ioActionFlags,
+								   const AudioTimeStamp *inTimeStamp,
+								   UInt32 inBusNumber,
+								   UInt32 inNumberFrames,
+								   AudioBufferList *ioData);
+
+// ----------------------------------------------------------
+ofxAudioUnitNativeNode::ofxAudioUnitNativeNode(UInt32 outputChannels)
+: _outputChannels(outputChannels)
+, _sampleRate(44100)
+// ----------------------------------------------------------
+{
+	_desc = nativeNodeDesc;
+	initUnit();
+	if(!_unit) return;
+	
+	// stream formats can only be changed while the unit is uninitialized
+	OFXAU_PRINT(AudioUnitUninitialize(*_unit), "uninitializing native node");
+	
+	AudioStreamBasicDescription asbd = {0};
+	asbd.mSampleRate       = 44100;
+	asbd.mFormatID         = kAudioFormatLinearPCM;
+	asbd.mFormatFlags      = kAudioFormatFlagsNativeFloatPacked | kAudioFormatFlagIsNonInterleaved;
+	asbd.mBytesPerPacket   = sizeof(Float32);
+	asbd.mFramesPerPacket  = 1;
+	asbd.mBytesPerFrame    = sizeof(Float32);
+	asbd.mChannelsPerFrame = _outputChannels;
+	asbd.mBitsPerChannel   = 8 * sizeof(Float32);
+	
+	OFXAU_PRINT(AudioUnitSetProperty(*_unit,
+									 kAudioUnitProperty_StreamFormat,
+									 kAudioUnitScope_Input,
+									 0,
+									 &asbd,
+									 sizeof(asbd)),
+				"setting native node's input format");
+	
+	OFXAU_PRINT(AudioUnitSetProperty(*_unit,
+									 kAudioUnitProperty_StreamFormat,
+									 kAudioUnitScope_Output,
+									 0,
+									 &asbd,
+									 sizeof(asbd)),
+				"setting native node's output format");
+	
+	UInt32 maxFrames = kMaxFramesPerSlice;
+	OFXAU_PRINT(AudioUnitSetProperty(*_unit,
+									 kAudioUnitProperty_MaximumFramesPerSlice,
+									 kAudioUnitScope_Global,
+									 0,
+									 &maxFrames,
+									 sizeof(maxFrames)),
+				"setting native node's maximum frames per slice");
+	
+	AURenderCallbackStruct callback;
+	callback.inputProc       = nodeRenderCallback;
+	callback.inputProcRefCon = this;
+	ofxAudioUnit::setRenderCallback(callback, 0);
+	
+	_sampleRate = asbd.mSampleRate;
+	OFXAU_PRINT(AudioUnitAddPropertyListener(*_unit,
+											 kAudioUnitProperty_StreamFormat,
+											 streamFormatChanged,
+											 this),
+				"listening for native node format changes");
+	
+	OFXAU_PRINT(AudioUnitInitialize(*_unit), "initializing native node");
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitNativeNode::~ofxAudioUnitNativeNode()
+// ----------------------------------------------------------
+{
+	detachNode();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitNativeNode::detachNode()
+// ----------------------------------------------------------
+{
+	// the converter may outlive us if something else holds on to its
+	// AudioUnitRef, so it shouldn't be left calling back into this object
+	if(_unit)
+	{
+		AURenderCallbackStruct callback;
+		callback.inputProc       = silentNodeCallback;
+		callback.inputProcRefCon = NULL;
+		
+		OFXAU_REALTIME_LOCK(_renderMutex);
+		ofxAudioUnit::setRenderCallback(callback, 0);
+		_renderMutex.unlock();
+		
+		AudioUnitRemovePropertyListenerWithUserData(*_unit,
+													kAudioUnitProperty_StreamFormat,
+													streamFormatChanged,
+													this);
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitNativeNode::streamFormatChanged(void *inRefCon,
+												 AudioUnit inUnit,
+												 AudioUnitPropertyID inID,
+												 AudioUnitScope inScope,
+												 AudioUnitElement inElement)
+// ----------------------------------------------------------
+{
+	// renderNode() works in the converter's input format (the converter
+	// resamples from there to its output, if the two differ), so that's
+	// the rate its time stamps count samples at
+	if(inScope != kAudioUnitScope_Input || inElement != 0) return;
+	
+	ofxAudioUnitNativeNode * node = static_cast<ofxAudioUnitNativeNode *>(inRefCon);
+	
+	AudioStreamBasicDescription asbd = {0};
+	UInt32 dataSize = sizeof(asbd);
+	if(AudioUnitGetProperty(inUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Input, 0, &asbd, &dataSize) == noErr &&
+	   asbd.mSampleRate > 0)
+	{
+		node->_sampleRate = asbd.mSampleRate;
+		OSMemoryBarrier();
+	}
+}
+
+#pragma mark - Connections
+
+// ----------------------------------------------------------
+void ofxAudioUnitNativeNode::connectInput(ofxAudioUnit &source, int destinationBus, int sourceBus)
+// ----------------------------------------------------------
+{
+	if(destinationBus >= _inputs.size())
+	{
+		cout << "Native node doesn't have an input bus " << destinationBus << endl;
+		return;
+	}
+	
+	OFXAU_REALTIME_LOCK(_renderMutex);
+	{
+		InputSource &input = _inputs[destinationBus];
+		input.callback.inputProc       = NULL;
+		input.callback.inputProcRefCon = NULL;
+		input.unit      = source.getUnit();
+		input.sourceBus = sourceBus;
+	}
+	_renderMutex.unlock();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitNativeNode::setRenderCallback(AURenderCallbackStruct callback, int destinationBus)
+// ----------------------------------------------------------
+{
+	if(destinationBus >= _inputs.size())
+	{
+		cout << "Native node doesn't have an input bus " << destinationBus << endl;
+		return;
+	}
+	
+	OFXAU_REALTIME_LOCK(_renderMutex);
+	{
+		InputSource &input = _inputs[destinationBus];
+		input.callback  = callback;
+		input.unit      = AudioUnitRef();
+		input.sourceBus = 0;
+	}
+	_renderMutex.unlock();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitNativeNode::resizeInputs(unsigned int inputCount)
+// ----------------------------------------------------------
+{
+	InputSource unconnected;
+	unconnected.callback.inputProc       = NULL;
+	unconnected.callback.inputProcRefCon = NULL;
+	unconnected.sourceBus = 0;
+	
+	OFXAU_REALTIME_LOCK(_renderMutex);
+	_inputs.resize(inputCount, unconnected);
+	_renderMutex.unlock();
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitNativeNode::isInputConnected(unsigned int bus) const
+// ----------------------------------------------------------
+{
+	return bus < _inputs.size() && (_inputs[bus].callback.inputProc || _inputs[bus].unit);
+}
+
+#pragma mark - Rendering
+
+// ----------------------------------------------------------
+OSStatus ofxAudioUnitNativeNode::pullInput(unsigned int bus,
+										   AudioUnitRenderActionFlags *ioActionFlags,
+										   const AudioTimeStamp *inTimeStamp,
+										   UInt32 inNumberFrames,
+										   AudioBufferList *ioData)
+// ----------------------------------------------------------
+{
+	const InputSource &input = _inputs[bus];
+	
+	if(input.callback.inputProc)
+	{
+		return input.callback.inputProc(input.callback.inputProcRefCon,
+										ioActionFlags,
+										inTimeStamp,
+										bus,
+										inNumberFrames,
+										ioData);
+	}
+	else if(input.unit)
+	{
+		return AudioUnitRender(*input.unit,
+							   ioActionFlags,
+							   inTimeStamp,
+							   input.sourceBus,
+							   inNumberFrames,
+							   ioData);
+	}
+	
+	return kAudioUnitErr_NoConnection;
+}
+
+// ----------------------------------------------------------
+UInt32 ofxAudioUnitNativeNode::framesUntilHostTime(uint64_t hostTime, const AudioTimeStamp *inTimeStamp) const
+// ----------------------------------------------------------
+{
+	if(!(inTimeStamp->mFlags & kAudioTimeStampHostTimeValid) || hostTime <= inTimeStamp->mHostTime)
+	{
+		return 0;
+	}
+	
+	// the rate scalar corrects for the device clock running slightly fast
+	// or slow against the host clock
+	double frames = ofxAudioUnitHostTimeToSeconds(hostTime - inTimeStamp->mHostTime) * _sampleRate;
+	if((inTimeStamp->mFlags & kAudioTimeStampRateScalarValid) && inTimeStamp->mRateScalar > 0)
+	{
+		frames /= inTimeStamp->mRateScalar;
+	}
+	
+	frames += 0.5;
+	return frames < UINT32_MAX ? (UInt32)frames : UINT32_MAX;
+}
+
+// ----------------------------------------------------------
+OSStatus ofxAudioUnitNativeNode::nodeRenderCallback(void *inRefCon,
+													AudioUnitRenderActionFlags *ioActionFlags,
+													const AudioTimeStamp *inTimeStamp,
+													UInt32 inBusNumber,
+													UInt32 inNumberFrames,
+													AudioBufferList *ioData)
+// ----------------------------------------------------------
+{
+	OFXAU_REALTIME_SCOPE();
+	ofxAudioUnitDenormalGuard denormalGuard;
+	
+	ofxAudioUnitNativeNode * node = static_cast<ofxAudioUnitNativeNode *>(inRefCon);
+	
+	if(inNumberFrames > kMaxFramesPerSlice)
+	{
+		return kAudioUnitErr_TooManyFramesToProcess;
+	}
+	
+	// if the node is being reconfigured, render silence for this slice
+	// rather than waiting for it
+	if(!node->_renderMutex.tryLock())
+	{
+		return silentNodeCallback(NULL, ioActionFlags, inTimeStamp,
+								  inBusNumber, inNumberFrames, ioData);
+	}
+	
+	OSStatus s = node->renderNode(ioActionFlags, inTimeStamp, inNumberFrames, ioData);
+	node->_renderMutex.unlock();
+	
+	return s;
+}
+
+// ----------------------------------------------------------
+OSStatus silentNodeCallback(void *inRefCon,
+							AudioUnitRenderActionFlags *ioActionFlags,
+							const AudioTimeStamp *inTimeStamp,
+							UInt32 inBusNumber,
+							UInt32 inNumberFrames,
+							AudioBufferList *ioData)
+// ----------------------------------------------------------
+{
+	for(int i = 0; i < ioData->mNumberBuffers; i++)
+	{
+		memset(ioData->mBuffers[i].mData, 0, ioData->mBuffers[i].mDataByteSize);
+	}
+	*ioActionFlags |= kAudioUnitRenderAction_OutputIsSilence;
+	return noErr;
+}
@@ -0,0 +1,315 @@
+#include "ofxAudioUnitRealtimeCheck.h"
+#include <execinfo.h>
+#include <pthread.h>
+#include <malloc/malloc.h>
+#include <mach/mach.h>
+#include <mach/mach_time.h>
+#include <libkern/OSAtomic.h>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+// Violations are written from render threads, so they go into a fixed
+// pool that is allocated up front. Anything past the pool's capacity
+// is still counted, but its stack trace is dropped.
+
+enum
+{
+	kMaxRecordedViolations = 256,
+	kMaxStackDepth         = 32
+};
+
+struct ViolationRecord
+{
+	const char * description;
+	void *       stack[kMaxStackDepth];
+	int          stackDepth;
+	uint64_t     hostTime;
+};
+
+static ViolationRecord  s_records[kMaxRecordedViolations];
+static volatile int32_t s_violationCount = 0;
+static volatile int32_t s_enabled = 0;
+
+// The thread-specific value holds the render scope nesting depth in
+// the upper bits and a "currently reporting" flag in the lowest bit
+// (so that we don't recurse if reporting itself trips a hook)
+static pthread_key_t  s_threadStateKey;
+static pthread_once_t s_threadStateOnce = PTHREAD_ONCE_INIT;
+
+static void createThreadStateKey()
+{
+	pthread_key_create(&s_threadStateKey, NULL);
+}
+
+static intptr_t getThreadState()
+{
+	pthread_once(&s_threadStateOnce, createThreadStateKey);
+	return (intptr_t)pthread_getspecific(s_threadStateKey);
+}
+
+static void setThreadState(intptr_t state)
+{
+	pthread_setspecific(s_threadStateKey, (const void *)state);
+}
+
+#pragma mark - Malloc zone hooks
+
+static malloc_zone_t * s_zone = NULL;
+static void * (*s_zoneMalloc) (malloc_zone_t *, size_t)         = NULL;
+static void * (*s_zoneCalloc) (malloc_zone_t *, size_t, size_t) = NULL;
+static void * (*s_zoneRealloc)(malloc_zone_t *, void *, size_t) = NULL;
+static void   (*s_zoneFree)   (malloc_zone_t *, void *)         = NULL;
+
+// enable() checks the hooks work by allocating from its own thread while
+// s_probing is set. Those allocations are counted here rather than
+// reported
+static volatile bool    s_probing = false;
+static pthread_t        s_probeThread;
+static volatile int32_t s_probeHits = 0;
+
+// ----------------------------------------------------------
+static void * checkedMalloc(malloc_zone_t * zone, size_t size)
+// ----------------------------------------------------------
+{
+	if(s_probing && pthread_equal(pthread_self(), s_probeThread))
+		OSAtomicIncrement32Barrier(&s_probeHits);
+	else if(ofxAudioUnitRealtimeCheck::isRenderThread())
+		ofxAudioUnitRealtimeCheck::reportViolation("malloc() on render thread");
+	return s_zoneMalloc(zone, size);
+}
+
+// ----------------------------------------------------------
+static void * checkedCalloc(malloc_zone_t * zone, size_t count, size_t size)
+// ----------------------------------------------------------
+{
+	if(ofxAudioUnitRealtimeCheck::isRenderThread())
+		ofxAudioUnitRealtimeCheck::reportViolation("calloc() on render thread");
+	return s_zoneCalloc(zone, count, size);
+}
+
+// ----------------------------------------------------------
+static void * checkedRealloc(malloc_zone_t * zone, void * ptr, size_t size)
+// ----------------------------------------------------------
+{
+	if(ofxAudioUnitRealtimeCheck::isRenderThread())
+		ofxAudioUnitRealtimeCheck::reportViolation("realloc() on render thread");
+	return s_zoneRealloc(zone, ptr, size);
+}
+
+// ----------------------------------------------------------
+static void checkedFree(malloc_zone_t * zone, void * ptr)
+// ----------------------------------------------------------
+{
+	if(ptr && ofxAudioUnitRealtimeCheck::isRenderThread())
+		ofxAudioUnitRealtimeCheck::reportViolation("free() on render thread");
+	s_zoneFree(zone, ptr);
+}
+
+// ----------------------------------------------------------
+static void setZoneWritable(malloc_zone_t * zone, bool writable)
+// ----------------------------------------------------------
+{
+	// newer versions of the default zone live in read-only memory
+	if(zone->version >= 8)
+	{
+		vm_protect(mach_task_self(),
+				   (vm_address_t)zone,
+				   sizeof(malloc_zone_t),
+				   0,
+				   writable ? (VM_PROT_READ | VM_PROT_WRITE) : VM_PROT_READ);
+	}
+}
+
+// ----------------------------------------------------------
+static malloc_zone_t * findDefaultZone()
+// ----------------------------------------------------------
+{
+	// malloc_default_zone() can return a wrapper that forwards to the real
+	// default zone, which malloc() calls directly, so hooking the wrapper
+	// would catch nothing. The real one is always first in the zone list
+	vm_address_t * zones = NULL;
+	unsigned int zoneCount = 0;
+	if(malloc_get_all_zones(mach_task_self(), NULL, &zones, &zoneCount) == KERN_SUCCESS && zoneCount > 0)
+	{
+		return (malloc_zone_t *)zones[0];
+	}
+	return malloc_default_zone();
+}
+
+// ----------------------------------------------------------
+static void installHooks(bool install)
+// ----------------------------------------------------------
+{
+	setZoneWritable(s_zone, true);
+	s_zone->malloc  = install ? checkedMalloc  : s_zoneMalloc;
+	s_zone->calloc  = install ? checkedCalloc  : s_zoneCalloc;
+	s_zone->realloc = install ? checkedRealloc : s_zoneRealloc;
+	s_zone->free    = install ? checkedFree    : s_zoneFree;
+	setZoneWritable(s_zone, false);
+}
+
+// ----------------------------------------------------------
+static bool hooksWork()
+// ----------------------------------------------------------
+{
+	s_probeThread = pthread_self();
+	s_probeHits   = 0;
+	OSMemoryBarrier();
+	s_probing = true;
+	
+	// volatile, so that the compiler can't elide the pair
+	void * volatile probe = malloc(16);
+	free(probe);
+	
+	s_probing = false;
+	OSMemoryBarrier();
+	return s_probeHits > 0;
+}
+
+#pragma mark - Enabling
+
+// ----------------------------------------------------------
+void ofxAudioUnitRealtimeCheck::enable()
+// ----------------------------------------------------------
+{
+	if(!OSAtomicCompareAndSwap32Barrier(0, 1, &s_enabled)) return;
+
+	pthread_once(&s_threadStateOnce, createThreadStateKey);
+
+	s_zone = findDefaultZone();
+	s_zoneMalloc  = s_zone->malloc;
+	s_zoneCalloc  = s_zone->calloc;
+	s_zoneRealloc = s_zone->realloc;
+	s_zoneFree    = s_zone->free;
+
+	installHooks(true);
+	
+	// the rest of the checks still work without these, but a clean run
+	// shouldn't be taken to mean nothing allocated
+	if(!hooksWork())
+	{
+		cout << "ofxAudioUnitRealtimeCheck couldn't hook malloc, so allocations on render threads won't be reported" << endl;
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitRealtimeCheck::disable()
+// ----------------------------------------------------------
+{
+	if(!OSAtomicCompareAndSwap32Barrier(1, 0, &s_enabled)) return;
+
+	installHooks(false);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitRealtimeCheck::isEnabled()
+// ----------------------------------------------------------
+{
+	return s_enabled != 0;
+}
+
+#pragma mark - Render threads
+
+// ----------------------------------------------------------
+bool ofxAudioUnitRealtimeCheck::isRenderThread()
+// ----------------------------------------------------------
+{
+	if(!s_enabled) return false;
+	intptr_t state = getThreadState();
+	return (state >> 1) > 0 && !(state & 1);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitRealtimeCheck::beginRenderThread()
+// ----------------------------------------------------------
+{
+	setThreadState(getThreadState() + 2);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitRealtimeCheck::endRenderThread()
+// ----------------------------------------------------------
+{
+	intptr_t state = getThreadState();
+	if(state >= 2) setThreadState(state - 2);
+}
+
+#pragma mark - Violations
+
+// ----------------------------------------------------------
+void ofxAudioUnitRealtimeCheck::reportViolation(const char * description)
+// ----------------------------------------------------------
+{
+	intptr_t state = getThreadState();
+	if(state & 1) return;
+	setThreadState(state | 1);
+
+	int32_t index = OSAtomicIncrement32Barrier(&s_violationCount) - 1;
+	if(index < kMaxRecordedViolations)
+	{
+		ViolationRecord &record = s_records[index];
+		record.description = description;
+		record.hostTime    = mach_absolute_time();
+		record.stackDepth  = backtrace(record.stack, kMaxStackDepth);
+	}
+
+	setThreadState(state);
+}
+
+// ----------------------------------------------------------
+unsigned int ofxAudioUnitRealtimeCheck::getViolationCount()
+// ----------------------------------------------------------
+{
+	return s_violationCount;
+}
+
+// ----------------------------------------------------------
+std::vector<std::string> ofxAudioUnitRealtimeCheck::getViolations()
+// ----------------------------------------------------------
+{
+	vector<string> violations;
+	int recorded = min((int)s_violationCount, (int)kMaxRecordedViolations);
+
+	for(int i = 0; i < recorded; i++)
+	{
+		const ViolationRecord &record = s_records[i];
+		ostringstream ss;
+		ss << record.description << " (host time " << record.hostTime << ")" << endl;
+
+		char ** symbols = backtrace_symbols(record.stack, record.stackDepth);
+		if(symbols)
+		{
+			// skipping the first frame, since it's reportViolation() itself
+			for(int f = 1; f < record.stackDepth; f++)
+				ss << "\t" << symbols[f] << endl;
+			free(symbols);
+		}
+		violations.push_back(ss.str());
+	}
+
+	return violations;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitRealtimeCheck::printViolations()
+// ----------------------------------------------------------
+{
+	vector<string> violations = getViolations();
+	cout << getViolationCount() << " real-time violation(s) on render threads";
+	if(getViolationCount() > violations.size())
+		cout << " (only the first " << violations.size() << " were recorded)";
+	cout << endl;
+
+	for(int i = 0; i < violations.size(); i++)
+		cout << violations[i];
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitRealtimeCheck::clearViolations()
+// ----------------------------------------------------------
+{
+	s_violationCount = 0;
+	OSMemoryBarrier();
+}
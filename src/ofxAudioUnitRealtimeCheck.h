@@ -0,0 +1,87 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// ofxAudioUnitRealtimeCheck is a debugging aid for render callbacks.
+// Code running on a render thread must not allocate memory, wait on
+// locks, print to the console or make any other call that could block.
+// These mistakes are easy to make and usually only show up as the
+// occasional glitch, so this class tries to catch them as they happen.
+
+// To use it, add OFXAU_DEBUG_REALTIME to your project's preprocessor
+// macros and call ofxAudioUnitRealtimeCheck::enable() in setup(). Every
+// render entry point owned by the addon (taps, inputs, native nodes...)
+// will then mark its thread as a render thread for the duration of the
+// callback. You can mark your own render callbacks with
+// OFXAU_REALTIME_SCOPE() at the top of the function.
+
+// While enabled, calls to malloc / calloc / realloc / free from a marked
+// thread are intercepted via the default malloc zone (enable() checks
+// this works, and says so if it doesn't). Blocking calls that can't be
+// intercepted that way are reported by the addon itself wherever it
+// makes them: every mutex it locks goes through OFXAU_REALTIME_LOCK(),
+// so calling something like a player's play() from a render callback is
+// caught, and so is writing to std::cout.
+// Each violation is recorded along with a stack trace, and can be
+// printed or inspected later from your app's main thread.
+
+// getViolationCount() is handy for automated test runs: render a few
+// seconds of your chain and fail if it is greater than zero.
+
+// Without OFXAU_DEBUG_REALTIME the macros below compile to nothing, so
+// there is no cost to leaving them in render code.
+
+struct ofxAudioUnitRealtimeCheck
+{
+	static void enable();
+	static void disable();
+	static bool isEnabled();
+
+	static bool isRenderThread();
+	static void beginRenderThread();
+	static void endRenderThread();
+
+	static void reportViolation(const char * description);
+
+	static unsigned int getViolationCount();
+	static std::vector<std::string> getViolations();
+	static void printViolations();
+	static void clearViolations();
+};
+
+// Marks the current thread as a render thread until the end of the
+// enclosing scope
+class ofxAudioUnitRealtimeScope
+{
+public:
+	ofxAudioUnitRealtimeScope() {ofxAudioUnitRealtimeCheck::beginRenderThread();}
+	~ofxAudioUnitRealtimeScope(){ofxAudioUnitRealtimeCheck::endRenderThread();}
+};
+
+#ifdef OFXAU_DEBUG_REALTIME
+
+#define OFXAU_REALTIME_SCOPE()\
+ofxAudioUnitRealtimeScope ofxAudioUnitRealtimeScopeInstance
+
+#define OFXAU_REALTIME_VIOLATION(description)\
+do{\
+	if(ofxAudioUnitRealtimeCheck::isRenderThread()){\
+		ofxAudioUnitRealtimeCheck::reportViolation(description);\
+	}\
+}while(0)
+
+#else
+
+#define OFXAU_REALTIME_SCOPE()
+#define OFXAU_REALTIME_VIOLATION(description) do{}while(0)
+
+#endif
+
+// Locks a mutex, flagging a violation first if this is a render thread.
+// Render code should tryLock() instead
+#define OFXAU_REALTIME_LOCK(mutex)\
+do{\
+	OFXAU_REALTIME_VIOLATION("locking " #mutex);\
+	(mutex).lock();\
+}while(0)
@@ -0,0 +1,290 @@
+#include "ofxAudioUnitResampler.h"
+#include <Accelerate/Accelerate.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+using namespace std;
+
+static const int kRadius = ofxAudioUnitResampler::kMaxKernelRadius;
+
+// The sinc filter has 2 * kRadius taps, covering the input samples from
+// kRadius - 1 before the read position to kRadius after it. Its table
+// holds kSincPhases + 1 rows of taps (one per fractional position, plus
+// one so that neighbouring rows can always be interpolated between) for
+// each of several bands. Rates above 1 use a band with a lower cutoff,
+// so that speeding up doesn't alias.
+static const unsigned int kSincTaps   = 2 * kRadius;
+static const unsigned int kSincPhases = 256;
+static const unsigned int kSincRows   = kSincPhases + 1;
+static const float kSincBandRates[]   = {1, 1.5, 2, 3, 4, 6, 8};
+static const unsigned int kSincBands  = sizeof(kSincBandRates) / sizeof(kSincBandRates[0]);
+
+// ----------------------------------------------------------
+static std::vector<float> buildSincTables()
+// ----------------------------------------------------------
+{
+	std::vector<float> tables(kSincBands * kSincRows * kSincTaps);
+	
+	for(int band = 0; band < kSincBands; band++)
+	{
+		// a little under the new Nyquist, since 16 taps can't make a steep filter
+		const double cutoff = 0.9 / kSincBandRates[band];
+		
+		for(int phase = 0; phase < kSincRows; phase++)
+		{
+			float * taps = &tables[(band * kSincRows + phase) * kSincTaps];
+			const double fraction = (double)phase / kSincPhases;
+			double sum = 0;
+			
+			for(int k = 0; k < kSincTaps; k++)
+			{
+				const double x = (k - (kRadius - 1)) - fraction;
+				const double sinc = x == 0 ? 1 : sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+				const double blackman = fabs(x) >= kRadius ? 0 :
+					0.42 + 0.5 * cos(M_PI * x / kRadius) + 0.08 * cos(2 * M_PI * x / kRadius);
+				
+				taps[k] = sinc * blackman;
+				sum += taps[k];
+			}
+			
+			// unity gain at DC for every phase
+			for(int k = 0; k < kSincTaps; k++) taps[k] /= sum;
+		}
+	}
+	
+	return tables;
+}
+
+// ----------------------------------------------------------
+static const float * sincTables()
+// ----------------------------------------------------------
+{
+	static const std::vector<float> tables = buildSincTables();
+	return &tables[0];
+}
+
+// ----------------------------------------------------------
+static unsigned int sincBand(float rate)
+// ----------------------------------------------------------
+{
+	rate = fabsf(rate);
+	unsigned int band = 0;
+	while(band + 1 < kSincBands && kSincBandRates[band + 1] <= rate) band++;
+	return band;
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitResampler::ofxAudioUnitResampler(unsigned int channels,
+											 ofxAudioUnitResamplerQuality quality,
+											 unsigned int maxInputFrames)
+: _quality(quality)
+, _channels(channels)
+, _capacity(maxInputFrames + 2 * kRadius + 1)
+// ----------------------------------------------------------
+{
+	// building the tables now, rather than on the render thread
+	sincTables();
+	
+	_buffer.assign(_channels * _capacity, 0);
+	reset();
+}
+
+// ----------------------------------------------------------
+unsigned int ofxAudioUnitResampler::getKernelRadius() const
+// ----------------------------------------------------------
+{
+	switch(_quality)
+	{
+		case OFX_AU_RESAMPLE_LINEAR: return 1;
+		case OFX_AU_RESAMPLE_CUBIC:  return 2;
+		default:                     return kRadius;
+	}
+}
+
+#pragma mark - Streaming
+
+// ----------------------------------------------------------
+void ofxAudioUnitResampler::reset()
+// ----------------------------------------------------------
+{
+	// starting with a kernel's worth of silent history
+	memset(&_buffer[0], 0, _buffer.size() * sizeof(float));
+	_bufferedFrames = kRadius;
+	_position = kRadius;
+}
+
+// ----------------------------------------------------------
+unsigned int ofxAudioUnitResampler::getInputFramesNeeded(unsigned int outputFrames, float rate) const
+// ----------------------------------------------------------
+{
+	if(outputFrames == 0) return 0;
+	
+	const double lastPosition = _position + (outputFrames - 1) * (double)max(rate, 0.f);
+	const double framesNeeded = floor(lastPosition) + kRadius + 1;
+	return max(framesNeeded - _bufferedFrames, 0.);
+}
+
+// ----------------------------------------------------------
+unsigned int ofxAudioUnitResampler::getInputFramesNeeded(unsigned int outputFrames, const float * rates) const
+// ----------------------------------------------------------
+{
+	if(outputFrames == 0) return 0;
+	
+	float distance = 0;
+	vDSP_sve(rates, 1, &distance, outputFrames - 1);
+	
+	const double framesNeeded = floor(_position + max(distance, 0.f)) + kRadius + 1;
+	return max(framesNeeded - _bufferedFrames, 0.);
+}
+
+// ----------------------------------------------------------
+unsigned int ofxAudioUnitResampler::write(const float * const * input, unsigned int frames)
+// ----------------------------------------------------------
+{
+	frames = min(frames, _capacity - _bufferedFrames);
+	
+	for(int c = 0; c < _channels; c++)
+	{
+		memcpy(&_buffer[c * _capacity + _bufferedFrames], input[c], frames * sizeof(float));
+	}
+	
+	_bufferedFrames += frames;
+	return frames;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitResampler::process(float * const * output, unsigned int frames, float rate)
+// ----------------------------------------------------------
+{
+	double position = _position;
+	for(int c = 0; c < _channels; c++)
+	{
+		position = render(&_buffer[c * _capacity], _position, output[c], frames, max(rate, 0.f), NULL);
+	}
+	
+	_position = position;
+	compact();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitResampler::process(float * const * output, unsigned int frames, const float * rates)
+// ----------------------------------------------------------
+{
+	double position = _position;
+	for(int c = 0; c < _channels; c++)
+	{
+		position = render(&_buffer[c * _capacity], _position, output[c], frames, 0, rates);
+	}
+	
+	_position = position;
+	compact();
+}
+
+// ----------------------------------------------------------
+double ofxAudioUnitResampler::getInputFramesAhead() const
+// ----------------------------------------------------------
+{
+	return max(_bufferedFrames - _position, 0.);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitResampler::compact()
+// ----------------------------------------------------------
+{
+	// dropping input that's behind the kernel's reach, and clearing the
+	// space it frees so that reading past the written input gives silence
+	const int discard = min((int)floor(_position) - (kRadius - 1), (int)_bufferedFrames);
+	if(discard <= 0) return;
+	
+	const unsigned int remaining = _bufferedFrames - discard;
+	for(int c = 0; c < _channels; c++)
+	{
+		float * channel = &_buffer[c * _capacity];
+		memmove(channel, channel + discard, remaining * sizeof(float));
+		memset(channel + remaining, 0, discard * sizeof(float));
+	}
+	
+	_bufferedFrames = remaining;
+	_position -= discard;
+}
+
+#pragma mark - Stateless
+
+// ----------------------------------------------------------
+double ofxAudioUnitResampler::resample(const float * input, double position, float * output, unsigned int frames, float rate) const
+// ----------------------------------------------------------
+{
+	return render(input, position, output, frames, rate, NULL);
+}
+
+// ----------------------------------------------------------
+double ofxAudioUnitResampler::resample(const float * input, double position, float * output, unsigned int frames, const float * rates) const
+// ----------------------------------------------------------
+{
+	return render(input, position, output, frames, 0, rates);
+}
+
+#pragma mark - Interpolation
+
+// ----------------------------------------------------------
+double ofxAudioUnitResampler::render(const float * input, double position, float * output, unsigned int frames, float rate, const float * rates) const
+// ----------------------------------------------------------
+{
+	switch(_quality)
+	{
+		case OFX_AU_RESAMPLE_LINEAR:
+			for(unsigned int i = 0; i < frames; i++)
+			{
+				const double index = floor(position);
+				const float fraction = position - index;
+				const float * x = input + (long)index;
+				
+				output[i] = x[0] + fraction * (x[1] - x[0]);
+				position += rates ? rates[i] : rate;
+			}
+			break;
+		
+		case OFX_AU_RESAMPLE_CUBIC:
+			for(unsigned int i = 0; i < frames; i++)
+			{
+				const double index = floor(position);
+				const float f = position - index;
+				const float * x = input + (long)index;
+				
+				// Catmull-Rom through x[-1] ... x[2]
+				output[i] = x[0] + 0.5f * f * (x[1] - x[-1] +
+							f * (2.f * x[-1] - 5.f * x[0] + 4.f * x[1] - x[2] +
+							f * (3.f * (x[0] - x[1]) + x[2] - x[-1])));
+				position += rates ? rates[i] : rate;
+			}
+			break;
+		
+		default:
+		{
+			const float * tables = sincTables();
+			const float * table  = tables + sincBand(rate) * kSincRows * kSincTaps;
+			
+			for(unsigned int i = 0; i < frames; i++)
+			{
+				if(rates) table = tables + sincBand(rates[i]) * kSincRows * kSincTaps;
+				
+				const double index = floor(position);
+				const float phase  = (position - index) * kSincPhases;
+				const unsigned int row = phase;
+				const float * x = input + (long)index - (kRadius - 1);
+				
+				// the two nearest phases, interpolated between
+				float a, b;
+				vDSP_dotpr(x, 1, table + row * kSincTaps, 1, &a, kSincTaps);
+				vDSP_dotpr(x, 1, table + (row + 1) * kSincTaps, 1, &b, kSincTaps);
+				
+				output[i] = a + (phase - row) * (b - a);
+				position += rates ? rates[i] : rate;
+			}
+			break;
+		}
+	}
+	
+	return position;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <AudioToolbox/AudioToolbox.h>
+#include <vector>
+
+// Interpolation used by ofxAudioUnitResampler. Linear is the cheapest and
+// dulls / aliases the most. Cubic (Catmull-Rom) is a good default for
+// modest rate changes. Sinc uses a 16 tap windowed-sinc filter from a
+// polyphase table and is the one to use when quality matters, especially
+// when speeding up (it band-limits for rates up to 8x).
+
+enum ofxAudioUnitResamplerQuality
+{
+	OFX_AU_RESAMPLE_LINEAR,
+	OFX_AU_RESAMPLE_CUBIC,
+	OFX_AU_RESAMPLE_SINC
+};
+
+// ofxAudioUnitResampler changes the playback rate of non-interleaved
+// float audio. A rate of 2 reads through the input twice as fast (an
+// octave up), 0.5 half as fast. The rate can be constant for a buffer
+// or given per output sample, so it can be modulated smoothly.
+
+// It can be used in two ways :
+// - as a stream, by writing input with write() and reading output with
+//   process(). getInputFramesNeeded() says how much input process() will
+//   need next. The resampler keeps the history its filter needs between
+//   calls.
+// - statelessly, with resample(), to read at arbitrary (even backwards)
+//   positions in a buffer the caller owns. The buffer must have
+//   getKernelRadius() frames of valid samples around every position read.
+
+// Nothing allocates after construction, so write() / process() /
+// resample() are safe to call on the render thread.
+
+class ofxAudioUnitResampler
+{
+public:
+	enum
+	{
+		kMaxKernelRadius = 8
+	};
+	
+	ofxAudioUnitResampler(unsigned int channels = 2,
+						  ofxAudioUnitResamplerQuality quality = OFX_AU_RESAMPLE_CUBIC,
+						  unsigned int maxInputFrames = 16384);
+	
+	void setQuality(ofxAudioUnitResamplerQuality quality) {_quality = quality;}
+	ofxAudioUnitResamplerQuality getQuality() const {return _quality;}
+	unsigned int getKernelRadius() const;
+	unsigned int getChannels() const {return _channels;}
+	
+	// streaming
+	void reset();
+	unsigned int getInputFramesNeeded(unsigned int outputFrames, float rate) const;
+	unsigned int getInputFramesNeeded(unsigned int outputFrames, const float * rates) const;
+	unsigned int write(const float * const * input, unsigned int frames);
+	void process(float * const * output, unsigned int frames, float rate);
+	void process(float * const * output, unsigned int frames, const float * rates);
+	
+	// how far the written input reaches past the read position, in input
+	// frames. A caller counting the frames it has written can subtract
+	// this to find the input frame being played
+	double getInputFramesAhead() const;
+	
+	// stateless. position is an index into input. Returns the position
+	// after the last output sample
+	double resample(const float * input, double position, float * output, unsigned int frames, float rate) const;
+	double resample(const float * input, double position, float * output, unsigned int frames, const float * rates) const;
+
+private:
+	ofxAudioUnitResamplerQuality _quality;
+	unsigned int _channels;
+	unsigned int _capacity;
+	unsigned int _bufferedFrames;
+	double _position;
+	std::vector<float> _buffer;
+	
+	double render(const float * input, double position, float * output, unsigned int frames, float rate, const float * rates) const;
+	void compact();
+};
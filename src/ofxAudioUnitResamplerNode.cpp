@@ -0,0 +1,136 @@
+#include "ofxAudioUnit.h"
+#include <Accelerate/Accelerate.h>
+
+static const float kMinResampleRate = 0.125;
+static const float kMaxResampleRate = 8;
+
+// ----------------------------------------------------------
+ofxAudioUnitResamplerNode::ofxAudioUnitResamplerNode(UInt32 channels, ofxAudioUnitResamplerQuality quality)
+: ofxAudioUnitNativeNode(channels)
+, _resampler(channels, quality, kMaxFramesPerSlice * kMaxResampleRate + 2 * ofxAudioUnitResampler::kMaxKernelRadius)
+, _rate(1)
+, _currentRate(1)
+, _inputSampleTime(0)
+// ----------------------------------------------------------
+{
+	resizeInputs(1);
+	_rates.assign(kMaxFramesPerSlice, 1);
+	_inputChannels.resize(channels);
+	_outputChannels.resize(channels);
+	
+	_inputSamples = (AudioUnitSampleType *)calloc(channels * kMaxFramesPerSlice, sizeof(AudioUnitSampleType));
+	
+	size_t listSize = offsetof(AudioBufferList, mBuffers[0]) + channels * sizeof(AudioBuffer);
+	_inputBuffer = (AudioBufferList *)malloc(listSize);
+	_inputBuffer->mNumberBuffers = channels;
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitResamplerNode::~ofxAudioUnitResamplerNode()
+// ----------------------------------------------------------
+{
+	detachNode();
+	
+	OFXAU_REALTIME_LOCK(_renderMutex);
+	free(_inputBuffer);
+	free(_inputSamples);
+	_inputBuffer  = NULL;
+	_inputSamples = NULL;
+	_renderMutex.unlock();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitResamplerNode::setRate(float rate)
+// ----------------------------------------------------------
+{
+	_rate = max(kMinResampleRate, min(rate, kMaxResampleRate));
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitResamplerNode::setQuality(ofxAudioUnitResamplerQuality quality)
+// ----------------------------------------------------------
+{
+	OFXAU_REALTIME_LOCK(_renderMutex);
+	_resampler.setQuality(quality);
+	_renderMutex.unlock();
+}
+
+// ----------------------------------------------------------
+OSStatus ofxAudioUnitResamplerNode::renderNode(AudioUnitRenderActionFlags *ioActionFlags,
+											   const AudioTimeStamp *inTimeStamp,
+											   UInt32 inNumberFrames,
+											   AudioBufferList *ioData)
+// ----------------------------------------------------------
+{
+	if(!isInputConnected(0))
+	{
+		for(int i = 0; i < ioData->mNumberBuffers; i++)
+		{
+			vDSP_vclr((AudioUnitSampleType *)ioData->mBuffers[i].mData, 1, inNumberFrames);
+		}
+		*ioActionFlags |= kAudioUnitRenderAction_OutputIsSilence;
+		return noErr;
+	}
+	
+	// ramping from the last buffer's rate to the current one
+	const float targetRate = _rate;
+	const float * rates = NULL;
+	
+	if(targetRate != _currentRate)
+	{
+		float step = (targetRate - _currentRate) / inNumberFrames;
+		float start = _currentRate + step;
+		vDSP_vramp(&start, &step, &_rates[0], 1, inNumberFrames);
+		rates = &_rates[0];
+		_currentRate = targetRate;
+	}
+	
+	UInt32 framesNeeded = rates ?
+		_resampler.getInputFramesNeeded(inNumberFrames, rates) :
+		_resampler.getInputFramesNeeded(inNumberFrames, targetRate);
+	
+	// pulling as much input as this buffer needs, which may take several
+	// slices when speeding up. The input gets its own continuous timeline
+	const UInt32 channels = _resampler.getChannels();
+	float ** inputChannels = &_inputChannels[0];
+	
+	while(framesNeeded > 0)
+	{
+		const UInt32 frames = min(framesNeeded, (UInt32)kMaxFramesPerSlice);
+		
+		for(int c = 0; c < channels; c++)
+		{
+			inputChannels[c] = _inputSamples + c * kMaxFramesPerSlice;
+			_inputBuffer->mBuffers[c].mNumberChannels = 1;
+			_inputBuffer->mBuffers[c].mData           = inputChannels[c];
+			_inputBuffer->mBuffers[c].mDataByteSize   = frames * sizeof(AudioUnitSampleType);
+		}
+		
+		AudioTimeStamp inputTimeStamp = *inTimeStamp;
+		inputTimeStamp.mSampleTime = _inputSampleTime;
+		inputTimeStamp.mFlags |= kAudioTimeStampSampleTimeValid;
+		
+		AudioUnitRenderActionFlags inputFlags = 0;
+		OSStatus s = pullInput(0, &inputFlags, &inputTimeStamp, frames, _inputBuffer);
+		if(s != noErr)
+		{
+			for(int c = 0; c < channels; c++) vDSP_vclr(inputChannels[c], 1, frames);
+		}
+		
+		_resampler.write(inputChannels, frames);
+		_inputSampleTime += frames;
+		framesNeeded -= frames;
+	}
+	
+	const UInt32 outputCount = min((UInt32)ioData->mNumberBuffers, channels);
+	float ** outputChannels = &_outputChannels[0];
+	for(int c = 0; c < channels; c++)
+	{
+		outputChannels[c] = (float *)ioData->mBuffers[min((UInt32)c, outputCount - 1)].mData;
+	}
+	
+	if(rates) _resampler.process(outputChannels, inNumberFrames, rates);
+	else      _resampler.process(outputChannels, inNumberFrames, targetRate);
+	
+	return noErr;
+}
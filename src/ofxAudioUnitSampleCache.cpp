@@ -0,0 +1,286 @@
+#include "ofxAudioUnitSampleCache.h"
+#include "ofxAudioUnitUtils.h"
+#include "ofxAudioUnitDecodeCache.h"
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <iostream>
+
+using namespace std;
+
+// how many frames are decoded per read from the file
+static const UInt32 kSampleCacheChunkFrames = 16384;
+
+// how often a load waiting for another thread's decode of the same file
+// checks whether it's done
+static const useconds_t kPendingIntervalMicroseconds = 5000;
+
+// ----------------------------------------------------------
+bool ofxAudioUnitSampleBuffer::load(const std::string &filePath, Float64 sampleRate)
+// ----------------------------------------------------------
+{
+	const std::string sourcePath = ofxAudioUnitDecodeCache::shared().resolve(filePath);
+	
+	CFURLRef fileURL;
+	fileURL = CFURLCreateFromFileSystemRepresentation(kCFAllocatorDefault,
+	                                                  (const UInt8 *)sourcePath.c_str(),
+	                                                  sourcePath.length(),
+	                                                  NULL);
+	
+	ExtAudioFileRef file = NULL;
+	OSStatus s = ExtAudioFileOpenURL(fileURL, &file);
+	CFRelease(fileURL);
+	
+	if(s != noErr)
+	{
+		cout << "Error " << s << " while opening file at " << filePath << endl;
+		return false;
+	}
+	
+	AudioStreamBasicDescription fileFormat = {0};
+	UInt32 dataSize = sizeof(fileFormat);
+	s = ExtAudioFileGetProperty(file, kExtAudioFileProperty_FileDataFormat, &dataSize, &fileFormat);
+	
+	AudioStreamBasicDescription clientFormat = {0};
+	clientFormat.mSampleRate       = sampleRate;
+	clientFormat.mFormatID         = kAudioFormatLinearPCM;
+	clientFormat.mFormatFlags      = kAudioFormatFlagsNativeFloatPacked | kAudioFormatFlagIsNonInterleaved;
+	clientFormat.mBitsPerChannel   = sizeof(AudioUnitSampleType) * 8;
+	clientFormat.mChannelsPerFrame = fileFormat.mChannelsPerFrame;
+	clientFormat.mFramesPerPacket  = 1;
+	clientFormat.mBytesPerFrame    = sizeof(AudioUnitSampleType);
+	clientFormat.mBytesPerPacket   = sizeof(AudioUnitSampleType);
+	
+	if(s == noErr)
+	{
+		s = ExtAudioFileSetProperty(file, kExtAudioFileProperty_ClientDataFormat, sizeof(clientFormat), &clientFormat);
+	}
+	
+	SInt64 fileFrames = 0;
+	if(s == noErr)
+	{
+		dataSize = sizeof(fileFrames);
+		s = ExtAudioFileGetProperty(file, kExtAudioFileProperty_FileLengthFrames, &dataSize, &fileFrames);
+	}
+	
+	if(s != noErr || fileFormat.mChannelsPerFrame == 0)
+	{
+		cout << "Error " << s << " while reading audio from file at " << filePath << endl;
+		ExtAudioFileDispose(file);
+		return false;
+	}
+	
+	// Decoding straight into the buffer, with room for each channel to
+	// hold the estimated length plus a read's worth. The length after
+	// resampling is only an estimate, so if the file turns out longer
+	// the channels are spread further apart
+	const UInt32 channels = fileFormat.mChannelsPerFrame;
+	UInt32 capacity = fileFrames * sampleRate / fileFormat.mSampleRate + kSampleCacheChunkFrames;
+	_samples.assign(channels * capacity, 0);
+	
+	size_t listSize = offsetof(AudioBufferList, mBuffers[0]) + channels * sizeof(AudioBuffer);
+	AudioBufferList * bufferList = (AudioBufferList *)malloc(listSize);
+	bufferList->mNumberBuffers = channels;
+	
+	UInt32 frames = 0;
+	while(true)
+	{
+		if(capacity - frames < kSampleCacheChunkFrames)
+		{
+			const UInt32 grownCapacity = capacity * 2;
+			std::vector<AudioUnitSampleType> grown(channels * grownCapacity);
+			for(int c = 0; c < channels; c++)
+			{
+				memcpy(&grown[c * grownCapacity], &_samples[c * capacity], frames * sizeof(AudioUnitSampleType));
+			}
+			_samples.swap(grown);
+			capacity = grownCapacity;
+		}
+		
+		for(int c = 0; c < channels; c++)
+		{
+			bufferList->mBuffers[c].mNumberChannels = 1;
+			bufferList->mBuffers[c].mData           = &_samples[c * capacity + frames];
+			bufferList->mBuffers[c].mDataByteSize   = kSampleCacheChunkFrames * sizeof(AudioUnitSampleType);
+		}
+		
+		UInt32 framesRead = kSampleCacheChunkFrames;
+		s = ExtAudioFileRead(file, &framesRead, bufferList);
+		if(s != noErr || framesRead == 0) break;
+		frames += framesRead;
+	}
+	
+	free(bufferList);
+	ExtAudioFileDispose(file);
+	
+	if(s != noErr)
+	{
+		cout << "Error " << s << " while decoding file at " << filePath << endl;
+		_samples.clear();
+		return false;
+	}
+	
+	// closing up the gaps after each channel. Every channel moves down
+	// (or stays put), so going from the first keeps the rest intact
+	for(int c = 1; c < channels; c++)
+	{
+		memmove(&_samples[c * frames], &_samples[c * capacity], frames * sizeof(AudioUnitSampleType));
+	}
+	
+	_channels   = channels;
+	_frames     = frames;
+	_sampleRate = sampleRate;
+	_samples.resize(channels * frames);
+	
+	return true;
+}
+
+#pragma mark - ofxAudioUnitSampleCache
+
+// ----------------------------------------------------------
+ofxAudioUnitSampleCache& ofxAudioUnitSampleCache::shared()
+// ----------------------------------------------------------
+{
+	static ofxAudioUnitSampleCache cache;
+	return cache;
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitSampleCache::ofxAudioUnitSampleCache()
+: _memoryBudget(256 * 1024 * 1024)
+, _memoryUsage(0)
+, _useClock(0)
+// ----------------------------------------------------------
+{
+
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitSampleBufferRef ofxAudioUnitSampleCache::load(const std::string &filePath, Float64 sampleRate)
+// ----------------------------------------------------------
+{
+	struct stat fileStat;
+	if(stat(filePath.c_str(), &fileStat) != 0)
+	{
+		cout << "Couldn't find a file at " << filePath << endl;
+		return ofxAudioUnitSampleBufferRef();
+	}
+	
+	// a file decoded at each rate it's asked for is a separate entry
+	char rateSuffix[32];
+	snprintf(rateSuffix, sizeof(rateSuffix), "@%g", sampleRate);
+	const std::string key = filePath + rateSuffix;
+	
+	// waiting for the file if another thread is already decoding it, or
+	// claiming it so that nobody else does. If that other decode fails,
+	// the next one to get here tries again
+	bool claimed = false;
+	while(!claimed)
+	{
+		OFXAU_REALTIME_LOCK(_mutex);
+		{
+			std::map<std::string, Entry>::iterator it = _entries.find(key);
+			if(it != _entries.end() && it->second.modified == fileStat.st_mtime)
+			{
+				it->second.lastUsed = ++_useClock;
+				ofxAudioUnitSampleBufferRef buffer = it->second.buffer;
+				_mutex.unlock();
+				return buffer;
+			}
+			
+			claimed = _pending.insert(key).second;
+		}
+		_mutex.unlock();
+		
+		if(!claimed) usleep(kPendingIntervalMicroseconds);
+	}
+	
+	// decoding happens outside the lock so that other files can be
+	// loaded at the same time
+	ofPtr<ofxAudioUnitSampleBuffer> decoded(new ofxAudioUnitSampleBuffer);
+	const bool loaded = decoded->load(filePath, sampleRate);
+	
+	ofxAudioUnitSampleBufferRef buffer;
+	
+	OFXAU_REALTIME_LOCK(_mutex);
+	{
+		_pending.erase(key);
+		
+		if(loaded)
+		{
+			std::map<std::string, Entry>::iterator it = _entries.find(key);
+			if(it != _entries.end()) erase(it);
+			
+			Entry &entry   = _entries[key];
+			entry.buffer   = decoded;
+			entry.modified = fileStat.st_mtime;
+			entry.lastUsed = ++_useClock;
+			_memoryUsage  += decoded->getSizeInBytes();
+			buffer = decoded;
+			
+			trim(_memoryBudget);
+		}
+	}
+	_mutex.unlock();
+	
+	return buffer;
+}
+
+#pragma mark - Memory
+
+// ----------------------------------------------------------
+void ofxAudioUnitSampleCache::setMemoryBudget(size_t bytes)
+// ----------------------------------------------------------
+{
+	OFXAU_REALTIME_LOCK(_mutex);
+	_memoryBudget = bytes;
+	trim(_memoryBudget);
+	_mutex.unlock();
+}
+
+// ----------------------------------------------------------
+size_t ofxAudioUnitSampleCache::getMemoryUsage()
+// ----------------------------------------------------------
+{
+	OFXAU_REALTIME_LOCK(_mutex);
+	size_t usage = _memoryUsage;
+	_mutex.unlock();
+	return usage;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitSampleCache::purge()
+// ----------------------------------------------------------
+{
+	OFXAU_REALTIME_LOCK(_mutex);
+	trim(0);
+	_mutex.unlock();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitSampleCache::erase(std::map<std::string, Entry>::iterator entry)
+// ----------------------------------------------------------
+{
+	_memoryUsage -= entry->second.buffer->getSizeInBytes();
+	_entries.erase(entry);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitSampleCache::trim(size_t budget)
+// ----------------------------------------------------------
+{
+	while(_memoryUsage > budget)
+	{
+		// the least recently used buffer that only the cache is holding
+		std::map<std::string, Entry>::iterator oldest = _entries.end();
+		std::map<std::string, Entry>::iterator it;
+		for(it = _entries.begin(); it != _entries.end(); ++it)
+		{
+			if(it->second.buffer.use_count() > 1) continue;
+			if(oldest == _entries.end() || it->second.lastUsed < oldest->second.lastUsed) oldest = it;
+		}
+		
+		if(oldest == _entries.end()) return;
+		erase(oldest);
+	}
+}
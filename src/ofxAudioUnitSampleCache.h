@@ -0,0 +1,92 @@
+#pragma once
+
+#include <AudioToolbox/AudioToolbox.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include "ofTypes.h"
+
+// ofxAudioUnitSampleBuffer is a whole audio file, decoded to
+// non-interleaved float at the rate of the nodes that will play it
+// (44.1kHz unless a node's format has been changed). Buffers handed out
+// by ofxAudioUnitSampleCache are shared and must not be modified.
+
+class ofxAudioUnitSampleBuffer
+{
+public:
+	ofxAudioUnitSampleBuffer() : _channels(0), _frames(0), _sampleRate(0) {}
+	
+	UInt32 getChannels() const {return _channels;}
+	UInt32 getFrames() const {return _frames;}
+	Float64 getSampleRate() const {return _sampleRate;}
+	size_t getSizeInBytes() const {return _samples.size() * sizeof(AudioUnitSampleType);}
+	
+	const AudioUnitSampleType * getChannel(UInt32 channel) const
+	{
+		return &_samples[channel * _frames];
+	}
+	
+	bool load(const std::string &filePath, Float64 sampleRate = 44100);
+
+private:
+	std::vector<AudioUnitSampleType> _samples;
+	UInt32 _channels;
+	UInt32 _frames;
+	Float64 _sampleRate;
+};
+
+typedef ofPtr<const ofxAudioUnitSampleBuffer> ofxAudioUnitSampleBufferRef;
+
+// ofxAudioUnitSampleCache keeps decoded files in memory so that any
+// number of players can share them. Files are keyed by their path and
+// modification time, so a file that changes on disk is decoded again
+// the next time it's asked for. A file asked for at two sample rates is
+// decoded (and stored) once at each. A file is only ever decoded by one
+// thread at a time: loading a file that another thread is decoding
+// waits for that decode and shares its buffer.
+
+// Buffers are reference counted. A buffer stays in memory as long as
+// anything holds a reference to it, even if it's over the memory
+// budget. Once the total size of the cache goes over budget, the
+// least recently requested buffers that nobody is holding are dropped.
+
+// The cache is safe to use from any non-render thread.
+
+class ofxAudioUnitSampleCache
+{
+public:
+	static ofxAudioUnitSampleCache& shared();
+	
+	// returns a null reference if the file couldn't be decoded
+	ofxAudioUnitSampleBufferRef load(const std::string &filePath, Float64 sampleRate = 44100);
+	
+	void   setMemoryBudget(size_t bytes);
+	size_t getMemoryBudget() const {return _memoryBudget;}
+	size_t getMemoryUsage();
+	
+	// drops every buffer nobody is holding
+	void   purge();
+
+private:
+	struct Entry
+	{
+		ofxAudioUnitSampleBufferRef buffer;
+		time_t modified;
+		uint64_t lastUsed;
+	};
+	
+	std::map<std::string, Entry> _entries;
+	std::set<std::string> _pending;
+	size_t   _memoryBudget;
+	size_t   _memoryUsage;
+	uint64_t _useClock;
+	ofMutex  _mutex;
+	
+	ofxAudioUnitSampleCache();
+	ofxAudioUnitSampleCache(const ofxAudioUnitSampleCache &orig);
+	ofxAudioUnitSampleCache& operator=(const ofxAudioUnitSampleCache &orig);
+	
+	void erase(std::map<std::string, Entry>::iterator entry);
+	void trim(size_t budget);
+};
@@ -0,0 +1,216 @@
+#include "ofxAudioUnit.h"
+#include <Accelerate/Accelerate.h>
+
+// ----------------------------------------------------------
+ofxAudioUnitSamplePlayer::ofxAudioUnitSamplePlayer()
+: ofxAudioUnitNativeNode(2)
+, _position(0)
+, _loopsRemaining(0)
+, _startTime(0)
+, _playing(false)
+, _loopStart(0)
+, _loopEnd(0)
+, _loopCrossfade(0)
+// ----------------------------------------------------------
+{
+	_fadeRamp.resize(kMaxFramesPerSlice);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitSamplePlayer::~ofxAudioUnitSamplePlayer()
+// ----------------------------------------------------------
+{
+	detachNode();
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitSamplePlayer::setFile(const std::string &filePath)
+// ----------------------------------------------------------
+{
+	ofxAudioUnitSampleBufferRef sample = ofxAudioUnitSampleCache::shared().load(filePath, getNodeSampleRate());
+	if(!sample) return false;
+	
+	setSample(sample);
+	return true;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitSamplePlayer::setSample(ofxAudioUnitSampleBufferRef sample)
+// ----------------------------------------------------------
+{
+	// samples are played a frame per frame, so one decoded at another
+	// rate plays at the wrong speed and pitch
+	if(sample && sample->getSampleRate() != getNodeSampleRate())
+	{
+		cout << "ofxAudioUnitSamplePlayer was given a sample decoded at " << sample->getSampleRate()
+		     << "Hz to play at " << getNodeSampleRate() << "Hz" << endl;
+	}
+	
+	// swapping under the lock means the previous sample is released here
+	// rather than on the render thread
+	OFXAU_REALTIME_LOCK(_renderMutex);
+	{
+		_playing  = false;
+		_position = 0;
+		_sample.swap(sample);
+	}
+	_renderMutex.unlock();
+}
+
+// ----------------------------------------------------------
+UInt32 ofxAudioUnitSamplePlayer::getLength() const
+// ----------------------------------------------------------
+{
+	return _sample ? _sample->getFrames() : 0;
+}
+
+#pragma mark - Playback
+
+// ----------------------------------------------------------
+void ofxAudioUnitSamplePlayer::play(uint64_t startTime)
+// ----------------------------------------------------------
+{
+	loop(0, startTime);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitSamplePlayer::loop(unsigned int timesToLoop, uint64_t startTime)
+// ----------------------------------------------------------
+{
+	if(!_sample)
+	{
+		cout << "ofxAudioUnitSamplePlayer has no file to play" << endl;
+		return;
+	}
+	
+	OFXAU_REALTIME_LOCK(_renderMutex);
+	{
+		_position       = 0;
+		_loopsRemaining = timesToLoop;
+		_startTime      = startTime;
+		_playing        = true;
+	}
+	_renderMutex.unlock();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitSamplePlayer::stop()
+// ----------------------------------------------------------
+{
+	_playing = false;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitSamplePlayer::setLoopPoints(UInt32 loopStart, UInt32 loopEnd)
+// ----------------------------------------------------------
+{
+	// the render thread checks the points against each other (and the
+	// sample) every buffer, so they don't have to change together
+	_loopStart = loopStart;
+	_loopEnd   = loopEnd;
+}
+
+#pragma mark - Rendering
+
+// ----------------------------------------------------------
+OSStatus ofxAudioUnitSamplePlayer::renderNode(AudioUnitRenderActionFlags *ioActionFlags,
+											  const AudioTimeStamp *inTimeStamp,
+											  UInt32 inNumberFrames,
+											  AudioBufferList *ioData)
+// ----------------------------------------------------------
+{
+	const UInt32 outputCount = min((UInt32)ioData->mNumberBuffers, _outputChannels);
+	UInt32 framesWritten = 0;
+	
+	// waiting for a scheduled start, which may fall part way through
+	// this buffer
+	if(_playing && _startTime)
+	{
+		framesWritten = min(framesUntilHostTime(_startTime, inTimeStamp), inNumberFrames);
+		if(framesWritten < inNumberFrames) _startTime = 0;
+		
+		for(int i = 0; i < outputCount; i++)
+		{
+			vDSP_vclr((AudioUnitSampleType *)ioData->mBuffers[i].mData, 1, framesWritten);
+		}
+	}
+	
+	const UInt32 startFrame = framesWritten;
+	
+	if(_playing && !_startTime && _sample && _sample->getFrames() > 0)
+	{
+		const ofxAudioUnitSampleBuffer &sample = *_sample;
+		
+		// the loop the user asked for, made to fit the sample. The
+		// crossfade blends the end of the loop with the frames leading up
+		// to the loop start (or following it, if there aren't enough),
+		// and playback carries on from where that material ends
+		const UInt32 loopEnd   = (_loopEnd == 0 || _loopEnd > sample.getFrames()) ? sample.getFrames() : _loopEnd;
+		const UInt32 loopStart = min((UInt32)_loopStart, loopEnd - 1);
+		const UInt32 crossfade = min((UInt32)_loopCrossfade, (loopEnd - loopStart) / 2);
+		const UInt32 fadeFrom  = loopStart >= crossfade ? loopStart - crossfade : loopStart;
+		
+		while(framesWritten < inNumberFrames)
+		{
+			const bool   looping = _loopsRemaining != 0;
+			const UInt32 end     = looping ? loopEnd : sample.getFrames();
+			
+			if(_position >= end)
+			{
+				if(!looping)
+				{
+					_playing = false;
+					break;
+				}
+				
+				if(_loopsRemaining > 0) _loopsRemaining--;
+				_position = fadeFrom + crossfade;
+				continue;
+			}
+			
+			const UInt32 fadeStart = looping ? end - crossfade : end;
+			const bool   fading    = _position >= fadeStart;
+			const UInt32 frames    = min(inNumberFrames - framesWritten, (fading ? end : fadeStart) - _position);
+			
+			if(fading)
+			{
+				float rampStart = (_position - fadeStart + 0.5f) / crossfade;
+				float rampStep  = 1.f / crossfade;
+				vDSP_vramp(&rampStart, &rampStep, &_fadeRamp[0], 1, frames);
+			}
+			
+			// mono samples play out of both sides
+			for(int i = 0; i < outputCount; i++)
+			{
+				const AudioUnitSampleType * in = sample.getChannel(min((UInt32)i, sample.getChannels() - 1));
+				AudioUnitSampleType * out = (AudioUnitSampleType *)ioData->mBuffers[i].mData + framesWritten;
+				
+				if(fading)
+				{
+					// out = tail + ramp * (head - tail)
+					const AudioUnitSampleType * tail = in + _position;
+					const AudioUnitSampleType * head = in + fadeFrom + (_position - fadeStart);
+					vDSP_vsub(tail, 1, head, 1, out, 1, frames);
+					vDSP_vma(&_fadeRamp[0], 1, out, 1, tail, 1, out, 1, frames);
+				}
+				else
+				{
+					memcpy(out, in + _position, frames * sizeof(AudioUnitSampleType));
+				}
+			}
+			
+			_position     += frames;
+			framesWritten += frames;
+		}
+	}
+	
+	for(int i = 0; i < outputCount; i++)
+	{
+		AudioUnitSampleType * out = (AudioUnitSampleType *)ioData->mBuffers[i].mData;
+		vDSP_vclr(out + framesWritten, 1, inNumberFrames - framesWritten);
+	}
+	
+	if(framesWritten == startFrame) *ioActionFlags |= kAudioUnitRenderAction_OutputIsSilence;
+	
+	return noErr;
+}
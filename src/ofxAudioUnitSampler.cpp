@@ -1,4 +1,116 @@
 #include "ofxAudioUnit.h"
+#include "ofxAudioUnitThreadPool.h"
+#include <libkern/OSAtomic.h>
+
+// how many scheduled events can be waiting to be sent at once
+static const unsigned int kScheduledEventCapacity = 1024;
+
+// Scheduled events are pushed onto a lock-free queue by the app, and a
+// pre-render notification moves them into a list of pending events that
+// only the render thread touches. Each buffer, the events due in it are
+// sent to the unit in time order, each at its sample offset. The
+// scheduler is shared by copies of a sampler that share its unit.
+
+struct ofxAudioUnitSampler::Scheduler
+{
+	struct Event
+	{
+		uint64_t hostTime;
+		UInt32   frames;    // after hostTime
+		UInt32   status;
+		UInt32   data1;
+		UInt32   data2;
+		UInt32   offset;    // into the buffer it's sent in
+		int32_t  generation;
+	};
+	
+	AudioUnitRef unit;
+	ofxAudioUnitLockFreeFifo<Event> incoming;
+	ofMutex mutex;
+	volatile float sampleRate;
+	
+	// bumped by clearScheduledEvents(), so events from before then are
+	// dropped instead of sent
+	volatile int32_t generation;
+	
+	// render thread only
+	std::vector<Event> pending;
+	std::vector<Event> due;
+	UInt32 pendingCount;
+	
+	// producer side, for building batches
+	std::vector<Event> batch;
+	
+	Scheduler(AudioUnitRef schedulerUnit);
+	~Scheduler();
+	
+	bool schedule(uint64_t hostTime, const ofxAudioUnitMidiEvent * events, UInt32 count);
+	void updateSampleRate();
+	void attach();
+	void detach();
+	
+	static OSStatus renderNotify(void *inRefCon,
+	                             AudioUnitRenderActionFlags *ioActionFlags,
+	                             const AudioTimeStamp *inTimeStamp,
+	                             UInt32 inBusNumber,
+	                             UInt32 inNumberFrames,
+	                             AudioBufferList *ioData);
+};
+
+// setSamplesAsync() loads into a unit of its own, which Swap then puts in
+// place of the sampler's unit. The AudioUnit inside the sampler's shared
+// AudioUnitRef is replaced, so every copy of the sampler (and anything
+// that renders it through the ofxAudioUnit object, like a tap or a
+// native node) moves to the new unit. Units that were connected to with
+// kAudioUnitProperty_MakeConnection hold on to the old unit, so the
+// last of those is remembered and reconnected. The old unit is kept
+// until the next swap rather than disposed straight away, in case the
+// render thread is still in the middle of it.
+
+// The new unit is given the last bank and program messages before its
+// samples are loaded, so it ends up where setSamples() on the old unit
+// would have. Global parameters are copied over at the moment of the
+// swap. (Copying kAudioUnitProperty_ClassInfo instead would also copy
+// the old instrument, and reload its samples.)
+
+struct ofxAudioUnitSampler::Swap
+{
+	struct Job
+	{
+		ofPtr<Swap> swap;
+		std::vector<std::string> samplePaths;
+		LoadCompletionProc completion;
+		void * context;
+	};
+	
+	AudioUnitRef unit;
+	AudioComponentDescription desc;
+	ofPtr<Scheduler> scheduler;
+	ofMutex mutex;
+	volatile int32_t loading;
+	
+	AudioUnitRef destination;
+	int destinationBus;
+	int sourceBus;
+	AudioUnit retired;
+	
+	// the last bank and program messages sent
+	bool   bankSet;
+	UInt32 bankStatus;
+	UInt32 bankMSB;
+	UInt32 bankLSB;
+	bool   programSet;
+	UInt32 programStatus;
+	UInt32 program;
+	
+	Swap(AudioUnitRef swapUnit, const AudioComponentDescription &swapDesc, ofPtr<Scheduler> swapScheduler);
+	~Swap();
+	
+	void sendBankAndProgram(AudioUnit toUnit);
+	void swapIn(AudioUnit newUnit);
+	static void copyParameters(AudioUnit fromUnit, AudioUnit toUnit);
+	static void loadJob(void * context);
+};
 
 #if (MAC_OS_X_VERSION_10_7 || __IPHONE_5_0)
 
@@ -14,6 +126,7 @@ ofxAudioUnitSampler::ofxAudioUnitSampler()
 {
 	_desc = samplerDesc;
 	initUnit();
+	initShared();
 }
 
 // ----------------------------------------------------------
@@ -28,6 +141,7 @@ ofxAudioUnitSampler::ofxAudioUnitSampler(OSType type,
     _desc.componentFlags        = 0;
     _desc.componentFlagsMask    = 0;
     initUnit();
+	initShared();
 };
 
 // ----------------------------------------------------------
@@ -36,6 +150,7 @@ ofxAudioUnitSampler::ofxAudioUnitSampler(const ofxAudioUnitSampler &orig)
 {
 	_desc = orig._desc;
     initUnit();
+	initShared();
 }
 
 // ----------------------------------------------------------
@@ -46,63 +161,137 @@ ofxAudioUnitSampler& ofxAudioUnitSampler::operator=(const ofxAudioUnitSampler &o
 	
     _desc = orig._desc;
 	_unit = orig._unit;
+	_scheduler = orig._scheduler;
+	_swap = orig._swap;
 	
 	return *this;
 }
 
 
 // ----------------------------------------------------------
-bool ofxAudioUnitSampler::setSample(const std::string &samplePath)
+static OSStatus loadSamples(AudioUnit unit, const std::vector<std::string> &samplePaths)
 // ----------------------------------------------------------
 {
-	CFURLRef sampleURL[1] = {CFURLCreateFromFileSystemRepresentation(kCFAllocatorDefault,
-																	 (const UInt8 *)samplePath.c_str(),
-																	 samplePath.length(),
-																	 NULL)};
+	std::vector<CFURLRef> sampleURLs(samplePaths.size());
 	
-	CFArrayRef sample = CFArrayCreate(NULL, (const void **)&sampleURL, 1, &kCFTypeArrayCallBacks);
+	for(int i = 0; i < samplePaths.size(); i++)
+	{
+		sampleURLs[i] = CFURLCreateFromFileSystemRepresentation(kCFAllocatorDefault,
+																(const UInt8 *)samplePaths[i].c_str(),
+																samplePaths[i].length(),
+																NULL);
+	}
+	
+	CFArrayRef samples = CFArrayCreate(NULL,
+									   (const void **)(sampleURLs.empty() ? NULL : &sampleURLs[0]),
+									   sampleURLs.size(),
+									   &kCFTypeArrayCallBacks);
+	
+	OSStatus s = AudioUnitSetProperty(unit,
+									  kAUSamplerProperty_LoadAudioFiles,
+									  kAudioUnitScope_Global,
+									  0,
+									  &samples,
+									  sizeof(samples));
+	
+	for(int i = 0; i < sampleURLs.size(); i++) CFRelease(sampleURLs[i]);
+	
+	CFRelease(samples);
+	return s;
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitSampler::setSample(const std::string &samplePath)
+// ----------------------------------------------------------
+{
+	OFXAU_RET_BOOL(loadSamples(*_unit, std::vector<std::string>(1, samplePath)),
+				   "setting ofxAudioUnitSampler's source sample");
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitSampler::setSamples(const std::vector<std::string> &samplePaths)
+// ----------------------------------------------------------
+{
+	OFXAU_RET_BOOL(loadSamples(*_unit, samplePaths),
+				   "setting ofxAudioUnitSampler's source samples");
+}
 
-	OFXAU_PRINT(AudioUnitSetProperty(*_unit,
-									 kAUSamplerProperty_LoadAudioFiles,
-									 kAudioUnitScope_Global,
-									 0,
-									 &sample,
-									 sizeof(sample)),
-				"setting ofxAudioUnitSampler's source sample");
+// ----------------------------------------------------------
+bool ofxAudioUnitSampler::setSamplesAsync(const std::vector<std::string> &samplePaths,
+										  LoadCompletionProc completion,
+										  void * context)
+// ----------------------------------------------------------
+{
+	if(!OSAtomicCompareAndSwap32Barrier(0, 1, &_swap->loading))
+	{
+		cout << "ofxAudioUnitSampler is already loading samples" << endl;
+		return false;
+	}
 	
-	CFRelease(sample);
-	CFRelease(sampleURL[0]);
+	Swap::Job * job = new Swap::Job;
+	job->swap        = _swap;
+	job->samplePaths = samplePaths;
+	job->completion  = completion;
+	job->context     = context;
+	ofxAudioUnitThreadPool::shared().addJob(Swap::loadJob, job);
 	
 	return true;
 }
 
 // ----------------------------------------------------------
-bool ofxAudioUnitSampler::setSamples(const std::vector<std::string> &samplePaths)
+void ofxAudioUnitSampler::Swap::loadJob(void * context)
 // ----------------------------------------------------------
 {
-	CFURLRef sampleURLs[samplePaths.size()];
+	Job * job = static_cast<Job *>(context);
+	Swap &swap = *job->swap;
 	
-	for(int i = 0; i < samplePaths.size(); i++)
+	// the new unit renders in the same format as the one it replaces
+	AudioStreamBasicDescription format = {0};
+	UInt32 maxFrames = 0;
+	OFXAU_REALTIME_LOCK(swap.mutex);
 	{
-		sampleURLs[i] = CFURLCreateFromFileSystemRepresentation(kCFAllocatorDefault,
-																(const UInt8 *)samplePaths[i].c_str(),
-																samplePaths[i].length(),
-																NULL);
+		UInt32 dataSize = sizeof(format);
+		AudioUnitGetProperty(*swap.unit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, &format, &dataSize);
+		dataSize = sizeof(maxFrames);
+		AudioUnitGetProperty(*swap.unit, kAudioUnitProperty_MaximumFramesPerSlice, kAudioUnitScope_Global, 0, &maxFrames, &dataSize);
 	}
+	swap.mutex.unlock();
 	
-	CFArrayRef samples = CFArrayCreate(NULL, (const void **)&sampleURLs, samplePaths.size(), &kCFTypeArrayCallBacks);
+	AudioUnit unit = NULL;
+	AudioComponent component = AudioComponentFindNext(NULL, &swap.desc);
+	OSStatus s = component ? AudioComponentInstanceNew(component, &unit) : (OSStatus)kAudioUnitErr_InvalidParameter;
 	
-	OFXAU_PRINT(AudioUnitSetProperty(*_unit,
-									 kAUSamplerProperty_LoadAudioFiles,
-									 kAudioUnitScope_Global,
-									 0,
-									 &samples,
-									 sizeof(samples)),
-				"setting ofxAudioUnitSampler's source samples");
+	if(s == noErr && format.mSampleRate > 0)
+	{
+		s = AudioUnitSetProperty(unit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, &format, sizeof(format));
+	}
+	if(s == noErr && maxFrames > 0)
+	{
+		s = AudioUnitSetProperty(unit, kAudioUnitProperty_MaximumFramesPerSlice, kAudioUnitScope_Global, 0, &maxFrames, sizeof(maxFrames));
+	}
+	if(s == noErr) s = AudioUnitInitialize(unit);
+	if(s == noErr)
+	{
+		OFXAU_REALTIME_LOCK(swap.mutex);
+		swap.sendBankAndProgram(unit);
+		swap.mutex.unlock();
+		s = loadSamples(unit, job->samplePaths);
+	}
 	
-	for(int i = 0; i < samplePaths.size(); i++) CFRelease(sampleURLs[i]);
+	if(s == noErr)
+	{
+		swap.swapIn(unit);
+	}
+	else
+	{
+		OFXAU_PRINT(s, "loading ofxAudioUnitSampler's samples in the background");
+		if(unit) AudioComponentInstanceDispose(unit);
+	}
 	
-	CFRelease(samples);
+	OSAtomicCompareAndSwap32Barrier(1, 0, &swap.loading);
+	if(job->completion) job->completion(s == noErr, job->context);
+	
+	delete job;
 }
 
 #else
@@ -121,10 +310,14 @@ ofxAudioUnitSampler::ofxAudioUnitSampler()
 {
 	_desc = samplerDesc;
 	initUnit();
+	initShared();
 }
 
 bool ofxAudioUnitSampler::setSample(const std::string &samplePath){return false;}
 bool ofxAudioUnitSampler::setSamples(const std::vector<std::string> &samplePaths){return false;}
+bool ofxAudioUnitSampler::setSamplesAsync(const std::vector<std::string> &samplePaths,
+										  LoadCompletionProc completion,
+										  void * context){return false;}
 
 #endif // MAC_OS_X_VERSION_10_6
 
@@ -137,6 +330,14 @@ void ofxAudioUnitSampler::midiEvent(const UInt32 status, const UInt32 data1, con
 
 void ofxAudioUnitSampler::setBank(const UInt32 msb, const UInt32 lsb)
 {
+    // remembered so that a unit swapped in by setSamplesAsync() gets it too
+    OFXAU_REALTIME_LOCK(_swap->mutex);
+    _swap->bankSet    = true;
+    _swap->bankStatus = kMidiMessage_ControlChange << 4 | midiChannelInUse;
+    _swap->bankMSB    = msb;
+    _swap->bankLSB    = lsb;
+    _swap->mutex.unlock();
+
     MusicDeviceMIDIEvent(*_unit,
                          kMidiMessage_ControlChange << 4 | midiChannelInUse,
                          kMidiMessage_BankMSBControl, msb,
@@ -150,6 +351,12 @@ void ofxAudioUnitSampler::setBank(const UInt32 msb, const UInt32 lsb)
 
 void ofxAudioUnitSampler::setProgram(const UInt32 prog)
 {
+    OFXAU_REALTIME_LOCK(_swap->mutex);
+    _swap->programSet    = true;
+    _swap->programStatus = kMidiMessage_ProgramChange << 4 | midiChannelInUse;
+    _swap->program       = prog;
+    _swap->mutex.unlock();
+
     MusicDeviceMIDIEvent(*_unit,
                          kMidiMessage_ProgramChange << 4 | midiChannelInUse,
                          prog, 0,
@@ -190,3 +397,357 @@ void ofxAudioUnitSampler::setVolume(float volume)
 }
 
 
+
+#pragma mark - Shared state
+
+// ----------------------------------------------------------
+void ofxAudioUnitSampler::initShared()
+// ----------------------------------------------------------
+{
+	_scheduler = ofPtr<Scheduler>(new Scheduler(_unit));
+	_swap      = ofPtr<Swap>(new Swap(_unit, _desc, _scheduler));
+}
+
+#pragma mark - Background loading
+
+// ----------------------------------------------------------
+bool ofxAudioUnitSampler::isLoading() const
+// ----------------------------------------------------------
+{
+	OSMemoryBarrier();
+	return _swap->loading != 0;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitSampler::connectTo(ofxAudioUnit &otherUnit, int destinationBus, int sourceBus)
+// ----------------------------------------------------------
+{
+	ofxAudioUnit::connectTo(otherUnit, destinationBus, sourceBus);
+	
+	// native nodes pull from this object rather than from the unit, so
+	// they follow a swap without being reconnected
+	OFXAU_REALTIME_LOCK(_swap->mutex);
+	if(dynamic_cast<ofxAudioUnitNativeNode *>(&otherUnit))
+	{
+		_swap->destination.reset();
+	}
+	else
+	{
+		_swap->destination    = otherUnit.getUnit();
+		_swap->destinationBus = destinationBus;
+		_swap->sourceBus      = sourceBus;
+	}
+	_swap->mutex.unlock();
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitSampler::Swap::Swap(AudioUnitRef swapUnit, const AudioComponentDescription &swapDesc, ofPtr<Scheduler> swapScheduler)
+: unit(swapUnit)
+, desc(swapDesc)
+, scheduler(swapScheduler)
+, loading(0)
+, destinationBus(0)
+, sourceBus(0)
+, retired(NULL)
+, bankSet(false)
+, bankStatus(0)
+, bankMSB(0)
+, bankLSB(0)
+, programSet(false)
+, programStatus(0)
+, program(0)
+// ----------------------------------------------------------
+{
+
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitSampler::Swap::~Swap()
+// ----------------------------------------------------------
+{
+	if(retired)
+	{
+		AudioUnitUninitialize(retired);
+		AudioComponentInstanceDispose(retired);
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitSampler::Swap::sendBankAndProgram(AudioUnit toUnit)
+// ----------------------------------------------------------
+{
+	if(bankSet)
+	{
+		MusicDeviceMIDIEvent(toUnit, bankStatus, kMidiMessage_BankMSBControl, bankMSB, 0);
+		MusicDeviceMIDIEvent(toUnit, bankStatus, kMidiMessage_BankLSBControl, bankLSB, 0);
+	}
+	
+	if(programSet)
+	{
+		MusicDeviceMIDIEvent(toUnit, programStatus, program, 0, 0);
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitSampler::Swap::copyParameters(AudioUnit fromUnit, AudioUnit toUnit)
+// ----------------------------------------------------------
+{
+	UInt32 dataSize = 0;
+	if(AudioUnitGetPropertyInfo(fromUnit, kAudioUnitProperty_ParameterList, kAudioUnitScope_Global, 0, &dataSize, NULL) != noErr ||
+	   dataSize == 0)
+	{
+		return;
+	}
+	
+	std::vector<AudioUnitParameterID> parameters(dataSize / sizeof(AudioUnitParameterID));
+	OFXAU_RETURN(AudioUnitGetProperty(fromUnit, kAudioUnitProperty_ParameterList, kAudioUnitScope_Global, 0, &parameters[0], &dataSize),
+				 "getting ofxAudioUnitSampler's parameter list");
+	
+	for(int i = 0; i < parameters.size(); i++)
+	{
+		AudioUnitParameterValue value;
+		if(AudioUnitGetParameter(fromUnit, parameters[i], kAudioUnitScope_Global, 0, &value) == noErr)
+		{
+			AudioUnitSetParameter(toUnit, parameters[i], kAudioUnitScope_Global, 0, value, 0);
+		}
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitSampler::Swap::swapIn(AudioUnit newUnit)
+// ----------------------------------------------------------
+{
+	OFXAU_REALTIME_LOCK(mutex);
+	
+	AudioUnit oldUnit = *unit;
+	copyParameters(oldUnit, newUnit);
+	
+	// the scheduler's notification moves with the unit, and keeps any
+	// events that are still waiting
+	scheduler->detach();
+	*unit = newUnit;
+	OSMemoryBarrier();
+	scheduler->attach();
+	
+	if(destination)
+	{
+		AudioUnitConnection connection;
+		connection.sourceAudioUnit    = newUnit;
+		connection.sourceOutputNumber = sourceBus;
+		connection.destInputNumber    = destinationBus;
+		
+		OFXAU_PRINT(AudioUnitSetProperty(*destination,
+										 kAudioUnitProperty_MakeConnection,
+										 kAudioUnitScope_Input,
+										 destinationBus,
+										 &connection,
+										 sizeof(AudioUnitConnection)),
+					"reconnecting ofxAudioUnitSampler after loading");
+	}
+	
+	if(retired)
+	{
+		AudioUnitUninitialize(retired);
+		AudioComponentInstanceDispose(retired);
+	}
+	retired = oldUnit;
+	
+	mutex.unlock();
+}
+
+#pragma mark - Scheduling
+
+
+// ----------------------------------------------------------
+bool ofxAudioUnitSampler::scheduleMidiEvent(uint64_t hostTime, const UInt32 status, const UInt32 data1, const UInt32 data2)
+// ----------------------------------------------------------
+{
+	ofxAudioUnitMidiEvent event = {status, data1, data2, 0};
+	return _scheduler->schedule(hostTime, &event, 1);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitSampler::scheduleNoteOn(uint64_t hostTime, const UInt32 note, const UInt32 vel)
+// ----------------------------------------------------------
+{
+	return scheduleMidiEvent(hostTime, kMidiMessage_NoteOn << 4 | midiChannelInUse, note, vel);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitSampler::scheduleNoteOff(uint64_t hostTime, const UInt32 note, const UInt32 vel)
+// ----------------------------------------------------------
+{
+	return scheduleMidiEvent(hostTime, kMidiMessage_NoteOff << 4 | midiChannelInUse, note, vel);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitSampler::scheduleMidiEvents(uint64_t hostTime, const ofxAudioUnitMidiEvent * events, UInt32 count)
+// ----------------------------------------------------------
+{
+	return _scheduler->schedule(hostTime, events, count);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitSampler::clearScheduledEvents()
+// ----------------------------------------------------------
+{
+	OSAtomicIncrement32Barrier(&_scheduler->generation);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitSampler::Scheduler::Scheduler(AudioUnitRef schedulerUnit)
+: unit(schedulerUnit)
+, incoming(kScheduledEventCapacity)
+, sampleRate(44100)
+, generation(0)
+, pendingCount(0)
+// ----------------------------------------------------------
+{
+	pending.resize(kScheduledEventCapacity);
+	due.resize(kScheduledEventCapacity);
+	attach();
+}
+	
+// ----------------------------------------------------------
+ofxAudioUnitSampler::Scheduler::~Scheduler()
+// ----------------------------------------------------------
+{
+	detach();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitSampler::Scheduler::attach()
+// ----------------------------------------------------------
+{
+	OFXAU_PRINT(AudioUnitAddRenderNotify(*unit, renderNotify, this),
+	            "adding sampler scheduling notification");
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitSampler::Scheduler::detach()
+// ----------------------------------------------------------
+{
+	AudioUnitRemoveRenderNotify(*unit, renderNotify, this);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitSampler::Scheduler::schedule(uint64_t hostTime, const ofxAudioUnitMidiEvent * events, UInt32 count)
+// ----------------------------------------------------------
+{
+	if(count == 0) return true;
+	
+	// the queue only takes one producer at a time
+	OFXAU_REALTIME_LOCK(mutex);
+	
+	updateSampleRate();
+	
+	const int32_t currentGeneration = generation;
+	batch.resize(count);
+	for(int i = 0; i < count; i++)
+	{
+		Event &event = batch[i];
+		event.hostTime   = hostTime;
+		event.frames     = events[i].offset;
+		event.status     = events[i].status;
+		event.data1      = events[i].data1;
+		event.data2      = events[i].data2;
+		event.offset     = 0;
+		event.generation = currentGeneration;
+	}
+	
+	const bool queued = incoming.push(&batch[0], count);
+	mutex.unlock();
+	
+	if(!queued) cout << "ofxAudioUnitSampler has too many scheduled events, dropping " << count << endl;
+	return queued;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitSampler::Scheduler::updateSampleRate()
+// ----------------------------------------------------------
+{
+	AudioStreamBasicDescription format = {0};
+	UInt32 dataSize = sizeof(format);
+	if(AudioUnitGetProperty(*unit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, &format, &dataSize) == noErr &&
+	   format.mSampleRate > 0)
+	{
+		sampleRate = format.mSampleRate;
+	}
+}
+
+// ----------------------------------------------------------
+OSStatus ofxAudioUnitSampler::Scheduler::renderNotify(void *inRefCon,
+                                                      AudioUnitRenderActionFlags *ioActionFlags,
+                                                      const AudioTimeStamp *inTimeStamp,
+                                                      UInt32 inBusNumber,
+                                                      UInt32 inNumberFrames,
+                                                      AudioBufferList *ioData)
+// ----------------------------------------------------------
+{
+	if(!(*ioActionFlags & kAudioUnitRenderAction_PreRender)) return noErr;
+	
+	Scheduler * scheduler = static_cast<Scheduler *>(inRefCon);
+	const int32_t generation = scheduler->generation;
+	
+	// taking in newly scheduled events. Any that don't fit stay in the
+	// queue until there's room
+	Event event;
+	while(scheduler->pendingCount < scheduler->pending.size() && scheduler->incoming.pop(event))
+	{
+		scheduler->pending[scheduler->pendingCount++] = event;
+	}
+	
+	// splitting off the events due in this buffer, keeping the rest in
+	// the order they were scheduled
+	const bool timed = inTimeStamp->mFlags & kAudioTimeStampHostTimeValid;
+	const double sampleRate = scheduler->sampleRate;
+	UInt32 dueCount  = 0;
+	UInt32 keepCount = 0;
+	
+	for(int i = 0; i < scheduler->pendingCount; i++)
+	{
+		Event &pendingEvent = scheduler->pending[i];
+		if(pendingEvent.generation != generation) continue;
+		
+		// an event's frames count from its host time, so events scheduled
+		// for "now" are pinned to the first buffer that sees them
+		double frames = pendingEvent.frames;
+		if(timed)
+		{
+			if(pendingEvent.hostTime == 0) pendingEvent.hostTime = inTimeStamp->mHostTime;
+			
+			if(pendingEvent.hostTime >= inTimeStamp->mHostTime)
+				frames += ofxAudioUnitHostTimeToSeconds(pendingEvent.hostTime - inTimeStamp->mHostTime) * sampleRate + 0.5;
+			else
+				frames -= ofxAudioUnitHostTimeToSeconds(inTimeStamp->mHostTime - pendingEvent.hostTime) * sampleRate - 0.5;
+		}
+		
+		if(frames < inNumberFrames)
+		{
+			pendingEvent.offset = max(frames, 0.);
+			
+			// insertion sort by offset, stable so that events for the same
+			// sample go out in the order they were scheduled
+			UInt32 j = dueCount++;
+			while(j > 0 && scheduler->due[j - 1].offset > pendingEvent.offset)
+			{
+				scheduler->due[j] = scheduler->due[j - 1];
+				j--;
+			}
+			scheduler->due[j] = pendingEvent;
+		}
+		else
+		{
+			scheduler->pending[keepCount++] = pendingEvent;
+		}
+	}
+	scheduler->pendingCount = keepCount;
+	
+	for(int i = 0; i < dueCount; i++)
+	{
+		const Event &dueEvent = scheduler->due[i];
+		MusicDeviceMIDIEvent(*scheduler->unit, dueEvent.status, dueEvent.data1, dueEvent.data2, dueEvent.offset);
+	}
+	
+	return noErr;
+}
@@ -0,0 +1,105 @@
+#include "ofxAudioUnitServiceThread.h"
+#include <unistd.h>
+
+// how long the thread sleeps between passes over its clients
+static const int kServiceIntervalMS = 10;
+
+// how often removeClient() checks whether the client's callback is done
+static const useconds_t kRemovePollMicroseconds = 500;
+
+// ----------------------------------------------------------
+ofxAudioUnitServiceThread::ofxAudioUnitServiceThread()
+: _delivering(NULL, NULL)
+// ----------------------------------------------------------
+{
+
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitServiceThread& ofxAudioUnitServiceThread::shared()
+// ----------------------------------------------------------
+{
+	static ofxAudioUnitServiceThread thread;
+	return thread;
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitServiceThread& ofxAudioUnitServiceThread::dispatcher()
+// ----------------------------------------------------------
+{
+	static ofxAudioUnitServiceThread thread;
+	return thread;
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitServiceThread::~ofxAudioUnitServiceThread()
+// ----------------------------------------------------------
+{
+	if(isThreadRunning()) waitForThread(true);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitServiceThread::addClient(ServiceProc proc, void * context)
+// ----------------------------------------------------------
+{
+	lock();
+	_clients.insert(Client(proc, context));
+	if(!isThreadRunning()) startThread(true, false);
+	unlock();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitServiceThread::removeClient(ServiceProc proc, void * context)
+// ----------------------------------------------------------
+{
+	const Client client(proc, context);
+	
+	lock();
+	_clients.erase(client);
+	
+	// the callback may be running right now. Waiting for it on the service
+	// thread itself would never finish (that's a callback removing itself
+	// or another client), and isn't needed since nothing else is running
+	while(_delivering == client && !pthread_equal(pthread_self(), _serviceThread))
+	{
+		unlock();
+		usleep(kRemovePollMicroseconds);
+		lock();
+	}
+	unlock();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitServiceThread::threadedFunction()
+// ----------------------------------------------------------
+{
+	lock();
+	_serviceThread = pthread_self();
+	unlock();
+	
+	while(isThreadRunning())
+	{
+		// the callbacks are called without the lock, so that they can add
+		// and remove clients. A client removed during the pass is skipped
+		lock();
+		_pass.assign(_clients.begin(), _clients.end());
+		unlock();
+		
+		for(int i = 0; i < _pass.size(); i++)
+		{
+			lock();
+			const bool registered = _clients.count(_pass[i]) > 0;
+			if(registered) _delivering = _pass[i];
+			unlock();
+			
+			if(!registered) continue;
+			_pass[i].first(_pass[i].second);
+			
+			lock();
+			_delivering = Client(NULL, NULL);
+			unlock();
+		}
+		
+		sleep(kServiceIntervalMS);
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "ofThread.h"
+#include <pthread.h>
+#include <set>
+#include <utility>
+#include <vector>
+
+// ofxAudioUnitServiceThread is one background thread shared by every
+// object that needs regular housekeeping off the render thread, such as
+// refilling a streaming player's buffer or scheduling the next regions
+// of a file player's queue.
+
+// Clients register a callback, which is called every few milliseconds
+// until the client is removed. Callbacks are called without the thread's
+// lock held, so they may add or remove clients (including themselves).
+// Removing a client from another thread waits until the client's
+// callback isn't running, so it's never called after removeClient()
+// returns. Callbacks should not block, since they hold up every other
+// client.
+
+// dispatcher() is a second thread of the same kind, which delivers
+// events to app callbacks (see ofxAudioUnitEventQueue). Keeping app code
+// off the shared thread means a slow callback can't hold up refilling
+// the players' buffers.
+
+class ofxAudioUnitServiceThread : public ofThread
+{
+public:
+	typedef void (*ServiceProc)(void * context);
+	
+	static ofxAudioUnitServiceThread& shared();
+	static ofxAudioUnitServiceThread& dispatcher();
+	~ofxAudioUnitServiceThread();
+	
+	void addClient(ServiceProc proc, void * context);
+	void removeClient(ServiceProc proc, void * context);
+
+protected:
+	void threadedFunction();
+
+private:
+	typedef std::pair<ServiceProc, void *> Client;
+	std::set<Client> _clients;
+	
+	// service thread only
+	std::vector<Client> _pass;
+	pthread_t _serviceThread;
+	
+	// the client whose callback is running, if any (guarded by lock())
+	Client _delivering;
+	
+	ofxAudioUnitServiceThread();
+	ofxAudioUnitServiceThread(const ofxAudioUnitServiceThread &orig);
+	ofxAudioUnitServiceThread& operator=(const ofxAudioUnitServiceThread &orig);
+};
@@ -0,0 +1,436 @@
+#include "ofxAudioUnit.h"
+#include <Accelerate/Accelerate.h>
+#include <algorithm>
+#include <math.h>
+
+// the largest number of ambisonic channels, for third order
+static const unsigned int kMaxAmbisonicChannels = 16;
+
+static void sphericalHarmonics(float azimuth, float elevation, unsigned int channels, float * out);
+
+// ----------------------------------------------------------
+static float wrapDegrees(float degrees)
+// ----------------------------------------------------------
+{
+	degrees = fmodf(degrees, 360);
+	return degrees < 0 ? degrees + 360 : degrees;
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitSpatialPanner::ofxAudioUnitSpatialPanner(unsigned int sources,
+													 unsigned int speakers,
+													 unsigned int channelsPerSource)
+: ofxAudioUnitNativeNode(speakers)
+, _mode(OFX_AU_PAN_VBAP)
+, _channelsPerSource(channelsPerSource)
+// ----------------------------------------------------------
+{
+	resizeInputs(sources);
+	
+	Source source;
+	source.azimuth   = 0;
+	source.elevation = 0;
+	source.gain      = 1;
+	source.currentGains.assign(max(speakers, kMaxAmbisonicChannels), 0);
+	source.targetGains.assign(max(speakers, kMaxAmbisonicChannels), 0);
+	_sources.assign(sources, source);
+	
+	_sourceSamples = (AudioUnitSampleType *)calloc(sources * channelsPerSource * kMaxFramesPerSlice,
+												   sizeof(AudioUnitSampleType));
+	_ambisonicSamples = (AudioUnitSampleType *)calloc(kMaxAmbisonicChannels * kMaxFramesPerSlice,
+													  sizeof(AudioUnitSampleType));
+	
+	_sourceBuffers.resize(sources);
+	for(int i = 0; i < sources; i++)
+	{
+		size_t listSize = offsetof(AudioBufferList, mBuffers[0]) + channelsPerSource * sizeof(AudioBuffer);
+		_sourceBuffers[i] = (AudioBufferList *)malloc(listSize);
+		_sourceBuffers[i]->mNumberBuffers = channelsPerSource;
+	}
+	
+	// speakers default to an evenly spaced ring, starting straight ahead
+	std::vector<float> azimuths(speakers);
+	for(int i = 0; i < speakers; i++) azimuths[i] = i * 360.f / speakers;
+	setSpeakerPositions(azimuths);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitSpatialPanner::~ofxAudioUnitSpatialPanner()
+// ----------------------------------------------------------
+{
+	detachNode();
+	
+	OFXAU_REALTIME_LOCK(_renderMutex);
+	{
+		for(int i = 0; i < _sourceBuffers.size(); i++) free(_sourceBuffers[i]);
+		_sourceBuffers.clear();
+		free(_sourceSamples);
+		free(_ambisonicSamples);
+		_sourceSamples = _ambisonicSamples = NULL;
+	}
+	_renderMutex.unlock();
+}
+
+#pragma mark - Setup
+
+// ----------------------------------------------------------
+unsigned int ofxAudioUnitSpatialPanner::getInputBusCount() const
+// ----------------------------------------------------------
+{
+	return _inputs.size();
+}
+
+// ----------------------------------------------------------
+unsigned int ofxAudioUnitSpatialPanner::getSpeakerCount() const
+// ----------------------------------------------------------
+{
+	return _outputChannels;
+}
+
+// ----------------------------------------------------------
+unsigned int ofxAudioUnitSpatialPanner::getPannerChannelCount() const
+// ----------------------------------------------------------
+{
+	switch(_mode)
+	{
+		case OFX_AU_PAN_AMBISONIC_FIRST_ORDER: return 4;
+		case OFX_AU_PAN_AMBISONIC_THIRD_ORDER: return 16;
+		default:                               return _outputChannels;
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitSpatialPanner::setMode(ofxAudioUnitPanningMode mode)
+// ----------------------------------------------------------
+{
+	OFXAU_REALTIME_LOCK(_renderMutex);
+	{
+		_mode = mode;
+		buildDecodeMatrix();
+		resetSources();
+	}
+	_renderMutex.unlock();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitSpatialPanner::setSpeakerPositions(const std::vector<float> &azimuths,
+													const std::vector<float> &elevations)
+// ----------------------------------------------------------
+{
+	if(azimuths.size() != _outputChannels || (!elevations.empty() && elevations.size() != _outputChannels))
+	{
+		cout << "Spatial panner needs a position for each of its "
+		<< _outputChannels << " speakers" << endl;
+		return;
+	}
+	
+	OFXAU_REALTIME_LOCK(_renderMutex);
+	{
+		_speakerAzimuths = azimuths;
+		_speakerElevations = elevations.empty() ? std::vector<float>(_outputChannels, 0) : elevations;
+		buildVBAPTable();
+		buildDecodeMatrix();
+		resetSources();
+	}
+	_renderMutex.unlock();
+}
+
+#pragma mark - Sources
+
+// ----------------------------------------------------------
+void ofxAudioUnitSpatialPanner::setSourcePosition(float azimuth, float elevation, int source)
+// ----------------------------------------------------------
+{
+	if(source >= _sources.size()) return;
+	_sources[source].azimuth   = azimuth;
+	_sources[source].elevation = elevation;
+	computeTargetGains(_sources[source]);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitSpatialPanner::setSourceGain(float gain, int source)
+// ----------------------------------------------------------
+{
+	if(source >= _sources.size()) return;
+	_sources[source].gain = gain;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitSpatialPanner::computeTargetGains(Source &source)
+// ----------------------------------------------------------
+{
+	// the gains are worked out in full before being copied over, since
+	// the render thread may be reading them at the same time
+	std::vector<float> gains(source.targetGains.size(), 0);
+	
+	if(_mode == OFX_AU_PAN_VBAP)
+	{
+		const VBAPEntry &entry = _vbapTable[(int)roundf(wrapDegrees(source.azimuth)) % 360];
+		gains[entry.speakers[0]] += entry.gains[0];
+		gains[entry.speakers[1]] += entry.gains[1];
+	}
+	else
+	{
+		sphericalHarmonics(source.azimuth, source.elevation, getPannerChannelCount(), &gains[0]);
+	}
+	
+	for(int i = 0; i < gains.size(); i++) source.targetGains[i] = gains[i];
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitSpatialPanner::resetSources()
+// ----------------------------------------------------------
+{
+	// called with the render mutex held, after the mode or speakers
+	// change. There's nothing sensible to interpolate from, so sources
+	// jump straight to their new gains
+	for(int i = 0; i < _sources.size(); i++)
+	{
+		Source &source = _sources[i];
+		computeTargetGains(source);
+		for(int g = 0; g < source.targetGains.size(); g++)
+			source.currentGains[g] = source.targetGains[g] * source.gain;
+	}
+}
+
+#pragma mark - Gain tables
+
+// ----------------------------------------------------------
+void ofxAudioUnitSpatialPanner::buildVBAPTable()
+// ----------------------------------------------------------
+{
+	const unsigned int speakerCount = _speakerAzimuths.size();
+	
+	std::vector<std::pair<float, unsigned int> > sorted(speakerCount);
+	for(int i = 0; i < speakerCount; i++)
+		sorted[i] = std::make_pair(wrapDegrees(_speakerAzimuths[i]), (unsigned int)i);
+	std::sort(sorted.begin(), sorted.end());
+	
+	_vbapTable.resize(360);
+	
+	for(int degree = 0; degree < 360; degree++)
+	{
+		VBAPEntry &entry = _vbapTable[degree];
+		entry.speakers[0] = entry.speakers[1] = sorted[0].second;
+		entry.gains[0] = 1;
+		entry.gains[1] = 0;
+		if(speakerCount < 2) continue;
+		
+		// finding the pair of neighbouring speakers either side of this angle
+		for(int i = 0; i < speakerCount; i++)
+		{
+			const std::pair<float, unsigned int> &a = sorted[i];
+			const std::pair<float, unsigned int> &b = sorted[(i + 1) % speakerCount];
+			
+			float arc    = wrapDegrees(b.first - a.first);
+			float offset = wrapDegrees(degree - a.first);
+			if(arc == 0) arc = 360;
+			if(offset > arc) continue;
+			
+			const float p[2]  = {cosf(degree  * M_PI / 180), sinf(degree  * M_PI / 180)};
+			const float la[2] = {cosf(a.first * M_PI / 180), sinf(a.first * M_PI / 180)};
+			const float lb[2] = {cosf(b.first * M_PI / 180), sinf(b.first * M_PI / 180)};
+			
+			// solving p = ga * la + gb * lb
+			float det = la[0] * lb[1] - la[1] * lb[0];
+			float ga  = -1;
+			float gb  = -1;
+			if(fabsf(det) > 1e-4)
+			{
+				ga = (p[0] * lb[1] - p[1] * lb[0]) / det;
+				gb = (la[0] * p[1] - la[1] * p[0]) / det;
+			}
+			
+			// pairs 180 degrees or more apart can't be solved that way, so
+			// those fall back to an equal-power crossfade across the gap
+			if(ga < 0 || gb < 0)
+			{
+				float t = offset / arc;
+				ga = cosf(t * M_PI_2);
+				gb = sinf(t * M_PI_2);
+			}
+			
+			float norm = sqrtf(ga * ga + gb * gb);
+			entry.speakers[0] = a.second;
+			entry.speakers[1] = b.second;
+			entry.gains[0] = ga / norm;
+			entry.gains[1] = gb / norm;
+			break;
+		}
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitSpatialPanner::buildDecodeMatrix()
+// ----------------------------------------------------------
+{
+	// A projection decoder : each speaker takes the ambisonic mix sampled
+	// in its direction, with each order weighted by (2n + 1) so that the
+	// SN3D components sum back to a (band-limited) point source.
+	const unsigned int channels = getPannerChannelCount();
+	const unsigned int speakerCount = _speakerAzimuths.size();
+	
+	_decodeMatrix.assign(speakerCount * channels, 0);
+	if(_mode == OFX_AU_PAN_VBAP) return;
+	
+	float harmonics[kMaxAmbisonicChannels];
+	for(int speaker = 0; speaker < speakerCount; speaker++)
+	{
+		sphericalHarmonics(_speakerAzimuths[speaker], _speakerElevations[speaker], channels, harmonics);
+		for(int c = 0; c < channels; c++)
+		{
+			const int order = (int)sqrtf(c);
+			_decodeMatrix[speaker * channels + c] = (2 * order + 1) * harmonics[c] / speakerCount;
+		}
+	}
+}
+
+// ----------------------------------------------------------
+void sphericalHarmonics(float azimuth, float elevation, unsigned int channels, float * out)
+// ----------------------------------------------------------
+{
+	// real spherical harmonics up to third order, in ACN channel order
+	// with SN3D normalization (as used by AmbiX)
+	const float a  = azimuth   * M_PI / 180;
+	const float e  = elevation * M_PI / 180;
+	const float ce = cosf(e);
+	const float se = sinf(e);
+	
+	out[0] = 1;
+	if(channels < 4) return;
+	
+	out[1] = sinf(a) * ce;
+	out[2] = se;
+	out[3] = cosf(a) * ce;
+	if(channels < 16) return;
+	
+	const float ce2 = ce * ce;
+	const float ce3 = ce2 * ce;
+	const float se2 = se * se;
+	
+	out[4]  = sqrtf(3.f) / 2 * sinf(2 * a) * ce2;
+	out[5]  = sqrtf(3.f) / 2 * sinf(a) * sinf(2 * e);
+	out[6]  = (3 * se2 - 1) / 2;
+	out[7]  = sqrtf(3.f) / 2 * cosf(a) * sinf(2 * e);
+	out[8]  = sqrtf(3.f) / 2 * cosf(2 * a) * ce2;
+	
+	out[9]  = sqrtf(5.f / 8) * sinf(3 * a) * ce3;
+	out[10] = sqrtf(15.f) / 2 * sinf(2 * a) * se * ce2;
+	out[11] = sqrtf(3.f / 8) * sinf(a) * ce * (5 * se2 - 1);
+	out[12] = se * (5 * se2 - 3) / 2;
+	out[13] = sqrtf(3.f / 8) * cosf(a) * ce * (5 * se2 - 1);
+	out[14] = sqrtf(15.f) / 2 * cosf(2 * a) * se * ce2;
+	out[15] = sqrtf(5.f / 8) * cosf(3 * a) * ce3;
+}
+
+#pragma mark - Rendering
+
+// ----------------------------------------------------------
+OSStatus ofxAudioUnitSpatialPanner::renderNode(AudioUnitRenderActionFlags *ioActionFlags,
+											   const AudioTimeStamp *inTimeStamp,
+											   UInt32 inNumberFrames,
+											   AudioBufferList *ioData)
+// ----------------------------------------------------------
+{
+	const bool ambisonic = _mode != OFX_AU_PAN_VBAP;
+	const unsigned int pannerChannels = getPannerChannelCount();
+	const unsigned int speakerCount = min((UInt32)ioData->mNumberBuffers, _outputChannels);
+	const UInt32 channelBytes = inNumberFrames * sizeof(AudioUnitSampleType);
+	
+	// VBAP pans straight into the speaker outputs, ambisonic modes pan
+	// into the ambisonic mix which is decoded afterwards
+	if(!ambisonic && pannerChannels > speakerCount) return kAudioUnitErr_InvalidParameter;
+	
+	for(int c = 0; c < pannerChannels; c++)
+	{
+		AudioUnitSampleType * mix = ambisonic ?
+			_ambisonicSamples + c * kMaxFramesPerSlice :
+			(AudioUnitSampleType *)ioData->mBuffers[c].mData;
+		vDSP_vclr(mix, 1, inNumberFrames);
+	}
+	
+	bool anySourceRendered = false;
+	
+	for(int s = 0; s < _sources.size(); s++)
+	{
+		Source &source = _sources[s];
+		if(!isInputConnected(s)) continue;
+		
+		AudioBufferList * sourceBuffer = _sourceBuffers[s];
+		AudioUnitSampleType * samples = _sourceSamples + s * _channelsPerSource * kMaxFramesPerSlice;
+		for(int c = 0; c < _channelsPerSource; c++)
+		{
+			sourceBuffer->mBuffers[c].mNumberChannels = 1;
+			sourceBuffer->mBuffers[c].mData           = samples + c * kMaxFramesPerSlice;
+			sourceBuffer->mBuffers[c].mDataByteSize   = channelBytes;
+		}
+		
+		AudioUnitRenderActionFlags sourceFlags = 0;
+		OSStatus status = pullInput(s, &sourceFlags, inTimeStamp, inNumberFrames, sourceBuffer);
+		bool silent = status != noErr || (sourceFlags & kAudioUnitRenderAction_OutputIsSilence);
+		
+		const AudioUnitSampleType * mono = (const AudioUnitSampleType *)sourceBuffer->mBuffers[0].mData;
+		if(!silent && _channelsPerSource > 1)
+		{
+			AudioUnitSampleType * downmix = samples;
+			if(mono != downmix) memcpy(downmix, mono, channelBytes);
+			for(int c = 1; c < _channelsPerSource; c++)
+			{
+				vDSP_vadd(downmix, 1,
+						  (const AudioUnitSampleType *)sourceBuffer->mBuffers[c].mData, 1,
+						  downmix, 1,
+						  inNumberFrames);
+			}
+			float scale = 1.f / _channelsPerSource;
+			vDSP_vsmul(downmix, 1, &scale, downmix, 1, inNumberFrames);
+			mono = downmix;
+		}
+		
+		// ramping each gain from where it was last buffer to where it
+		// should be now
+		for(int c = 0; c < pannerChannels; c++)
+		{
+			float start = source.currentGains[c];
+			float end   = source.targetGains[c] * source.gain;
+			source.currentGains[c] = end;
+			
+			if(silent || (start == 0 && end == 0)) continue;
+			
+			AudioUnitSampleType * mix = ambisonic ?
+				_ambisonicSamples + c * kMaxFramesPerSlice :
+				(AudioUnitSampleType *)ioData->mBuffers[c].mData;
+			
+			if(start == end)
+			{
+				vDSP_vsma(mono, 1, &end, mix, 1, mix, 1, inNumberFrames);
+			}
+			else
+			{
+				float step = (end - start) / inNumberFrames;
+				vDSP_vrampmuladd(mono, 1, &start, &step, mix, 1, inNumberFrames);
+			}
+		}
+		
+		anySourceRendered = anySourceRendered || !silent;
+	}
+	
+	if(ambisonic)
+	{
+		for(int speaker = 0; speaker < speakerCount; speaker++)
+		{
+			AudioUnitSampleType * out = (AudioUnitSampleType *)ioData->mBuffers[speaker].mData;
+			vDSP_vclr(out, 1, inNumberFrames);
+			
+			for(int c = 0; c < pannerChannels; c++)
+			{
+				const float gain = _decodeMatrix[speaker * pannerChannels + c];
+				if(gain == 0) continue;
+				vDSP_vsma(_ambisonicSamples + c * kMaxFramesPerSlice, 1, &gain, out, 1, out, 1, inNumberFrames);
+			}
+		}
+	}
+	
+	if(!anySourceRendered) *ioActionFlags |= kAudioUnitRenderAction_OutputIsSilence;
+	
+	return noErr;
+}
@@ -0,0 +1,1021 @@
+#include "ofxAudioUnit.h"
+#include "ofxAudioUnitServiceThread.h"
+#include <Accelerate/Accelerate.h>
+#include <libkern/OSAtomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <math.h>
+
+// how many frames are decoded per read from the file
+static const UInt32 kDecodeChunkFrames = 4096;
+
+// how many frames a new stream needs before the render thread switches
+// to it. The rest of the ring is filled once it's playing
+static const UInt32 kPrimeFrames = 8192;
+
+// setRate() is clamped to this, so a buffer never reads more than this
+// many times its length from the ring
+static const float kMaxScrubRate = 8;
+
+// how many packets the service thread parses per pass while building a
+// file's seek index
+static const UInt32 kIndexPacketsPerPass = 512;
+
+// how many loop points can be waiting in the ring at once
+static const UInt32 kMaxPositionMarks = 64;
+
+static float unpackSample(const unsigned char * sample, UInt32 bytes, bool isFloat, bool bigEndian);
+static OSStatus setClientFormat(ExtAudioFileRef file, UInt32 channels, Float64 sampleRate);
+
+// ----------------------------------------------------------
+ofxAudioUnitStreamingFilePlayer::ofxAudioUnitStreamingFilePlayer()
+: ofxAudioUnitNativeNode(2)
+, _streamState(0)
+, _requestGeneration(0)
+, _startGeneration(0)
+, _extAudioFile(NULL)
+, _mappedFile(NULL)
+, _mappedFileSize(0)
+, _mappedAudio(NULL)
+, _fileChannels(0)
+, _fileLength(0)
+, _decodeRate(0)
+, _decodePosition(0)
+, _decodeStream(0)
+, _loopsRemaining(0)
+, _decodeBuffers(NULL)
+, _fadeSamples(2 * kDecodeChunkFrames)
+, _fadeRamp(kDecodeChunkFrames)
+, _loopStart(0)
+, _loopEnd(0)
+, _loopCrossfade(0)
+, _prefetchSeconds(2)
+, _startTime(0)
+, _rate(1)
+, _playing(false)
+, _underruns(0)
+, _indexFile(NULL)
+, _indexedPackets(0)
+, _indexBuilt(false)
+, _resampler(2, OFX_AU_RESAMPLE_CUBIC, (unsigned int)(kMaxFramesPerSlice * kMaxScrubRate))
+, _renderSamples(2 * kMaxFramesPerSlice)
+, _hasNextPositionMark(false)
+, _position(0)
+// ----------------------------------------------------------
+{
+	memset(&_fileFormat, 0, sizeof(_fileFormat));
+	
+	for(int i = 0; i < 2; i++)
+	{
+		_streams[i].ring.allocate(2, _prefetchSeconds * getNodeSampleRate());
+		_streams[i].positionMarks.setCapacity(kMaxPositionMarks);
+		_streams[i].generation    = 0;
+		_streams[i].startPosition = 0;
+		_streams[i].direction     = 1;
+		_streams[i].endOfStream   = true;
+	}
+	
+	_request.position    = 0;
+	_request.direction   = 1;
+	_request.timesToLoop = 0;
+	_request.restart     = false;
+	_request.pending     = false;
+	
+	_positionMark.ringFrame = 0;
+	_positionMark.position  = 0;
+	ofxAudioUnitServiceThread::shared().addClient(serviceStream, this);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitStreamingFilePlayer::~ofxAudioUnitStreamingFilePlayer()
+// ----------------------------------------------------------
+{
+	detachNode();
+	ofxAudioUnitServiceThread::shared().removeClient(serviceStream, this);
+	
+	OFXAU_REALTIME_LOCK(_streamMutex);
+	closeFile();
+	_streamMutex.unlock();
+}
+
+#pragma mark - Files
+
+// ----------------------------------------------------------
+bool ofxAudioUnitStreamingFilePlayer::setFile(const std::string &filePath)
+// ----------------------------------------------------------
+{
+	bool opened;
+	
+	// a decoded copy of a compressed file can be mapped rather than decoded
+	const std::string sourcePath = ofxAudioUnitDecodeCache::shared().resolve(filePath);
+	
+	OFXAU_REALTIME_LOCK(_streamMutex);
+	{
+		_playing = false;
+		closeFile();
+		_sourcePath = sourcePath;
+		opened = openFile(sourcePath);
+	}
+	_streamMutex.unlock();
+	
+	// whatever the render thread has left is from the old file, so a
+	// stream of the new one is primed from the start
+	OFXAU_REALTIME_LOCK(_requestMutex);
+	{
+		_request.restart = false;
+		requestStream(0);
+	}
+	_requestMutex.unlock();
+	_position = 0;
+	
+	if(opened) _overview.setFile(filePath);
+	else       _overview.clear();
+	
+	return opened;
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitStreamingFilePlayer::openFile(const std::string &filePath)
+// ----------------------------------------------------------
+{
+	// decoded at whatever rate the node is running at now (see
+	// reopenFile() for when that changes)
+	_decodeRate = getNodeSampleRate();
+	
+	CFURLRef fileURL;
+	fileURL = CFURLCreateFromFileSystemRepresentation(kCFAllocatorDefault,
+	                                                  (const UInt8 *)filePath.c_str(),
+	                                                  filePath.length(),
+	                                                  NULL);
+	
+	AudioFileID fileID;
+	OSStatus s = AudioFileOpenURL(fileURL, kAudioFileReadPermission, 0, &fileID);
+	
+	if(s != noErr)
+	{
+		CFRelease(fileURL);
+		cout << "Error " << s << " while opening file at " << filePath << endl;
+		return false;
+	}
+	
+	bool mapped = mapFile(filePath, fileID);
+	AudioFileClose(fileID);
+	
+	// anything that can't be read straight from memory goes through an
+	// ExtAudioFile, which decodes and resamples to the node's format
+	if(!mapped)
+	{
+		s = ExtAudioFileOpenURL(fileURL, &_extAudioFile);
+		
+		if(s == noErr)
+		{
+			UInt32 dataSize = sizeof(_fileFormat);
+			s = ExtAudioFileGetProperty(_extAudioFile, kExtAudioFileProperty_FileDataFormat, &dataSize, &_fileFormat);
+		}
+		
+		if(s == noErr)
+		{
+			_fileChannels = _fileFormat.mChannelsPerFrame;
+			s = setClientFormat(_extAudioFile, _fileChannels, _decodeRate);
+		}
+		
+		if(s == noErr)
+		{
+			SInt64 fileFrames = 0;
+			UInt32 dataSize = sizeof(fileFrames);
+			s = ExtAudioFileGetProperty(_extAudioFile, kExtAudioFileProperty_FileLengthFrames, &dataSize, &fileFrames);
+			_fileLength = fileFrames * _decodeRate / _fileFormat.mSampleRate;
+		}
+		
+		// Files with variable-sized packets (mp3, for example) have to be
+		// parsed up to the seek point on every seek until the audio file
+		// has a table of packet offsets, which gets slow far into a long
+		// file. Filling the table means parsing the whole file, so rather
+		// than holding up setFile(), the service thread does it a little
+		// at a time on a second handle to the file (see buildIndex()).
+		// Until then, seeks parse their way there as before
+		if(s == noErr && _fileFormat.mBytesPerPacket == 0)
+		{
+			AudioFileID indexFile = NULL;
+			if(AudioFileOpenURL(fileURL, kAudioFileReadPermission, 0, &indexFile) == noErr)
+			{
+				UInt32 maxPacketSize = 0;
+				UInt32 dataSize = sizeof(maxPacketSize);
+				if(AudioFileGetProperty(indexFile, kAudioFilePropertyPacketSizeUpperBound, &dataSize, &maxPacketSize) == noErr &&
+				   maxPacketSize > 0)
+				{
+					_indexFile = indexFile;
+					_indexPacketData.resize(kIndexPacketsPerPass * maxPacketSize);
+				}
+				else
+				{
+					AudioFileClose(indexFile);
+				}
+			}
+		}
+	}
+	
+	CFRelease(fileURL);
+	
+	if(s != noErr || _fileChannels == 0)
+	{
+		cout << "Error " << s << " while reading audio from file at " << filePath << endl;
+		closeFile();
+		return false;
+	}
+	
+	const UInt32 decodeChannels = max(_fileChannels, (UInt32)2);
+	_decodeSamples.assign(decodeChannels * kDecodeChunkFrames, 0);
+	
+	size_t listSize = offsetof(AudioBufferList, mBuffers[0]) + decodeChannels * sizeof(AudioBuffer);
+	_decodeBuffers = (AudioBufferList *)malloc(listSize);
+	_decodeBuffers->mNumberBuffers = _fileChannels;
+	
+	return true;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStreamingFilePlayer::reopenFile()
+// ----------------------------------------------------------
+{
+	// The node's rate has changed since the file was opened, so it's
+	// opened again to decode at the new rate, and a stream is started
+	// from the same point in time
+	const Float64 previousRate = _decodeRate;
+	closeFile();
+	
+	if(!openFile(_sourcePath))
+	{
+		_playing = false;
+		return;
+	}
+	
+	const double scale = _decodeRate / previousRate;
+	
+	OFXAU_REALTIME_LOCK(_requestMutex);
+	requestStream((_request.pending ? _request.position : _position) * scale);
+	_requestMutex.unlock();
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitStreamingFilePlayer::mapFile(const std::string &filePath, AudioFileID fileID)
+// ----------------------------------------------------------
+{
+	AudioStreamBasicDescription format = {0};
+	UInt32 dataSize = sizeof(format);
+	if(AudioFileGetProperty(fileID, kAudioFilePropertyDataFormat, &dataSize, &format) != noErr) return false;
+	
+	// only plain interleaved integer or 32 bit float PCM at the node's
+	// rate can be converted straight out of the file
+	const bool isFloat = format.mFormatFlags & kAudioFormatFlagIsFloat;
+	const UInt32 bits  = format.mBitsPerChannel;
+	
+	if(format.mFormatID != kAudioFormatLinearPCM ||
+	   format.mSampleRate != _decodeRate ||
+	   format.mChannelsPerFrame == 0 ||
+	   (format.mFormatFlags & kAudioFormatFlagIsNonInterleaved) ||
+	   !(format.mFormatFlags & kAudioFormatFlagIsPacked) ||
+	   (isFloat ? bits != 32 : (bits != 16 && bits != 24 && bits != 32)) ||
+	   (!isFloat && !(format.mFormatFlags & kAudioFormatFlagIsSignedInteger)) ||
+	   format.mBytesPerFrame != format.mChannelsPerFrame * bits / 8)
+	{
+		return false;
+	}
+	
+	SInt64 dataOffset = 0;
+	UInt64 dataBytes  = 0;
+	dataSize = sizeof(dataOffset);
+	if(AudioFileGetProperty(fileID, kAudioFilePropertyDataOffset, &dataSize, &dataOffset) != noErr) return false;
+	dataSize = sizeof(dataBytes);
+	if(AudioFileGetProperty(fileID, kAudioFilePropertyAudioDataByteCount, &dataSize, &dataBytes) != noErr) return false;
+	
+	int fd = open(filePath.c_str(), O_RDONLY);
+	if(fd < 0) return false;
+	
+	struct stat fileStat;
+	void * mapping = MAP_FAILED;
+	
+	if(fstat(fd, &fileStat) == 0 && dataOffset >= 0 && dataOffset + dataBytes <= (UInt64)fileStat.st_size)
+	{
+		mapping = mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	
+	// the mapping keeps its own reference to the file
+	close(fd);
+	
+	if(mapping == MAP_FAILED) return false;
+	
+	madvise(mapping, fileStat.st_size, MADV_SEQUENTIAL);
+	
+	_mappedFile     = (const unsigned char *)mapping;
+	_mappedFileSize = fileStat.st_size;
+	_mappedAudio    = _mappedFile + dataOffset;
+	_fileFormat     = format;
+	_fileChannels   = format.mChannelsPerFrame;
+	_fileLength     = dataBytes / format.mBytesPerFrame;
+	
+	return true;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStreamingFilePlayer::closeFile()
+// ----------------------------------------------------------
+{
+	// the ExtAudioFile may be wrapping _indexFile, so it goes first
+	if(_extAudioFile) ExtAudioFileDispose(_extAudioFile);
+	if(_indexFile) AudioFileClose(_indexFile);
+	if(_mappedFile) munmap((void *)_mappedFile, _mappedFileSize);
+	free(_decodeBuffers);
+	std::vector<unsigned char>().swap(_indexPacketData);
+	
+	_extAudioFile   = NULL;
+	_indexFile      = NULL;
+	_indexedPackets = 0;
+	_indexBuilt     = false;
+	_mappedFile     = NULL;
+	_mappedFileSize = 0;
+	_mappedAudio    = NULL;
+	_decodeBuffers  = NULL;
+	_fileChannels   = 0;
+	_fileLength     = 0;
+	_decodePosition = 0;
+	memset(&_fileFormat, 0, sizeof(_fileFormat));
+}
+
+#pragma mark - Playback
+
+// ----------------------------------------------------------
+void ofxAudioUnitStreamingFilePlayer::play(uint64_t startTime)
+// ----------------------------------------------------------
+{
+	loop(0, startTime);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStreamingFilePlayer::loop(unsigned int timesToLoop, uint64_t startTime)
+// ----------------------------------------------------------
+{
+	if(_fileChannels == 0)
+	{
+		cout << "ofxAudioUnitStreamingFilePlayer has no file to play" << endl;
+		return;
+	}
+	
+	OFXAU_REALTIME_LOCK(_requestMutex);
+	{
+		// playing backwards starts from the end
+		_request.direction   = _rate < 0 ? -1 : 1;
+		_request.timesToLoop = timesToLoop;
+		_request.restart     = true;
+		requestStream(_request.direction < 0 ? _fileLength : 0);
+		
+		_startGeneration = _requestGeneration;
+		_startTime = startTime;
+		OSMemoryBarrier();
+		_playing = true;
+	}
+	_requestMutex.unlock();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStreamingFilePlayer::stop()
+// ----------------------------------------------------------
+{
+	_playing = false;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStreamingFilePlayer::setLoopPoints(SInt64 loopStart, SInt64 loopEnd)
+// ----------------------------------------------------------
+{
+	// the decoder checks the points against each other (and the file)
+	// every chunk, so they don't have to change together
+	_loopStart = loopStart;
+	_loopEnd   = loopEnd;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStreamingFilePlayer::resetUnderrunCount()
+// ----------------------------------------------------------
+{
+	_underruns = 0;
+	OSMemoryBarrier();
+}
+
+#pragma mark - Seeking
+
+// ----------------------------------------------------------
+void ofxAudioUnitStreamingFilePlayer::seek(SInt64 frame)
+// ----------------------------------------------------------
+{
+	if(_fileChannels == 0) return;
+	
+	frame = max((SInt64)0, min(frame, _fileLength));
+	
+	OFXAU_REALTIME_LOCK(_requestMutex);
+	requestStream(frame);
+	_requestMutex.unlock();
+	
+	// nothing's playing to move the position on when the new stream starts
+	if(!_playing) _position = frame;
+}
+
+// ----------------------------------------------------------
+SInt64 ofxAudioUnitStreamingFilePlayer::getPosition() const
+// ----------------------------------------------------------
+{
+	return _position;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStreamingFilePlayer::setResampleQuality(ofxAudioUnitResamplerQuality quality)
+// ----------------------------------------------------------
+{
+	OFXAU_REALTIME_LOCK(_renderMutex);
+	_resampler.setQuality(quality);
+	_renderMutex.unlock();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStreamingFilePlayer::setRate(float rate)
+// ----------------------------------------------------------
+{
+	rate = max(-kMaxScrubRate, min(rate, kMaxScrubRate));
+	_rate = rate;
+	
+	// The ring holds frames in the order they play, so only a change of
+	// direction needs a new stream, decoded the other way from wherever
+	// playback has got to (or from the other end, if it's yet to start)
+	const int direction = rate < 0 ? -1 : 1;
+	
+	OFXAU_REALTIME_LOCK(_requestMutex);
+	if(rate != 0 && direction != _request.direction && _fileChannels > 0)
+	{
+		_request.direction = direction;
+		
+		if(_request.restart)      requestStream(direction < 0 ? _fileLength : 0);
+		else if(_request.pending) requestStream(_request.position);
+		else                      requestStream(_position);
+	}
+	_requestMutex.unlock();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStreamingFilePlayer::requestStream(double position)
+// ----------------------------------------------------------
+{
+	// only called with _requestMutex held
+	_request.position = position;
+	_request.pending  = true;
+	OSAtomicIncrement32Barrier(&_requestGeneration);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStreamingFilePlayer::adoptStream(const Stream &stream)
+// ----------------------------------------------------------
+{
+	// Called on the render thread when it switches to a newly primed
+	// stream. The resampler's history belongs to the old one
+	_resampler.reset();
+	_hasNextPositionMark = false;
+	_positionMark.ringFrame = 0;
+	_positionMark.position  = stream.startPosition;
+	_position = stream.startPosition;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStreamingFilePlayer::updatePosition(Stream &stream)
+// ----------------------------------------------------------
+{
+	// Called on the render thread after playing from the ring. The file
+	// position moves a frame for each ring frame the resampler has played
+	// through (not counting the frames it has read ahead), until playback
+	// reaches a mark the decoder left where it jumped (looping round)
+	const uint32_t playedFrame = stream.ring.getFramesRead() - (uint32_t)_resampler.getInputFramesAhead();
+	
+	while(true)
+	{
+		if(!_hasNextPositionMark) _hasNextPositionMark = stream.positionMarks.pop(_nextPositionMark);
+		if(!_hasNextPositionMark || (int32_t)(playedFrame - _nextPositionMark.ringFrame) < 0) break;
+		
+		_positionMark = _nextPositionMark;
+		_hasNextPositionMark = false;
+	}
+	
+	double position = _positionMark.position + (int32_t)(playedFrame - _positionMark.ringFrame) * stream.direction;
+	position = max(0., min(position, (double)_fileLength));
+	_position = position;
+}
+
+#pragma mark - Prefetching
+
+// ----------------------------------------------------------
+void ofxAudioUnitStreamingFilePlayer::setPrefetchDepth(float seconds)
+// ----------------------------------------------------------
+{
+	// at the fastest rate, a buffer reads kMaxScrubRate times its length
+	// from the ring
+	_prefetchSeconds = max(seconds, (float)(kMaxFramesPerSlice * kMaxScrubRate / getNodeSampleRate()));
+		
+	// the ring is resized when the next stream starts, so one is started
+	// from wherever playback has got to
+	OFXAU_REALTIME_LOCK(_requestMutex);
+	if(_fileChannels > 0 && !_request.pending) requestStream(_position);
+	_requestMutex.unlock();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStreamingFilePlayer::serviceStream(void * context)
+// ----------------------------------------------------------
+{
+	ofxAudioUnitStreamingFilePlayer * player = static_cast<ofxAudioUnitStreamingFilePlayer *>(context);
+	
+	// a player that's busy (opening a file, say) just waits for the next pass
+	if(!player->_streamMutex.tryLock()) return;
+	
+	if(player->_fileChannels > 0 && player->_decodeRate != player->getNodeSampleRate()) player->reopenFile();
+	
+	// a new stream is primed (which may take the pass), then the playing
+	// one is kept topped up
+	if(!player->startStream() && player->_playing)
+	{
+		player->fillRing(player->_streams[player->_decodeStream].ring.getWritableFrames());
+	}
+	
+	if(player->_indexFile && !player->_indexBuilt) player->buildIndex();
+	
+	player->_streamMutex.unlock();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStreamingFilePlayer::buildIndex()
+// ----------------------------------------------------------
+{
+	// reading the packets in order is what makes the audio file find
+	// (and remember) where each one starts
+	UInt32 bytes   = _indexPacketData.size();
+	UInt32 packets = kIndexPacketsPerPass;
+	OSStatus s = AudioFileReadPacketData(_indexFile, false, &bytes, NULL, _indexedPackets, &packets, &_indexPacketData[0]);
+	_indexedPackets += packets;
+	
+	if(s == noErr && packets > 0) return;
+	
+	// The whole file has been parsed, and this handle's table of packet
+	// offsets is complete (asking for the exact packet count makes sure
+	// of that, and costs nothing now). Decoding carries on from the same
+	// frame through this handle, and the one that has to parse is closed
+	UInt64 packetCount = 0;
+	UInt32 dataSize = sizeof(packetCount);
+	AudioFileGetProperty(_indexFile, kAudioFilePropertyAudioDataPacketCount, &dataSize, &packetCount);
+	
+	ExtAudioFileRef indexedFile = NULL;
+	if(ExtAudioFileWrapAudioFileID(_indexFile, false, &indexedFile) == noErr &&
+	   setClientFormat(indexedFile, _fileChannels, _decodeRate) == noErr)
+	{
+		ExtAudioFileDispose(_extAudioFile);
+		_extAudioFile = indexedFile;
+		seekFile(_decodePosition);
+	}
+	else
+	{
+		if(indexedFile) ExtAudioFileDispose(indexedFile);
+		AudioFileClose(_indexFile);
+		_indexFile = NULL;
+	}
+	
+	_indexBuilt = true;
+	std::vector<unsigned char>().swap(_indexPacketData);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitStreamingFilePlayer::startStream()
+// ----------------------------------------------------------
+{
+	Request request;
+	int32_t generation;
+	
+	OFXAU_REALTIME_LOCK(_requestMutex);
+	{
+		request    = _request;
+		generation = _requestGeneration;
+		_request.restart = false;
+		_request.pending = false;
+	}
+	_requestMutex.unlock();
+	
+	if(!request.pending || _fileChannels == 0) return false;
+	
+	// A stream primed for an earlier request that the render thread
+	// hasn't switched to yet is taken back. Once bit 1 is clear the render
+	// thread can't switch, so the stream it isn't playing is free
+	int32_t state;
+	do
+	{
+		state = _streamState;
+	}
+	while((state & 2) && !OSAtomicCompareAndSwap32Barrier(state, state & 1, &_streamState));
+	
+	_decodeStream = (state & 1) ^ 1;
+	Stream &stream = _streams[_decodeStream];
+	
+	// resized here rather than in setPrefetchDepth(), since the render
+	// thread may be reading the other ring
+	const unsigned int capacity = _prefetchSeconds * _decodeRate;
+	if(stream.ring.getCapacity() < capacity || stream.ring.getCapacity() / 2 >= capacity)
+	{
+		stream.ring.allocate(2, capacity);
+	}
+	
+	stream.ring.reset();
+	PositionMark mark;
+	while(stream.positionMarks.pop(mark));
+	
+	if(request.restart) _loopsRemaining = request.timesToLoop;
+	stream.generation    = generation;
+	stream.direction     = request.direction;
+	stream.startPosition = max(0., min(request.position, (double)_fileLength));
+	stream.endOfStream   = false;
+	seekFile(stream.startPosition);
+	
+	fillRing(min(kPrimeFrames, stream.ring.getWritableFrames()));
+	
+	// the stream has to be complete before the render thread can see it
+	OSAtomicCompareAndSwap32Barrier(state & 1, (state & 1) | 2, &_streamState);
+	return true;
+}
+
+// ----------------------------------------------------------
+UInt32 ofxAudioUnitStreamingFilePlayer::fillRing(UInt32 maxFrames)
+// ----------------------------------------------------------
+{
+	Stream &stream = _streams[_decodeStream];
+	const bool backwards = stream.direction < 0;
+	UInt32 filled = 0;
+	
+	while(filled < maxFrames && !stream.endOfStream)
+	{
+		// The loop the user asked for, made to fit the file. It's read
+		// for every chunk, so changes apply from the next chunk decoded.
+		// The crossfade blends the end of the loop with the frames leading
+		// up to the loop start (or following it, if there aren't enough),
+		// as ofxAudioUnitSamplePlayer does. Going backwards, the loop is
+		// played without one
+		const SInt64 loopEnd   = (_loopEnd <= 0 || _loopEnd > _fileLength) ? _fileLength : _loopEnd;
+		const SInt64 loopStart = max((SInt64)0, min((SInt64)_loopStart, loopEnd - 1));
+		const SInt64 crossfade = backwards ? 0 : min((SInt64)_loopCrossfade, (loopEnd - loopStart) / 2);
+		const SInt64 fadeFrom  = loopStart >= crossfade ? loopStart - crossfade : loopStart;
+		
+		// where decoding stops (or goes round), and where it goes round to
+		const bool   looping   = _loopsRemaining != 0;
+		const SInt64 end       = backwards ? (looping ? loopStart : 0) : (looping ? loopEnd : _fileLength);
+		const SInt64 loopTo    = backwards ? loopEnd : fadeFrom + crossfade;
+		const SInt64 fadeStart = looping ? end - crossfade : end;
+		
+		UInt32 frames  = min(kDecodeChunkFrames, maxFrames - filled);
+		UInt32 decoded = 0;
+		
+		if(backwards && _decodePosition > end)
+		{
+			decoded = decodeFramesBackwards(min((SInt64)frames, _decodePosition - end));
+		}
+		else if(!backwards && _decodePosition < end)
+		{
+			const bool fading = _decodePosition >= fadeStart;
+			frames  = min((SInt64)frames, (fading ? end : fadeStart) - _decodePosition);
+			decoded = fading ? decodeCrossfadeFrames(frames, fadeStart, fadeFrom, crossfade) : decodeFrames(frames);
+		}
+		
+		if(decoded == 0)
+		{
+			// the end of the loop or the file (or the start, going
+			// backwards), so either go round again or finish
+			if(looping && _decodePosition != loopTo)
+			{
+				// playback jumps to the loop start at the next frame
+				// written. If the render thread hasn't caught up with
+				// earlier jumps, this one waits for the next pass
+				PositionMark mark;
+				mark.ringFrame = stream.ring.getFramesWritten();
+				mark.position  = loopTo;
+				if(!stream.positionMarks.push(mark)) break;
+				
+				if(_loopsRemaining > 0) _loopsRemaining--;
+				seekFile(loopTo);
+			}
+			else
+			{
+				// the ring's last frames have to be visible before the
+				// render thread can see that the stream has ended
+				OSMemoryBarrier();
+				stream.endOfStream = true;
+			}
+			continue;
+		}
+		
+		const float * channels[2] = {&_decodeSamples[0], &_decodeSamples[kDecodeChunkFrames]};
+		stream.ring.write(channels, decoded);
+		filled += decoded;
+	}
+	
+	return filled;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStreamingFilePlayer::seekFile(SInt64 frame)
+// ----------------------------------------------------------
+{
+	_decodePosition = min(frame, _fileLength);
+	
+	if(_extAudioFile)
+	{
+		// ExtAudioFile seeks in the file's own frames, not the client's
+		SInt64 fileFrame = _decodePosition * _fileFormat.mSampleRate / _decodeRate;
+		OFXAU_PRINT(ExtAudioFileSeek(_extAudioFile, fileFrame), "seeking in streamed file");
+	}
+}
+
+// ----------------------------------------------------------
+UInt32 ofxAudioUnitStreamingFilePlayer::decodeFrames(UInt32 frames)
+// ----------------------------------------------------------
+{
+	// decodes the next frames into the first two channels of _decodeSamples
+	if(_mappedAudio)
+	{
+		frames = min((SInt64)frames, _fileLength - _decodePosition);
+		
+		const UInt32 bytesPerSample = _fileFormat.mBitsPerChannel / 8;
+		const UInt32 stride         = _fileChannels;
+		const bool   isFloat        = _fileFormat.mFormatFlags & kAudioFormatFlagIsFloat;
+		const bool   bigEndian      = _fileFormat.mFormatFlags & kAudioFormatFlagIsBigEndian;
+		const bool   nativeEndian   = bigEndian == (bool)(kAudioFormatFlagsNativeEndian & kAudioFormatFlagIsBigEndian);
+		const unsigned char * start = _mappedAudio + _decodePosition * _fileFormat.mBytesPerFrame;
+		
+		for(UInt32 c = 0; c < min(_fileChannels, (UInt32)2); c++)
+		{
+			float * out = &_decodeSamples[c * kDecodeChunkFrames];
+			const unsigned char * in = start + c * bytesPerSample;
+			
+			if(nativeEndian && isFloat)
+			{
+				float one = 1;
+				vDSP_vsmul((const float *)in, stride, &one, out, 1, frames);
+			}
+			else if(nativeEndian && bytesPerSample == 2)
+			{
+				float scale = 1.f / 32768.f;
+				vDSP_vflt16((const short *)in, stride, out, 1, frames);
+				vDSP_vsmul(out, 1, &scale, out, 1, frames);
+			}
+			else if(nativeEndian && bytesPerSample == 4)
+			{
+				float scale = 1.f / 2147483648.f;
+				vDSP_vflt32((const int *)in, stride, out, 1, frames);
+				vDSP_vsmul(out, 1, &scale, out, 1, frames);
+			}
+			else
+			{
+				for(UInt32 i = 0; i < frames; i++)
+				{
+					out[i] = unpackSample(in + i * _fileFormat.mBytesPerFrame, bytesPerSample, isFloat, bigEndian);
+				}
+			}
+		}
+	}
+	else if(_extAudioFile)
+	{
+		for(UInt32 c = 0; c < _fileChannels; c++)
+		{
+			_decodeBuffers->mBuffers[c].mNumberChannels = 1;
+			_decodeBuffers->mBuffers[c].mData           = &_decodeSamples[c * kDecodeChunkFrames];
+			_decodeBuffers->mBuffers[c].mDataByteSize   = frames * sizeof(AudioUnitSampleType);
+		}
+		
+		OSStatus s = ExtAudioFileRead(_extAudioFile, &frames, _decodeBuffers);
+		if(s != noErr)
+		{
+			OFXAU_PRINT(s, "reading from streamed file");
+			frames = 0;
+		}
+	}
+	else
+	{
+		return 0;
+	}
+	
+	// mono files play out of both sides
+	if(_fileChannels == 1)
+	{
+		memcpy(&_decodeSamples[kDecodeChunkFrames], &_decodeSamples[0], frames * sizeof(AudioUnitSampleType));
+	}
+	
+	_decodePosition += frames;
+	return frames;
+}
+
+// ----------------------------------------------------------
+UInt32 ofxAudioUnitStreamingFilePlayer::decodeCrossfadeFrames(UInt32 frames, SInt64 fadeStart, SInt64 fadeFrom, SInt64 crossfade)
+// ----------------------------------------------------------
+{
+	// Decodes the next frames of the loop's tail into _decodeSamples,
+	// faded into the same frames of the loop's head. The head is decoded
+	// first, so the file is left where the tail carries on
+	const SInt64 tailPosition = _decodePosition;
+	const SInt64 offset       = tailPosition - fadeStart;
+	
+	seekFile(fadeFrom + offset);
+	const UInt32 headFrames = decodeFrames(frames);
+	
+	for(int c = 0; c < 2; c++)
+	{
+		float * head = &_fadeSamples[c * kDecodeChunkFrames];
+		memcpy(head, &_decodeSamples[c * kDecodeChunkFrames], headFrames * sizeof(float));
+		vDSP_vclr(head + headFrames, 1, frames - headFrames);
+	}
+	
+	seekFile(tailPosition);
+	const UInt32 decoded = decodeFrames(frames);
+	
+	float rampStart = (offset + 0.5f) / crossfade;
+	float rampStep  = 1.f / crossfade;
+	vDSP_vramp(&rampStart, &rampStep, &_fadeRamp[0], 1, decoded);
+	
+	// tail = tail + ramp * (head - tail)
+	for(int c = 0; c < 2; c++)
+	{
+		float * tail = &_decodeSamples[c * kDecodeChunkFrames];
+		float * head = &_fadeSamples[c * kDecodeChunkFrames];
+		vDSP_vsub(tail, 1, head, 1, head, 1, decoded);
+		vDSP_vma(&_fadeRamp[0], 1, head, 1, tail, 1, tail, 1, decoded);
+	}
+	
+	return decoded;
+}
+
+// ----------------------------------------------------------
+UInt32 ofxAudioUnitStreamingFilePlayer::decodeFramesBackwards(UInt32 frames)
+// ----------------------------------------------------------
+{
+	// decodes the frames just before _decodePosition into _decodeSamples
+	// last frame first, and leaves _decodePosition at the earliest of them
+	const SInt64 end = _decodePosition;
+	frames = min((SInt64)frames, end);
+	if(frames == 0) return 0;
+	
+	seekFile(end - frames);
+	const UInt32 decoded = decodeFrames(frames);
+	
+	// a compressed file can come up a little short of its estimated
+	// length, so anything missing is silent
+	for(int c = 0; c < 2; c++)
+	{
+		float * channel = &_decodeSamples[c * kDecodeChunkFrames];
+		vDSP_vclr(channel + decoded, 1, frames - decoded);
+		vDSP_vrvrs(channel, 1, frames);
+	}
+	
+	// the next chunk seeks again, so the file itself needn't be moved
+	_decodePosition = end - frames;
+	return frames;
+}
+
+#pragma mark - Rendering
+
+// ----------------------------------------------------------
+OSStatus ofxAudioUnitStreamingFilePlayer::renderNode(AudioUnitRenderActionFlags *ioActionFlags,
+													 const AudioTimeStamp *inTimeStamp,
+													 UInt32 inNumberFrames,
+													 AudioBufferList *ioData)
+// ----------------------------------------------------------
+{
+	const UInt32 outputCount = min((UInt32)ioData->mNumberBuffers, (UInt32)2);
+	float * channels[2] = {NULL, NULL};
+	for(int i = 0; i < outputCount; i++) channels[i] = (float *)ioData->mBuffers[i].mData;
+	if(outputCount == 1) channels[1] = channels[0];
+	
+	// switching to a newly primed stream, unless the service thread has
+	// just taken it back for a later one
+	const int32_t state = _streamState;
+	if((state & 2) && OSAtomicCompareAndSwap32Barrier(state, (state & 1) ^ 1, &_streamState))
+	{
+		adoptStream(_streams[(state & 1) ^ 1]);
+	}
+	
+	Stream &stream = _streams[_streamState & 1];
+	
+	UInt32 startFrame   = 0;
+	UInt32 framesPlayed = 0;
+	
+	// waiting for a scheduled start, which may fall part way through
+	// this buffer
+	if(_playing && _startTime)
+	{
+		startFrame = min(framesUntilHostTime(_startTime, inTimeStamp), inNumberFrames);
+		if(startFrame < inNumberFrames) _startTime = 0;
+		
+		for(int i = 0; i < outputCount; i++) vDSP_vclr(channels[i], 1, startFrame);
+		for(int i = 0; i < 2; i++) channels[i] += startFrame;
+	}
+	
+	// Silent (without counting an underrun) until the stream play() asked
+	// for is primed, while holding still, and while a change of direction
+	// is being primed
+	const float rate = _rate;
+	const bool started = (int32_t)(stream.generation - _startGeneration) >= 0;
+	const bool moving  = rate != 0 && (rate < 0) == (stream.direction < 0);
+	
+	if(_playing && !_startTime && started && moving)
+	{
+		const UInt32 frames = inNumberFrames - startFrame;
+		const float  speed  = fabsf(rate);
+		
+		// checked before reading, so that frames written just before the
+		// stream ended can't be mistaken for the end
+		const bool ending = stream.endOfStream;
+		OSMemoryBarrier();
+		
+		// the ring is read through the resampler at the playback speed
+		UInt32 framesNeeded = _resampler.getInputFramesNeeded(frames, speed);
+		float * ringChannels[2] = {&_renderSamples[0], &_renderSamples[kMaxFramesPerSlice]};
+		
+		while(framesNeeded > 0)
+		{
+			const UInt32 chunk = min(framesNeeded, (UInt32)kMaxFramesPerSlice);
+			const UInt32 read  = stream.ring.read(ringChannels, chunk);
+			_resampler.write(ringChannels, read);
+			framesNeeded -= read;
+			if(read < chunk) break;
+		}
+		
+		// anything the ring was short of plays as silence
+		_resampler.process(channels, frames, speed);
+		framesPlayed = frames;
+		updatePosition(stream);
+		
+		if(framesNeeded > 0)
+		{
+			if(ending)
+			{
+				_playing = false;
+			}
+			else
+			{
+				// the resampler has read past its input, so it starts
+				// again from whatever the ring has next
+				OSAtomicIncrement32Barrier(&_underruns);
+				_resampler.reset();
+			}
+		}
+	}
+	
+	for(int i = 0; i < outputCount; i++)
+	{
+		vDSP_vclr(channels[i] + framesPlayed, 1, inNumberFrames - startFrame - framesPlayed);
+	}
+	
+	if(framesPlayed == 0) *ioActionFlags |= kAudioUnitRenderAction_OutputIsSilence;
+	
+	return noErr;
+}
+
+// ----------------------------------------------------------
+OSStatus setClientFormat(ExtAudioFileRef file, UInt32 channels, Float64 sampleRate)
+// ----------------------------------------------------------
+{
+	// decoded and resampled to the node's format
+	AudioStreamBasicDescription clientFormat = {0};
+	clientFormat.mSampleRate       = sampleRate;
+	clientFormat.mFormatID         = kAudioFormatLinearPCM;
+	clientFormat.mFormatFlags      = kAudioFormatFlagsNativeFloatPacked | kAudioFormatFlagIsNonInterleaved;
+	clientFormat.mBitsPerChannel   = sizeof(AudioUnitSampleType) * 8;
+	clientFormat.mChannelsPerFrame = channels;
+	clientFormat.mFramesPerPacket  = 1;
+	clientFormat.mBytesPerFrame    = sizeof(AudioUnitSampleType);
+	clientFormat.mBytesPerPacket   = sizeof(AudioUnitSampleType);
+	
+	return ExtAudioFileSetProperty(file, kExtAudioFileProperty_ClientDataFormat, sizeof(clientFormat), &clientFormat);
+}
+
+// ----------------------------------------------------------
+float unpackSample(const unsigned char * sample, UInt32 bytes, bool isFloat, bool bigEndian)
+// ----------------------------------------------------------
+{
+	// assembling the sample most significant byte first, then shifting
+	// it to the top of a 32 bit word so that the sign comes along
+	uint32_t word = 0;
+	for(UInt32 b = 0; b < bytes; b++)
+	{
+		word = (word << 8) | sample[bigEndian ? b : bytes - 1 - b];
+	}
+	
+	if(isFloat)
+	{
+		float value;
+		memcpy(&value, &word, sizeof(value));
+		return value;
+	}
+	
+	word <<= 32 - bytes * 8;
+	return (int32_t)word / 2147483648.f;
+}
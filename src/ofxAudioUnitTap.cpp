@@ -25,16 +25,10 @@ ofxAudioUnitTap::~ofxAudioUnitTap()
 		AURenderCallbackStruct callbackInfo;
 		callbackInfo.inputProc = silentRenderCallback;
 		callbackInfo.inputProcRefCon = NULL;
-		OFXAU_PRINT(AudioUnitSetProperty(*_destinationUnit->getUnit(),
-										 kAudioUnitProperty_SetRenderCallback,
-										 kAudioUnitScope_Input,
-										 _destinationBus,
-										 &callbackInfo,
-										 sizeof(callbackInfo)),
-					"setting tap destination to a silent render callback");
+		_destinationUnit->setRenderCallback(callbackInfo, _destinationBus);
 	}
 	
-	_bufferMutex.lock();
+	OFXAU_REALTIME_LOCK(_bufferMutex);
 	{
 		if(_trackedSamples) releaseBufferList(_trackedSamples);
 	}
@@ -100,7 +94,7 @@ void ofxAudioUnitTap::getSamples(ofxAudioUnitTapSamples &outData)
 	outData.left.clear();
 	outData.right.clear();
 	
-	_bufferMutex.lock();
+	OFXAU_REALTIME_LOCK(_bufferMutex);
 	{
 		AudioUnitSampleType * leftSamples = (AudioUnitSampleType *)_trackedSamples->mBuffers[0].mData;
 		for(int i = 0; i < _trackedSamples->mBuffers[0].mDataByteSize / sizeof(AudioUnitSampleType); i++)
@@ -118,7 +112,7 @@ void ofxAudioUnitTap::waveformForBuffer(AudioBuffer *buffer, float width, float
 // ----------------------------------------------------------
 {	
 	outLine.clear();
-	_bufferMutex.lock();
+	OFXAU_REALTIME_LOCK(_bufferMutex);
 	{
 		float xStep = width / (buffer->mDataByteSize / sizeof(AudioUnitSampleType));
 		float x = 0;
@@ -175,6 +169,8 @@ OSStatus ofxAudioUnitTap::renderAndCopy(void * inRefCon,
 										AudioBufferList * ioData)
 // ----------------------------------------------------------
 {
+	OFXAU_REALTIME_SCOPE();
+	ofxAudioUnitDenormalGuard denormalGuard;
 	TapContext * context = (TapContext *)inRefCon;
 	
 	// if we don't have a source, render silence (or else you'll get an extremely loud
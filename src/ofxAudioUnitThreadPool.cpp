@@ -0,0 +1,91 @@
+#include "ofxAudioUnitThreadPool.h"
+#include "ofxAudioUnitRealtimeCheck.h"
+#include <unistd.h>
+#include <algorithm>
+
+// how long an idle worker sleeps before checking for jobs again
+static const int kIdleIntervalMS = 10;
+
+// one worker per core, less one for the app's own threads, up to this many
+static const long kMaxWorkers = 8;
+
+// ----------------------------------------------------------
+ofxAudioUnitThreadPool& ofxAudioUnitThreadPool::shared()
+// ----------------------------------------------------------
+{
+	static ofxAudioUnitThreadPool pool;
+	return pool;
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitThreadPool::ofxAudioUnitThreadPool()
+// ----------------------------------------------------------
+{
+	const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	const long workers = std::max(1L, std::min(cores - 1, kMaxWorkers));
+	
+	for(int i = 0; i < workers; i++)
+	{
+		_workers.push_back(new Worker(this));
+	}
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitThreadPool::~ofxAudioUnitThreadPool()
+// ----------------------------------------------------------
+{
+	for(int i = 0; i < _workers.size(); i++)
+	{
+		if(_workers[i]->isThreadRunning()) _workers[i]->waitForThread(true);
+		delete _workers[i];
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitThreadPool::addJob(JobProc proc, void * context)
+// ----------------------------------------------------------
+{
+	OFXAU_REALTIME_LOCK(_mutex);
+	_jobs.push_back(Job(proc, context));
+	
+	// the workers are only started once there's something for them to do
+	for(int i = 0; i < _workers.size(); i++)
+	{
+		if(!_workers[i]->isThreadRunning()) _workers[i]->startThread(true, false);
+	}
+	_mutex.unlock();
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitThreadPool::nextJob(Job &job)
+// ----------------------------------------------------------
+{
+	OFXAU_REALTIME_LOCK(_mutex);
+	const bool found = !_jobs.empty();
+	if(found)
+	{
+		job = _jobs.front();
+		_jobs.pop_front();
+	}
+	_mutex.unlock();
+	
+	return found;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitThreadPool::Worker::threadedFunction()
+// ----------------------------------------------------------
+{
+	while(isThreadRunning())
+	{
+		Job job;
+		if(_pool->nextJob(job))
+		{
+			job.first(job.second);
+		}
+		else
+		{
+			sleep(kIdleIntervalMS);
+		}
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "ofThread.h"
+#include <deque>
+#include <vector>
+#include <utility>
+
+// ofxAudioUnitThreadPool runs one-off background jobs (such as decoding
+// part of a file) on a few worker threads, one per spare core. Jobs are
+// run in the order they were added, as many at once as there are
+// workers. Unlike ofxAudioUnitServiceThread, each job is run once and
+// may take as long as it needs.
+
+// A job's context has to stay valid until the job has run. Jobs that
+// have been added can't be removed, so anything that might go away
+// before its jobs have run should give them a way to bail out early.
+
+class ofxAudioUnitThreadPool
+{
+public:
+	typedef void (*JobProc)(void * context);
+	
+	static ofxAudioUnitThreadPool& shared();
+	~ofxAudioUnitThreadPool();
+	
+	void addJob(JobProc proc, void * context);
+	unsigned int getThreadCount() const {return _workers.size();}
+
+private:
+	typedef std::pair<JobProc, void *> Job;
+	
+	class Worker : public ofThread
+	{
+	public:
+		Worker(ofxAudioUnitThreadPool * pool) : _pool(pool) {}
+	protected:
+		void threadedFunction();
+	private:
+		ofxAudioUnitThreadPool * _pool;
+	};
+	
+	std::deque<Job> _jobs;
+	std::vector<Worker *> _workers;
+	ofMutex _mutex;
+	
+	ofxAudioUnitThreadPool();
+	ofxAudioUnitThreadPool(const ofxAudioUnitThreadPool &orig);
+	ofxAudioUnitThreadPool& operator=(const ofxAudioUnitThreadPool &orig);
+	
+	bool nextJob(Job &job);
+};
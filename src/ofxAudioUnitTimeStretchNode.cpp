@@ -0,0 +1,173 @@
+#include "ofxAudioUnit.h"
+#include <Accelerate/Accelerate.h>
+#include <math.h>
+
+static const float kMinTempo     = 0.25;
+static const float kMaxTempo     = 4;
+static const float kMaxSemitones = 24;
+static const float kMaxPitchRate = 4;
+
+// ----------------------------------------------------------
+ofxAudioUnitTimeStretchNode::ofxAudioUnitTimeStretchNode(UInt32 channels)
+: ofxAudioUnitNativeNode(channels)
+, _stretcher(channels, kMaxFramesPerSlice)
+, _resampler(channels, OFX_AU_RESAMPLE_CUBIC, kMaxFramesPerSlice * kMaxPitchRate + 2 * ofxAudioUnitResampler::kMaxKernelRadius)
+, _tempo(1)
+, _pitch(0)
+, _inputSampleTime(0)
+// ----------------------------------------------------------
+{
+	resizeInputs(1);
+	
+	_stageSamples.assign(channels * kMaxFramesPerSlice, 0);
+	_stageChannels.resize(channels);
+	_inputChannels.resize(channels);
+	_outputChannels.resize(channels);
+	
+	_inputSamples = (AudioUnitSampleType *)calloc(channels * kMaxFramesPerSlice, sizeof(AudioUnitSampleType));
+	
+	for(int c = 0; c < channels; c++)
+	{
+		_stageChannels[c] = &_stageSamples[c * kMaxFramesPerSlice];
+		_inputChannels[c] = _inputSamples + c * kMaxFramesPerSlice;
+	}
+	
+	size_t listSize = offsetof(AudioBufferList, mBuffers[0]) + channels * sizeof(AudioBuffer);
+	_inputBuffer = (AudioBufferList *)malloc(listSize);
+	_inputBuffer->mNumberBuffers = channels;
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitTimeStretchNode::~ofxAudioUnitTimeStretchNode()
+// ----------------------------------------------------------
+{
+	detachNode();
+	
+	OFXAU_REALTIME_LOCK(_renderMutex);
+	free(_inputBuffer);
+	free(_inputSamples);
+	_inputBuffer  = NULL;
+	_inputSamples = NULL;
+	_renderMutex.unlock();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitTimeStretchNode::setTempo(float tempo)
+// ----------------------------------------------------------
+{
+	_tempo = max(kMinTempo, min(tempo, kMaxTempo));
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitTimeStretchNode::setPitch(float semitones)
+// ----------------------------------------------------------
+{
+	_pitch = max(-kMaxSemitones, min(semitones, kMaxSemitones));
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitTimeStretchNode::setPitchQuality(ofxAudioUnitResamplerQuality quality)
+// ----------------------------------------------------------
+{
+	OFXAU_REALTIME_LOCK(_renderMutex);
+	_resampler.setQuality(quality);
+	_renderMutex.unlock();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitTimeStretchNode::reset()
+// ----------------------------------------------------------
+{
+	OFXAU_REALTIME_LOCK(_renderMutex);
+	_stretcher.reset();
+	_resampler.reset();
+	_renderMutex.unlock();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitTimeStretchNode::pullInputFrames(const AudioTimeStamp *inTimeStamp, UInt32 frames)
+// ----------------------------------------------------------
+{
+	// the input gets its own continuous timeline, since it's pulled at a
+	// different rate to the output
+	const UInt32 channels = _resampler.getChannels();
+	
+	while(frames > 0)
+	{
+		const UInt32 slice = min(frames, (UInt32)kMaxFramesPerSlice);
+		
+		for(int c = 0; c < channels; c++)
+		{
+			_inputBuffer->mBuffers[c].mNumberChannels = 1;
+			_inputBuffer->mBuffers[c].mData           = _inputChannels[c];
+			_inputBuffer->mBuffers[c].mDataByteSize   = slice * sizeof(AudioUnitSampleType);
+		}
+		
+		AudioTimeStamp inputTimeStamp = *inTimeStamp;
+		inputTimeStamp.mSampleTime = _inputSampleTime;
+		inputTimeStamp.mFlags |= kAudioTimeStampSampleTimeValid;
+		
+		AudioUnitRenderActionFlags inputFlags = 0;
+		OSStatus s = pullInput(0, &inputFlags, &inputTimeStamp, slice, _inputBuffer);
+		if(s != noErr)
+		{
+			for(int c = 0; c < channels; c++) vDSP_vclr(_inputChannels[c], 1, slice);
+		}
+		
+		_resampler.write(&_inputChannels[0], slice);
+		_inputSampleTime += slice;
+		frames -= slice;
+	}
+}
+
+// ----------------------------------------------------------
+OSStatus ofxAudioUnitTimeStretchNode::renderNode(AudioUnitRenderActionFlags *ioActionFlags,
+												 const AudioTimeStamp *inTimeStamp,
+												 UInt32 inNumberFrames,
+												 AudioBufferList *ioData)
+// ----------------------------------------------------------
+{
+	if(!isInputConnected(0))
+	{
+		for(int i = 0; i < ioData->mNumberBuffers; i++)
+		{
+			vDSP_vclr((AudioUnitSampleType *)ioData->mBuffers[i].mData, 1, inNumberFrames);
+		}
+		*ioActionFlags |= kAudioUnitRenderAction_OutputIsSilence;
+		return noErr;
+	}
+	
+	// resampling by the pitch ratio shifts the pitch but also speeds the
+	// audio up by the same ratio, so the stretcher only has to make up
+	// the difference between that and the tempo
+	const float pitchRate = powf(2, _pitch / 12.f);
+	_stretcher.setRate(_tempo / pitchRate);
+	
+	while(_stretcher.getAvailableFrames() < inNumberFrames)
+	{
+		const UInt32 frames = min(_stretcher.getInputFramesNeeded(), (unsigned int)kMaxFramesPerSlice);
+		if(frames == 0) break;
+		
+		pullInputFrames(inTimeStamp, _resampler.getInputFramesNeeded(frames, pitchRate));
+		_resampler.process(&_stageChannels[0], frames, pitchRate);
+		_stretcher.write(&_stageChannels[0], frames);
+	}
+	
+	const UInt32 channels    = _stretcher.getChannels();
+	const UInt32 outputCount = min((UInt32)ioData->mNumberBuffers, channels);
+	for(int c = 0; c < channels; c++)
+	{
+		_outputChannels[c] = (float *)ioData->mBuffers[min((UInt32)c, outputCount - 1)].mData;
+	}
+	
+	const UInt32 framesRead = _stretcher.read(&_outputChannels[0], inNumberFrames);
+	if(framesRead < inNumberFrames)
+	{
+		for(int i = 0; i < outputCount; i++)
+		{
+			vDSP_vclr(_outputChannels[i] + framesRead, 1, inNumberFrames - framesRead);
+		}
+	}
+	
+	return noErr;
+}
@@ -0,0 +1,227 @@
+#include "ofxAudioUnitTimeStretcher.h"
+#include <Accelerate/Accelerate.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+using namespace std;
+
+// frames are 1024 samples (about 23ms) with a Hann window, overlapped
+// by half. The search for the best fit reaches 256 samples either side,
+// which covers a period of anything above about 170Hz and is enough to
+// keep lower notes from smearing audibly
+static const unsigned int kFrameSize     = 1024;
+static const unsigned int kHopSize       = kFrameSize / 2;
+static const unsigned int kOverlapSize   = kFrameSize - kHopSize;
+static const long         kSearchRadius  = 256;
+static const long         kCoarseStep    = 4;
+static const float        kMinRate       = 1. / 16;
+static const float        kMaxRate       = 16;
+static const unsigned int kMaxAnalysisHop = kHopSize * kMaxRate;
+
+// ----------------------------------------------------------
+ofxAudioUnitTimeStretcher::ofxAudioUnitTimeStretcher(unsigned int channels, unsigned int maxOutputFrames)
+: _channels(channels)
+, _inputCapacity(kMaxAnalysisHop + 2 * kSearchRadius + kFrameSize + kHopSize)
+, _outputCapacity(maxOutputFrames + kHopSize)
+, _rate(1)
+// ----------------------------------------------------------
+{
+	_input.assign(_channels * _inputCapacity, 0);
+	_mix.assign(_inputCapacity, 0);
+	_overlap.assign(_channels * kFrameSize, 0);
+	_output.assign(_channels * _outputCapacity, 0);
+	
+	// periodic, so that frames overlapped by half sum to exactly 1
+	_window.resize(kFrameSize);
+	vDSP_hann_window(&_window[0], kFrameSize, vDSP_HANN_DENORM);
+	
+	reset();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitTimeStretcher::setRate(float rate)
+// ----------------------------------------------------------
+{
+	_rate = max(kMinRate, min(rate, kMaxRate));
+}
+
+// ----------------------------------------------------------
+unsigned int ofxAudioUnitTimeStretcher::getLatency() const
+// ----------------------------------------------------------
+{
+	return kHopSize;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitTimeStretcher::reset()
+// ----------------------------------------------------------
+{
+	// starting with half a frame of silence, so the first frame of input
+	// comes out at full level rather than faded in by the window
+	memset(&_input[0], 0, _input.size() * sizeof(float));
+	memset(&_mix[0], 0, _mix.size() * sizeof(float));
+	memset(&_overlap[0], 0, _overlap.size() * sizeof(float));
+	_inputFrames  = kHopSize;
+	_outputFrames = 0;
+	_analysisPosition = 0;
+	_lastPosition = -1;
+}
+
+// ----------------------------------------------------------
+unsigned int ofxAudioUnitTimeStretcher::getInputFramesNeeded() const
+// ----------------------------------------------------------
+{
+	if(_outputFrames + kHopSize > _outputCapacity) return 0;
+	
+	// the next frame can be anywhere in the search range, which has to
+	// have been written in full before it's searched
+	long framesNeeded = (long)floor(_analysisPosition) + kFrameSize;
+	if(_lastPosition >= 0) framesNeeded += kSearchRadius;
+	
+	return max(framesNeeded - (long)_inputFrames, 0L);
+}
+
+// ----------------------------------------------------------
+unsigned int ofxAudioUnitTimeStretcher::write(const float * const * input, unsigned int frames)
+// ----------------------------------------------------------
+{
+	frames = min(frames, _inputCapacity - _inputFrames);
+	
+	float * mix = &_mix[_inputFrames];
+	for(int c = 0; c < _channels; c++)
+	{
+		memcpy(&_input[c * _inputCapacity + _inputFrames], input[c], frames * sizeof(float));
+		vDSP_vadd(mix, 1, input[c], 1, mix, 1, frames);
+	}
+	
+	_inputFrames += frames;
+	update();
+	return frames;
+}
+
+// ----------------------------------------------------------
+unsigned int ofxAudioUnitTimeStretcher::read(float * const * output, unsigned int frames)
+// ----------------------------------------------------------
+{
+	frames = min(frames, _outputFrames);
+	const unsigned int remaining = _outputFrames - frames;
+	
+	for(int c = 0; c < _channels; c++)
+	{
+		float * channel = &_output[c * _outputCapacity];
+		memcpy(output[c], channel, frames * sizeof(float));
+		memmove(channel, channel + frames, remaining * sizeof(float));
+	}
+	
+	_outputFrames = remaining;
+	update();
+	return frames;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitTimeStretcher::update()
+// ----------------------------------------------------------
+{
+	// stepping as far as the input and output space allow, so that
+	// getInputFramesNeeded() only returns 0 when the output is full
+	while(canStep()) step();
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitTimeStretcher::canStep() const
+// ----------------------------------------------------------
+{
+	return _outputFrames + kHopSize <= _outputCapacity && getInputFramesNeeded() == 0;
+}
+
+// ----------------------------------------------------------
+long ofxAudioUnitTimeStretcher::bestPosition() const
+// ----------------------------------------------------------
+{
+	const long nominal = floor(_analysisPosition);
+	if(_lastPosition < 0) return nominal;
+	
+	// the frame should start with whatever would have naturally followed
+	// the overlapping half of the previous frame
+	const float * target = &_mix[_lastPosition + kHopSize];
+	const long first = max(nominal - kSearchRadius, 0L);
+	const long last  = nominal + kSearchRadius;
+	
+	// ties go to the nominal position, which keeps silence from drifting
+	long best = nominal;
+	float bestScore;
+	vDSP_dotpr(&_mix[nominal], 2, target, 2, &bestScore, kOverlapSize / 2);
+	
+	for(long position = first; position <= last; position += kCoarseStep)
+	{
+		float score;
+		vDSP_dotpr(&_mix[position], 2, target, 2, &score, kOverlapSize / 2);
+		if(score > bestScore)
+		{
+			bestScore = score;
+			best = position;
+		}
+	}
+	
+	// refining around the coarse result at full resolution
+	const long refineFirst = max(best - kCoarseStep + 1, first);
+	const long refineLast  = min(best + kCoarseStep - 1, last);
+	vDSP_dotpr(&_mix[best], 1, target, 1, &bestScore, kOverlapSize);
+	
+	for(long position = refineFirst; position <= refineLast; position++)
+	{
+		float score;
+		vDSP_dotpr(&_mix[position], 1, target, 1, &score, kOverlapSize);
+		if(score > bestScore)
+		{
+			bestScore = score;
+			best = position;
+		}
+	}
+	
+	return best;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitTimeStretcher::step()
+// ----------------------------------------------------------
+{
+	const long position = bestPosition();
+	
+	// overlap-adding the windowed frame, after which the first hop of
+	// the overlap is finished and moves to the output
+	for(int c = 0; c < _channels; c++)
+	{
+		const float * input = &_input[c * _inputCapacity + position];
+		float * overlap = &_overlap[c * kFrameSize];
+		float * output  = &_output[c * _outputCapacity + _outputFrames];
+		
+		vDSP_vma(input, 1, &_window[0], 1, overlap, 1, overlap, 1, kFrameSize);
+		memcpy(output, overlap, kHopSize * sizeof(float));
+		memmove(overlap, overlap + kHopSize, kOverlapSize * sizeof(float));
+		memset(overlap + kOverlapSize, 0, kHopSize * sizeof(float));
+	}
+	
+	_outputFrames += kHopSize;
+	_lastPosition = position;
+	_analysisPosition += kHopSize * _rate;
+	
+	// dropping input that neither the next search nor its target reach
+	const long nominal = floor(_analysisPosition);
+	const long discard = min(min(_lastPosition + (long)kHopSize, nominal - kSearchRadius), (long)_inputFrames);
+	if(discard <= 0) return;
+	
+	const unsigned int remaining = _inputFrames - discard;
+	for(int c = 0; c < _channels; c++)
+	{
+		float * channel = &_input[c * _inputCapacity];
+		memmove(channel, channel + discard, remaining * sizeof(float));
+	}
+	memmove(&_mix[0], &_mix[discard], remaining * sizeof(float));
+	memset(&_mix[remaining], 0, discard * sizeof(float));
+	
+	_inputFrames = remaining;
+	_lastPosition -= discard;
+	_analysisPosition -= discard;
+}
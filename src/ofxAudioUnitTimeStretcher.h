@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+
+// ofxAudioUnitTimeStretcher changes the tempo of non-interleaved float
+// audio without changing its pitch, using WSOLA (waveform similarity
+// overlap-add). The output is built from overlapping windowed frames of
+// the input. Each frame is read from near where the tempo says it should
+// be, nudged to wherever it lines up best with the end of the previous
+// frame, so that the overlaps don't phase-cancel.
+
+// The rate is how many input frames are used per output frame, so 2
+// plays at double tempo and 0.5 at half. It's clamped to between 1/16
+// and 16.
+
+// It's used as a stream : write() input until getInputFramesNeeded()
+// returns 0 or enough output is available, then read() the output.
+// The output is delayed by getLatency() frames.
+
+// To keep the cost per voice down, frames are lined up using the mix of
+// all the channels, searched coarsely at every 4th lag with every 2nd
+// sample before being refined. Nothing allocates after construction, so
+// every call is safe on the render thread.
+
+class ofxAudioUnitTimeStretcher
+{
+public:
+	ofxAudioUnitTimeStretcher(unsigned int channels = 2, unsigned int maxOutputFrames = 4096);
+	
+	void  setRate(float rate);
+	float getRate() const {return _rate;}
+	unsigned int getChannels() const {return _channels;}
+	unsigned int getLatency() const;
+	
+	void reset();
+	unsigned int getInputFramesNeeded() const;
+	unsigned int write(const float * const * input, unsigned int frames);
+	unsigned int getAvailableFrames() const {return _outputFrames;}
+	unsigned int read(float * const * output, unsigned int frames);
+
+private:
+	unsigned int _channels;
+	unsigned int _inputCapacity;
+	unsigned int _outputCapacity;
+	unsigned int _inputFrames;
+	unsigned int _outputFrames;
+	float  _rate;
+	double _analysisPosition;
+	long   _lastPosition;
+	
+	std::vector<float> _input;
+	std::vector<float> _mix;
+	std::vector<float> _overlap;
+	std::vector<float> _output;
+	std::vector<float> _window;
+	
+	bool canStep() const;
+	void step();
+	long bestPosition() const;
+	void update();
+};
@@ -0,0 +1,93 @@
+#include "ofxAudioUnit.h"
+#include <mach/mach_time.h>
+
+// ----------------------------------------------------------
+ofxAudioUnitTransport::ofxAudioUnitTransport(float startLatencySeconds)
+: _startLatency(startLatencySeconds)
+, _startTime(0)
+// ----------------------------------------------------------
+{
+
+}
+
+#pragma mark - Players
+
+// ----------------------------------------------------------
+void ofxAudioUnitTransport::addPlayer(ofxAudioUnitFilePlayer &player)
+// ----------------------------------------------------------
+{
+	_filePlayers.push_back(&player);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitTransport::addPlayer(ofxAudioUnitSamplePlayer &player)
+// ----------------------------------------------------------
+{
+	_samplePlayers.push_back(&player);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitTransport::addPlayer(ofxAudioUnitStreamingFilePlayer &player)
+// ----------------------------------------------------------
+{
+	_streamingPlayers.push_back(&player);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitTransport::clearPlayers()
+// ----------------------------------------------------------
+{
+	_filePlayers.clear();
+	_samplePlayers.clear();
+	_streamingPlayers.clear();
+}
+
+#pragma mark - Playback
+
+// ----------------------------------------------------------
+uint64_t ofxAudioUnitTransport::play()
+// ----------------------------------------------------------
+{
+	return loop(0);
+}
+
+// ----------------------------------------------------------
+uint64_t ofxAudioUnitTransport::loop(unsigned int timesToLoop)
+// ----------------------------------------------------------
+{
+	// every player gets exactly the same host time, which each of them
+	// turns into a sample position against the same output clock
+	_startTime = mach_absolute_time() + ofxAudioUnitSecondsToHostTime(_startLatency);
+	
+	for(int i = 0; i < _filePlayers.size(); i++)
+	{
+		_filePlayers[i]->loop(timesToLoop, _startTime);
+	}
+	
+	for(int i = 0; i < _samplePlayers.size(); i++)
+	{
+		_samplePlayers[i]->loop(timesToLoop, _startTime);
+	}
+	
+	for(int i = 0; i < _streamingPlayers.size(); i++)
+	{
+		_streamingPlayers[i]->loop(timesToLoop, _startTime);
+	}
+	
+	if(mach_absolute_time() > _startTime)
+	{
+		cout << "ofxAudioUnitTransport took longer than its start latency to schedule "
+		<< "its players, so some of them will start late" << endl;
+	}
+	
+	return _startTime;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitTransport::stop()
+// ----------------------------------------------------------
+{
+	for(int i = 0; i < _filePlayers.size(); i++)      _filePlayers[i]->stop();
+	for(int i = 0; i < _samplePlayers.size(); i++)    _samplePlayers[i]->stop();
+	for(int i = 0; i < _streamingPlayers.size(); i++) _streamingPlayers[i]->stop();
+}
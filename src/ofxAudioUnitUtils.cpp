@@ -1,4 +1,11 @@
 #include "ofxAudioUnitUtils.h"
+#include <mach/mach_time.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <vector>
+
+// how much of the start and end of a file ofxAudioUnitHashFile() hashes
+static const size_t kHashedBytes = 65536;
 
 AudioBufferList * allocBufferList(int channels, size_t size)
 {
@@ -25,3 +32,124 @@ void releaseBufferList(AudioBufferList * bufferList)
 	
 	free(bufferList);
 }
+
+
+// ----------------------------------------------------------
+static const mach_timebase_info_data_t& hostTimebase()
+// ----------------------------------------------------------
+{
+	static mach_timebase_info_data_t timebase = {0, 0};
+	if(timebase.denom == 0) mach_timebase_info(&timebase);
+	return timebase;
+}
+
+// ----------------------------------------------------------
+uint64_t ofxAudioUnitSecondsToHostTime(double seconds)
+// ----------------------------------------------------------
+{
+	const mach_timebase_info_data_t &timebase = hostTimebase();
+	return (seconds * 1e9) * timebase.denom / timebase.numer;
+}
+
+// ----------------------------------------------------------
+double ofxAudioUnitHostTimeToSeconds(uint64_t hostTime)
+// ----------------------------------------------------------
+{
+	const mach_timebase_info_data_t &timebase = hostTimebase();
+	return ((double)hostTime * timebase.numer / timebase.denom) * 1e-9;
+}
+
+// ----------------------------------------------------------
+static void fnv1a(uint64_t &hash, const void * data, size_t bytes)
+// ----------------------------------------------------------
+{
+	const unsigned char * d = (const unsigned char *)data;
+	for(size_t i = 0; i < bytes; i++)
+	{
+		hash = (hash ^ d[i]) * 1099511628211ULL;
+	}
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitHashFile(const std::string &filePath, uint64_t &hash)
+// ----------------------------------------------------------
+{
+	struct stat info;
+	if(stat(filePath.c_str(), &info) != 0) return false;
+	
+	FILE * file = fopen(filePath.c_str(), "rb");
+	if(!file) return false;
+	
+	hash = 14695981039346656037ULL;
+	fnv1a(hash, &info.st_size, sizeof(info.st_size));
+	fnv1a(hash, &info.st_mtime, sizeof(info.st_mtime));
+	
+	std::vector<unsigned char> bytes(kHashedBytes);
+	size_t read = fread(&bytes[0], 1, kHashedBytes, file);
+	fnv1a(hash, &bytes[0], read);
+	
+	if(info.st_size > kHashedBytes)
+	{
+		fseeko(file, max((off_t)kHashedBytes, info.st_size - (off_t)kHashedBytes), SEEK_SET);
+		read = fread(&bytes[0], 1, kHashedBytes, file);
+		fnv1a(hash, &bytes[0], read);
+	}
+	
+	fclose(file);
+	return true;
+}
+
+// ----------------------------------------------------------
+static double secondsSinceStartup()
+// ----------------------------------------------------------
+{
+	return ofxAudioUnitHostTimeToSeconds(mach_absolute_time());
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitMeterBallistics::ofxAudioUnitMeterBallistics(float holdSeconds, float decayDecibelsPerSecond)
+: _lastUpdateTime(0), _holdTime(holdSeconds), _decayRate(decayDecibelsPerSecond)
+// ----------------------------------------------------------
+{
+
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitMeterBallistics::setPeakHold(float holdSeconds, float decayDecibelsPerSecond)
+// ----------------------------------------------------------
+{
+	_holdTime  = holdSeconds;
+	_decayRate = decayDecibelsPerSecond;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitMeterBallistics::process(float * levels, unsigned int meterCount, bool peaksHeld)
+// ----------------------------------------------------------
+{
+	if(_heldPeaks.size() < meterCount)
+	{
+		_heldPeaks.resize(meterCount, -120);
+		_holdStartTimes.resize(meterCount, 0);
+	}
+	
+	double now = secondsSinceStartup();
+	float elapsed = _lastUpdateTime > 0 ? now - _lastUpdateTime : 0;
+	_lastUpdateTime = now;
+	
+	for(int i = 0; i < meterCount; i++)
+	{
+		float peak = levels[i * 2 + 1];
+		
+		if(peak >= _heldPeaks[i])
+		{
+			_heldPeaks[i] = peak;
+			_holdStartTimes[i] = now;
+		}
+		else if(peaksHeld || now - _holdStartTimes[i] > _holdTime)
+		{
+			_heldPeaks[i] = max(peak, _heldPeaks[i] - _decayRate * elapsed);
+		}
+		
+		levels[i * 2 + 1] = _heldPeaks[i];
+	}
+}
@@ -1,7 +1,13 @@
 #pragma once
 
 #include <AudioToolbox/AudioToolbox.h>
+#include <string>
 #include "ofTypes.h"
+#include "ofxAudioUnitRealtimeCheck.h"
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
 
 class ofxAudioUnitTap;
 class ofxAudioUnit;
@@ -20,20 +26,105 @@ ofxAudioUnitTapSamples;
 AudioBufferList * allocBufferList(int channels = 2, size_t size = 512);
 void releaseBufferList(AudioBufferList * bufferList);
 
-// these macros make the "do core audio thing, check for error" process less repetitive
+// Converting between seconds and host time (the units of
+// mach_absolute_time() and AudioTimeStamp::mHostTime)
+uint64_t ofxAudioUnitSecondsToHostTime(double seconds);
+double   ofxAudioUnitHostTimeToSeconds(uint64_t hostTime);
+
+// A quick hash of a file's contents, for keying caches of things derived
+// from it. Only the file's size, modification time and first and last
+// 64kB are hashed, so it's cheap even for long files
+bool ofxAudioUnitHashFile(const std::string &filePath, uint64_t &hash);
+
+// ofxAudioUnitMeterBallistics adds peak-hold and decay to a set of level
+// meters. Levels are passed in as {average, peak} pairs (in decibels), and
+// each peak is replaced with the held / decaying peak for that meter. If
+// the peaks passed in are already held by whatever measured them, pass
+// peaksHeld and they're only decayed, not held a second time. It is
+// meant to be called from the thread reading the meters (eg. in update()),
+// so none of this work happens on the render thread.
+
+class ofxAudioUnitMeterBallistics
+{
+	std::vector<float>  _heldPeaks;
+	std::vector<double> _holdStartTimes;
+	double _lastUpdateTime;
+	float  _holdTime;
+	float  _decayRate;
+
+public:
+	ofxAudioUnitMeterBallistics(float holdSeconds = 1.5, float decayDecibelsPerSecond = 20);
+	
+	void setPeakHold(float holdSeconds, float decayDecibelsPerSecond);
+	void process(float * levels, unsigned int meterCount, bool peaksHeld = false);
+};
+
+// ofxAudioUnitDenormalGuard switches the current thread into flush-to-zero /
+// denormals-are-zero mode for as long as it is in scope, and restores the
+// previous mode afterwards. Decaying signals (reverb tails, filter feedback)
+// otherwise end up as denormal floats, which are extremely slow to process
+// on x86 and can cause CPU spikes just as a chain goes quiet. Every render
+// entry point in the addon creates one of these on the stack, which also
+// covers any Audio Units it pulls from.
+
+class ofxAudioUnitDenormalGuard
+{
+#if defined(__SSE__)
+	unsigned int _previousCSR;
+#elif defined(__arm64__) || defined(__aarch64__)
+	uint64_t _previousFPCR;
+#elif defined(__arm__) && defined(__VFP_FP__)
+	uint32_t _previousFPSCR;
+#endif
+	
+public:
+	ofxAudioUnitDenormalGuard()
+	{
+#if defined(__SSE__)
+		_previousCSR = _mm_getcsr();
+		_mm_setcsr(_previousCSR | 0x8040); // FTZ (bit 15) | DAZ (bit 6)
+#elif defined(__arm64__) || defined(__aarch64__)
+		__asm__ __volatile__("mrs %0, fpcr" : "=r"(_previousFPCR));
+		uint64_t fpcr = _previousFPCR | (1ULL << 24); // FZ
+		__asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr));
+#elif defined(__arm__) && defined(__VFP_FP__)
+		__asm__ __volatile__("vmrs %0, fpscr" : "=r"(_previousFPSCR));
+		uint32_t fpscr = _previousFPSCR | (1U << 24); // FZ
+		__asm__ __volatile__("vmsr fpscr, %0" : : "r"(fpscr));
+#endif
+	}
+	
+	~ofxAudioUnitDenormalGuard()
+	{
+#if defined(__SSE__)
+		_mm_setcsr(_previousCSR);
+#elif defined(__arm64__) || defined(__aarch64__)
+		__asm__ __volatile__("msr fpcr, %0" : : "r"(_previousFPCR));
+#elif defined(__arm__) && defined(__VFP_FP__)
+		__asm__ __volatile__("vmsr fpscr, %0" : : "r"(_previousFPSCR));
+#endif
+	}
+};
+
+// these macros make the "do core audio thing, check for error" process less repetitive.
+// Printing isn't real-time safe, so they'll also flag a violation if they
+// end up printing from a render thread (see ofxAudioUnitRealtimeCheck.h)
 #define OFXAU_PRINT(s, stage)\
 if(s!=noErr){\
+	OFXAU_REALTIME_VIOLATION("writing to std::cout");\
 	std::cout << "Error " << (OSStatus)s << " while " << stage << std::endl;\
 }
 
 #define OFXAU_RETURN(s, stage)\
 if(s!=noErr){\
+	OFXAU_REALTIME_VIOLATION("writing to std::cout");\
 	std::cout << "Error " << (OSStatus)s << " while " << stage << std::endl;\
 	return;\
 }
 
 #define OFXAU_RET_BOOL(s, stage)\
 if(s!=noErr){\
+	OFXAU_REALTIME_VIOLATION("writing to std::cout");\
 	std::cout << "Error " << (OSStatus)s << " while " << stage << std::endl;\
 	return false;\
 }\
@@ -41,6 +132,7 @@ return true;
 
 #define OFXAU_RET_FALSE(s, stage)\
 if(s!=noErr){\
+	OFXAU_REALTIME_VIOLATION("writing to std::cout");\
 	std::cout << "Error " << (OSStatus)s << " while " << stage << std::endl;\
 	return false;\
 }
@@ -48,6 +140,7 @@ if(s!=noErr){\
 #define OFXAU_RET_STATUS(s, stage)\
 OSStatus stat = s;\
 if(stat!=noErr){\
+	OFXAU_REALTIME_VIOLATION("writing to std::cout");\
 	std::cout << "Error " << (OSStatus)s << " while " << stage << std::endl;\
 	return stat;\
 }
@@ -0,0 +1,678 @@
+#include "ofxAudioUnitWaveformOverview.h"
+#include "ofxAudioUnitThreadPool.h"
+#include "ofxAudioUnitUtils.h"
+#include <Accelerate/Accelerate.h>
+#include <libkern/OSAtomic.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <iostream>
+#include <algorithm>
+
+using namespace std;
+
+// the finest level of the overview has one min / max pair per channel for
+// every kBlockFrames frames, and each level above it has half as many
+static const UInt32 kBlockFrames = 256;
+
+// how many frames each read from the file decodes
+static const UInt32 kReadFrames = 16384;
+
+// files are split into at least this many frames per chunk (about 24
+// seconds at 44.1kHz), so short files aren't split into pointless jobs
+static const SInt64 kMinChunkFrames = 1 << 20;
+
+static const char kCacheMagic[8] = {'O', 'F', 'X', 'P', 'E', 'A', 'K', '1'};
+
+static std::string s_cacheDirectory = std::string(getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp/") + "ofxAudioUnitPeaks";
+
+// guards every overview's _generation and every generation's overview,
+// which is how the two find out about each other going away
+static ofMutex s_generationMutex;
+
+struct ofxAudioUnitWaveformOverview::Peaks
+{
+	UInt32  channels;
+	SInt64  frames;
+	Float64 sampleRate;
+	std::vector<std::vector<float> > levels;
+	
+	SInt64 getBlocks(unsigned int level) const {return levels[level].size() / (2 * channels);}
+	void buildLevels();
+};
+
+struct ofxAudioUnitWaveformOverview::Generation
+{
+	struct Chunk
+	{
+		Generation * generation;
+		SInt64 startFrame;
+		SInt64 frames;
+	};
+	
+	ofxAudioUnitWaveformOverview * overview;
+	std::string filePath;
+	std::string cachePath;
+	uint64_t hash;
+	ofPtr<Peaks> peaks;
+	std::vector<Chunk> chunks;
+	volatile int32_t chunksRemaining;
+	volatile bool cancelled;
+	volatile bool failed;
+};
+
+struct CacheHeader
+{
+	char     magic[8];
+	uint64_t hash;
+	uint32_t channels;
+	uint32_t blockFrames;
+	int64_t  frames;
+	double   sampleRate;
+};
+
+#pragma mark - Caching
+
+// ----------------------------------------------------------
+static std::string cachePathForFile(uint64_t hash)
+// ----------------------------------------------------------
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.peaks", (unsigned long long)hash);
+	return s_cacheDirectory + "/" + name;
+}
+
+// ----------------------------------------------------------
+static bool readCache(const std::string &cachePath, uint64_t hash, std::vector<std::vector<float> > &levels,
+					  UInt32 &channels, SInt64 &frames, Float64 &sampleRate)
+// ----------------------------------------------------------
+{
+	FILE * file = fopen(cachePath.c_str(), "rb");
+	if(!file) return false;
+	
+	CacheHeader header;
+	bool valid = fread(&header, sizeof(header), 1, file) == 1
+	          && memcmp(header.magic, kCacheMagic, sizeof(kCacheMagic)) == 0
+	          && header.hash == hash
+	          && header.blockFrames == kBlockFrames
+	          && header.channels > 0
+	          && header.frames >= 0;
+	
+	if(valid)
+	{
+		const SInt64 blocks = (header.frames + kBlockFrames - 1) / kBlockFrames;
+		levels.assign(1, std::vector<float>(blocks * header.channels * 2));
+		valid = blocks == 0 || fread(&levels[0][0], sizeof(float), levels[0].size(), file) == levels[0].size();
+		
+		channels   = header.channels;
+		frames     = header.frames;
+		sampleRate = header.sampleRate;
+	}
+	
+	fclose(file);
+	return valid;
+}
+
+// ----------------------------------------------------------
+static void writeCache(const std::string &cachePath, uint64_t hash, const std::vector<float> &peaks,
+					   UInt32 channels, SInt64 frames, Float64 sampleRate)
+// ----------------------------------------------------------
+{
+	// written under a temporary name and moved into place, so a reader
+	// never sees half a file
+	mkdir(s_cacheDirectory.c_str(), 0755);
+	const std::string tempPath = cachePath + ".tmp";
+	FILE * file = fopen(tempPath.c_str(), "wb");
+	if(!file) return;
+	
+	CacheHeader header;
+	memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+	header.hash        = hash;
+	header.channels    = channels;
+	header.blockFrames = kBlockFrames;
+	header.frames      = frames;
+	header.sampleRate  = sampleRate;
+	
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1
+	            && (peaks.empty() || fwrite(&peaks[0], sizeof(float), peaks.size(), file) == peaks.size());
+	
+	fclose(file);
+	
+	if(!written || rename(tempPath.c_str(), cachePath.c_str()) != 0)
+	{
+		unlink(tempPath.c_str());
+	}
+}
+
+#pragma mark - Peaks
+
+// ----------------------------------------------------------
+void ofxAudioUnitWaveformOverview::Peaks::buildLevels()
+// ----------------------------------------------------------
+{
+	levels.resize(1);
+	
+	while(getBlocks(levels.size() - 1) > 1)
+	{
+		const std::vector<float> &below = levels.back();
+		const SInt64 belowBlocks = getBlocks(levels.size() - 1);
+		const SInt64 blocks = (belowBlocks + 1) / 2;
+		std::vector<float> level(blocks * channels * 2);
+		
+		for(SInt64 b = 0; b < blocks; b++)
+		{
+			const SInt64 first = 2 * b;
+			const SInt64 second = min(first + 1, belowBlocks - 1);
+			
+			for(int c = 0; c < channels; c++)
+			{
+				const float * p = &below[(first  * channels + c) * 2];
+				const float * q = &below[(second * channels + c) * 2];
+				level[(b * channels + c) * 2]     = min(p[0], q[0]);
+				level[(b * channels + c) * 2 + 1] = max(p[1], q[1]);
+			}
+		}
+		
+		levels.push_back(level);
+	}
+}
+
+#pragma mark - Overview
+
+// ----------------------------------------------------------
+ofxAudioUnitWaveformOverview::ofxAudioUnitWaveformOverview()
+: _lazy(false)
+, _generation(NULL)
+// ----------------------------------------------------------
+{
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitWaveformOverview::~ofxAudioUnitWaveformOverview()
+// ----------------------------------------------------------
+{
+	cancelGeneration();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitWaveformOverview::setCacheDirectory(const std::string &directory)
+// ----------------------------------------------------------
+{
+	s_cacheDirectory = directory;
+}
+
+// ----------------------------------------------------------
+std::string ofxAudioUnitWaveformOverview::getCacheDirectory()
+// ----------------------------------------------------------
+{
+	return s_cacheDirectory;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitWaveformOverview::clear()
+// ----------------------------------------------------------
+{
+	cancelGeneration();
+	
+	OFXAU_REALTIME_LOCK(_mutex);
+	_peaks.reset();
+	_pendingFilePath.clear();
+	_mutex.unlock();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitWaveformOverview::setFile(const std::string &filePath)
+// ----------------------------------------------------------
+{
+	if(!_lazy)
+	{
+		load(filePath);
+		return;
+	}
+	
+	clear();
+	
+	OFXAU_REALTIME_LOCK(_mutex);
+	_pendingFilePath = filePath;
+	_mutex.unlock();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitWaveformOverview::loadPendingFile()
+// ----------------------------------------------------------
+{
+	OFXAU_REALTIME_LOCK(_mutex);
+	std::string filePath;
+	filePath.swap(_pendingFilePath);
+	_mutex.unlock();
+	
+	if(!filePath.empty()) load(filePath);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitWaveformOverview::load(const std::string &filePath)
+// ----------------------------------------------------------
+{
+	clear();
+	
+	uint64_t hash = 0;
+	if(!ofxAudioUnitHashFile(filePath, hash))
+	{
+		cout << "Error while reading file at " << filePath << " for its overview" << endl;
+		return;
+	}
+	
+	const std::string cachePath = cachePathForFile(hash);
+	ofPtr<Peaks> peaks(new Peaks);
+	
+	if(readCache(cachePath, hash, peaks->levels, peaks->channels, peaks->frames, peaks->sampleRate))
+	{
+		peaks->buildLevels();
+		publish(peaks);
+		return;
+	}
+	
+	// finding out how much there is to decode
+	CFURLRef fileURL;
+	fileURL = CFURLCreateFromFileSystemRepresentation(kCFAllocatorDefault,
+	                                                  (const UInt8 *)filePath.c_str(),
+	                                                  filePath.length(),
+	                                                  NULL);
+	
+	ExtAudioFileRef file = NULL;
+	OSStatus s = ExtAudioFileOpenURL(fileURL, &file);
+	CFRelease(fileURL);
+	
+	AudioStreamBasicDescription fileFormat = {0};
+	SInt64 fileFrames = 0;
+	
+	if(s == noErr)
+	{
+		UInt32 dataSize = sizeof(fileFormat);
+		s = ExtAudioFileGetProperty(file, kExtAudioFileProperty_FileDataFormat, &dataSize, &fileFormat);
+	}
+	
+	if(s == noErr)
+	{
+		UInt32 dataSize = sizeof(fileFrames);
+		s = ExtAudioFileGetProperty(file, kExtAudioFileProperty_FileLengthFrames, &dataSize, &fileFrames);
+	}
+	
+	if(file) ExtAudioFileDispose(file);
+	
+	if(s != noErr || fileFormat.mChannelsPerFrame == 0)
+	{
+		cout << "Error " << s << " while opening file at " << filePath << " for its overview" << endl;
+		return;
+	}
+	
+	peaks->channels   = fileFormat.mChannelsPerFrame;
+	peaks->frames     = fileFrames;
+	peaks->sampleRate = fileFormat.mSampleRate;
+	peaks->levels.assign(1, std::vector<float>(((fileFrames + kBlockFrames - 1) / kBlockFrames) * peaks->channels * 2));
+	
+	Generation * generation = new Generation;
+	generation->overview        = this;
+	generation->filePath        = filePath;
+	generation->cachePath       = cachePath;
+	generation->hash            = hash;
+	generation->peaks           = peaks;
+	generation->cancelled       = false;
+	generation->failed          = false;
+	
+	// splitting the file into a chunk or two per worker, each a whole
+	// number of blocks long so that no block straddles two chunks
+	ofxAudioUnitThreadPool &pool = ofxAudioUnitThreadPool::shared();
+	SInt64 chunkFrames = max(kMinChunkFrames, fileFrames / (2 * (SInt64)pool.getThreadCount()) + 1);
+	chunkFrames = ((chunkFrames + kBlockFrames - 1) / kBlockFrames) * kBlockFrames;
+	
+	SInt64 startFrame = 0;
+	do
+	{
+		Generation::Chunk chunk = {generation, startFrame, min(chunkFrames, fileFrames - startFrame)};
+		generation->chunks.push_back(chunk);
+		startFrame += chunkFrames;
+	}
+	while(startFrame < fileFrames);
+	
+	generation->chunksRemaining = generation->chunks.size();
+	
+	OFXAU_REALTIME_LOCK(s_generationMutex);
+	_generation = generation;
+	s_generationMutex.unlock();
+	
+	for(int i = 0; i < generation->chunks.size(); i++)
+	{
+		pool.addJob(generateChunk, &generation->chunks[i]);
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitWaveformOverview::cancelGeneration()
+// ----------------------------------------------------------
+{
+	// this doesn't wait for the generation's chunks, since it may be
+	// called from a pool job that they're queued behind. The chunks that
+	// haven't run yet return straight away, and the last one deletes the
+	// generation
+	OFXAU_REALTIME_LOCK(s_generationMutex);
+	if(_generation)
+	{
+		_generation->overview  = NULL;
+		_generation->cancelled = true;
+		_generation = NULL;
+	}
+	s_generationMutex.unlock();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitWaveformOverview::publish(const PeaksRef &peaks)
+// ----------------------------------------------------------
+{
+	OFXAU_REALTIME_LOCK(_mutex);
+	_peaks = peaks;
+	_mutex.unlock();
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitWaveformOverview::PeaksRef ofxAudioUnitWaveformOverview::peaks()
+// ----------------------------------------------------------
+{
+	// every query goes through here, so the first one starts the load
+	loadPendingFile();
+	
+	OFXAU_REALTIME_LOCK(_mutex);
+	PeaksRef peaks = _peaks;
+	_mutex.unlock();
+	return peaks;
+}
+
+#pragma mark - Generation
+
+// ----------------------------------------------------------
+static void storeBlock(std::vector<float> &peaks, SInt64 block, std::vector<float> &minimums, std::vector<float> &maximums)
+// ----------------------------------------------------------
+{
+	const UInt32 channels = minimums.size();
+	if((block + 1) * channels * 2 > peaks.size()) return;
+	
+	for(int c = 0; c < channels; c++)
+	{
+		peaks[(block * channels + c) * 2]     = minimums[c];
+		peaks[(block * channels + c) * 2 + 1] = maximums[c];
+		minimums[c] = FLT_MAX;
+		maximums[c] = -FLT_MAX;
+	}
+}
+
+// ----------------------------------------------------------
+static bool decodeChunk(const std::string &filePath, UInt32 channels, Float64 sampleRate,
+						SInt64 startFrame, SInt64 frames, std::vector<float> &peaks,
+						const volatile bool &cancelled)
+// ----------------------------------------------------------
+{
+	CFURLRef fileURL;
+	fileURL = CFURLCreateFromFileSystemRepresentation(kCFAllocatorDefault,
+	                                                  (const UInt8 *)filePath.c_str(),
+	                                                  filePath.length(),
+	                                                  NULL);
+	
+	ExtAudioFileRef file = NULL;
+	OSStatus s = ExtAudioFileOpenURL(fileURL, &file);
+	CFRelease(fileURL);
+	
+	// decoding at the file's own rate, so that frames in the overview
+	// are frames in the file
+	AudioStreamBasicDescription clientFormat = {0};
+	clientFormat.mSampleRate       = sampleRate;
+	clientFormat.mFormatID         = kAudioFormatLinearPCM;
+	clientFormat.mFormatFlags      = kAudioFormatFlagsNativeFloatPacked | kAudioFormatFlagIsNonInterleaved;
+	clientFormat.mBitsPerChannel   = sizeof(float) * 8;
+	clientFormat.mChannelsPerFrame = channels;
+	clientFormat.mFramesPerPacket  = 1;
+	clientFormat.mBytesPerFrame    = sizeof(float);
+	clientFormat.mBytesPerPacket   = sizeof(float);
+	
+	if(s == noErr) s = ExtAudioFileSetProperty(file, kExtAudioFileProperty_ClientDataFormat, sizeof(clientFormat), &clientFormat);
+	if(s == noErr) s = ExtAudioFileSeek(file, startFrame);
+	
+	if(s != noErr)
+	{
+		cout << "Error " << s << " while reading audio from file at " << filePath << " for its overview" << endl;
+		if(file) ExtAudioFileDispose(file);
+		return false;
+	}
+	
+	std::vector<float> samples(channels * kReadFrames);
+	std::vector<float> minimums(channels, FLT_MAX);
+	std::vector<float> maximums(channels, -FLT_MAX);
+	
+	size_t listSize = offsetof(AudioBufferList, mBuffers[0]) + channels * sizeof(AudioBuffer);
+	AudioBufferList * bufferList = (AudioBufferList *)malloc(listSize);
+	bufferList->mNumberBuffers = channels;
+	
+	SInt64 block = startFrame / kBlockFrames;
+	SInt64 remaining = frames;
+	UInt32 blockFill = 0;
+	
+	while(remaining > 0 && !cancelled)
+	{
+		UInt32 framesRead = min((SInt64)kReadFrames, remaining);
+		for(int c = 0; c < channels; c++)
+		{
+			bufferList->mBuffers[c].mNumberChannels = 1;
+			bufferList->mBuffers[c].mData           = &samples[c * kReadFrames];
+			bufferList->mBuffers[c].mDataByteSize   = framesRead * sizeof(float);
+		}
+		
+		s = ExtAudioFileRead(file, &framesRead, bufferList);
+		if(s != noErr || framesRead == 0) break;
+		
+		// reads don't have to line up with blocks, so a block's min and
+		// max are built up across reads
+		for(UInt32 offset = 0; offset < framesRead; )
+		{
+			const UInt32 length = min(kBlockFrames - blockFill, framesRead - offset);
+			
+			for(int c = 0; c < channels; c++)
+			{
+				float lo, hi;
+				vDSP_minv(&samples[c * kReadFrames + offset], 1, &lo, length);
+				vDSP_maxv(&samples[c * kReadFrames + offset], 1, &hi, length);
+				minimums[c] = min(minimums[c], lo);
+				maximums[c] = max(maximums[c], hi);
+			}
+			
+			offset    += length;
+			blockFill += length;
+			
+			if(blockFill == kBlockFrames)
+			{
+				storeBlock(peaks, block++, minimums, maximums);
+				blockFill = 0;
+			}
+		}
+		
+		remaining -= framesRead;
+	}
+	
+	// the last block of the file is usually short
+	if(blockFill > 0) storeBlock(peaks, block, minimums, maximums);
+	
+	free(bufferList);
+	ExtAudioFileDispose(file);
+	
+	if(s != noErr)
+	{
+		cout << "Error " << s << " while reading audio from file at " << filePath << " for its overview" << endl;
+		return false;
+	}
+	
+	return true;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitWaveformOverview::generateChunk(void * context)
+// ----------------------------------------------------------
+{
+	Generation::Chunk * chunk = (Generation::Chunk *)context;
+	Generation * generation = chunk->generation;
+	
+	if(!generation->cancelled && !generation->failed)
+	{
+		const Peaks &peaks = *generation->peaks;
+		const bool decoded = decodeChunk(generation->filePath, peaks.channels, peaks.sampleRate,
+		                                 chunk->startFrame, chunk->frames,
+		                                 generation->peaks->levels[0], generation->cancelled);
+		if(!decoded) generation->failed = true;
+	}
+	
+	// the last chunk to finish finishes the whole generation
+	if(OSAtomicDecrement32Barrier(&generation->chunksRemaining) == 0)
+	{
+		finishGeneration(generation);
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitWaveformOverview::finishGeneration(Generation * generation)
+// ----------------------------------------------------------
+{
+	const bool succeeded = !generation->cancelled && !generation->failed;
+	
+	if(succeeded)
+	{
+		Peaks &peaks = *generation->peaks;
+		writeCache(generation->cachePath, generation->hash, peaks.levels[0], peaks.channels, peaks.frames, peaks.sampleRate);
+		peaks.buildLevels();
+	}
+	
+	OFXAU_REALTIME_LOCK(s_generationMutex);
+	ofxAudioUnitWaveformOverview * overview = generation->overview;
+	if(overview)
+	{
+		overview->_generation = NULL;
+		if(succeeded) overview->publish(generation->peaks);
+	}
+	s_generationMutex.unlock();
+	
+	delete generation;
+}
+
+#pragma mark - Queries
+
+// ----------------------------------------------------------
+bool ofxAudioUnitWaveformOverview::isReady()
+// ----------------------------------------------------------
+{
+	PeaksRef p = peaks();
+	return p.get() != NULL;
+}
+
+// ----------------------------------------------------------
+float ofxAudioUnitWaveformOverview::getProgress()
+// ----------------------------------------------------------
+{
+	if(isReady()) return 1;
+	
+	float progress = 0;
+	
+	OFXAU_REALTIME_LOCK(s_generationMutex);
+	if(_generation)
+	{
+		const float chunks = _generation->chunks.size();
+		progress = (chunks - _generation->chunksRemaining) / chunks;
+	}
+	s_generationMutex.unlock();
+	
+	return progress;
+}
+
+// ----------------------------------------------------------
+SInt64 ofxAudioUnitWaveformOverview::getLength()
+// ----------------------------------------------------------
+{
+	PeaksRef p = peaks();
+	return p ? p->frames : 0;
+}
+
+// ----------------------------------------------------------
+UInt32 ofxAudioUnitWaveformOverview::getChannels()
+// ----------------------------------------------------------
+{
+	PeaksRef p = peaks();
+	return p ? p->channels : 0;
+}
+
+// ----------------------------------------------------------
+Float64 ofxAudioUnitWaveformOverview::getSampleRate()
+// ----------------------------------------------------------
+{
+	PeaksRef p = peaks();
+	return p ? p->sampleRate : 0;
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitWaveformOverview::getPeaks(float * minimums, float * maximums, unsigned int points,
+											unsigned int channel, SInt64 startFrame, SInt64 endFrame)
+// ----------------------------------------------------------
+{
+	PeaksRef p = peaks();
+	if(!p || channel >= p->channels || points == 0 || p->frames == 0) return false;
+	
+	if(endFrame < 0 || endFrame > p->frames) endFrame = p->frames;
+	startFrame = max(startFrame, (SInt64)0);
+	if(endFrame <= startFrame) return false;
+	
+	// the coarsest level that still has at least one block per point
+	const double framesPerPoint = (double)(endFrame - startFrame) / points;
+	unsigned int level = 0;
+	while(level + 1 < p->levels.size() && ((SInt64)kBlockFrames << (level + 1)) <= framesPerPoint) level++;
+	
+	const std::vector<float> &peaks = p->levels[level];
+	const double blockFrames = (SInt64)kBlockFrames << level;
+	const SInt64 blocks = p->getBlocks(level);
+	
+	for(unsigned int i = 0; i < points; i++)
+	{
+		const SInt64 first = min((SInt64)floor((startFrame + i * framesPerPoint) / blockFrames), blocks - 1);
+		const SInt64 last  = min(max((SInt64)ceil((startFrame + (i + 1) * framesPerPoint) / blockFrames), first + 1), blocks);
+		
+		float lo = FLT_MAX, hi = -FLT_MAX;
+		for(SInt64 b = first; b < last; b++)
+		{
+			lo = min(lo, peaks[(b * p->channels + channel) * 2]);
+			hi = max(hi, peaks[(b * p->channels + channel) * 2 + 1]);
+		}
+		
+		minimums[i] = lo;
+		maximums[i] = hi;
+	}
+	
+	return true;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitWaveformOverview::getWaveform(ofPolyline &outLine, float width, float height, unsigned int channel)
+// ----------------------------------------------------------
+{
+	outLine.clear();
+	
+	const unsigned int points = max(1, (int)width);
+	std::vector<float> minimums(points), maximums(points);
+	if(!getPeaks(&minimums[0], &maximums[0], points, channel)) return;
+	
+	// along the tops of the peaks, then back along the bottoms
+	const float xStep = width / points;
+	for(int i = 0; i < points; i++)
+	{
+		outLine.addVertex(ofPoint(i * xStep, ofMap(maximums[i], -1, 1, height, 0, true)));
+	}
+	for(int i = points - 1; i >= 0; i--)
+	{
+		outLine.addVertex(ofPoint(i * xStep, ofMap(minimums[i], -1, 1, height, 0, true)));
+	}
+	outLine.close();
+}
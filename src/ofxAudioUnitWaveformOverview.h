@@ -0,0 +1,85 @@
+#pragma once
+
+#include <AudioToolbox/AudioToolbox.h>
+#include <string>
+#include <vector>
+#include "ofTypes.h"
+#include "ofPolyline.h"
+
+// ofxAudioUnitWaveformOverview holds the min / max peaks of a whole file,
+// at several resolutions, for drawing an overview of it without decoding
+// it on the spot.
+
+// load() returns right away. If the file's peaks have been cached on
+// disk they're read in straight away, otherwise they're generated in the
+// background, with the file split into chunks that are decoded in
+// parallel on ofxAudioUnitThreadPool. Until then, isReady() is false and
+// queries return nothing.
+
+// setFile() is what the players call when they open a file. It load()s
+// the file straight away, so the overview is usually ready by the time
+// it's first drawn. With setLazy(true), setFile() only remembers the
+// file and load()s it the first time the overview is queried instead,
+// so that files whose overviews are never drawn aren't decoded for them.
+
+// Peaks are cached in ".peaks" files in the cache directory, which
+// defaults to a folder in the app's temporary directory. Each is named
+// after a hash of its source (its size, modification time and first and
+// last 64kB), so it's regenerated if the source changes. If the cache
+// can't be written, the peaks are only kept in memory.
+
+// Queries are safe from any non-render thread.
+
+class ofxAudioUnitWaveformOverview
+{
+public:
+	ofxAudioUnitWaveformOverview();
+	~ofxAudioUnitWaveformOverview();
+	
+	void  load(const std::string &filePath);
+	void  setFile(const std::string &filePath);
+	void  clear();
+	
+	void  setLazy(bool lazy) {_lazy = lazy;}
+	bool  isLazy() const {return _lazy;}
+	
+	bool  isReady();
+	float getProgress();
+	
+	SInt64  getLength();
+	UInt32  getChannels();
+	Float64 getSampleRate();
+	
+	// fills points mins and maxes, each covering an equal part of the
+	// frames from startFrame to endFrame (-1 for the end of the file)
+	bool getPeaks(float * minimums, float * maximums, unsigned int points,
+				  unsigned int channel = 0, SInt64 startFrame = 0, SInt64 endFrame = -1);
+	
+	// the outline of the peaks, as a closed shape width wide and height tall
+	void getWaveform(ofPolyline &outLine, float width, float height, unsigned int channel = 0);
+	
+	static void setCacheDirectory(const std::string &directory);
+	static std::string getCacheDirectory();
+
+private:
+	struct Peaks;
+	struct Generation;
+	typedef ofPtr<const Peaks> PeaksRef;
+	
+	PeaksRef _peaks;
+	std::string _pendingFilePath;
+	bool _lazy;
+	Generation * _generation;
+	ofMutex _mutex;
+	
+	ofxAudioUnitWaveformOverview(const ofxAudioUnitWaveformOverview &orig);
+	ofxAudioUnitWaveformOverview& operator=(const ofxAudioUnitWaveformOverview &orig);
+	
+	PeaksRef peaks();
+	void loadPendingFile();
+	void cancelGeneration();
+	void publish(const PeaksRef &peaks);
+	
+	static void generateChunk(void * context);
+	static void finishGeneration(Generation * generation);
+};